@@ -0,0 +1,107 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "bt_app_asrc.h"
+
+static inline int16_t bt_app_asrc_sat16(int32_t v)
+{
+    if (v > 32767) {
+        return 32767;
+    } else if (v < -32768) {
+        return -32768;
+    }
+    return (int16_t)v;
+}
+
+/* Hermite interpolation between x1 and x2, t in Q15; coefficients are kept doubled */
+static inline int16_t bt_app_asrc_hermite(int32_t x0, int32_t x1, int32_t x2, int32_t x3, int32_t t)
+{
+    int32_t c1 = x2 - x0;
+    int32_t c2 = 2 * x0 - 5 * x1 + 4 * x2 - x3;
+    int32_t c3 = (x3 - x0) + 3 * (x1 - x2);
+
+    int64_t acc = ((int64_t)c3 * t) >> 15;
+    acc = ((acc + c2) * t) >> 15;
+    acc = ((acc + c1) * t) >> 16;
+
+    return bt_app_asrc_sat16(x1 + (int32_t)acc);
+}
+
+static void bt_app_asrc_update_step(bt_app_asrc_t *s)
+{
+    uint64_t step = s->base_step + (int64_t)s->base_step * s->ppb / 1000000000LL;
+    s->step_int = (uint32_t)(step >> 32);
+    s->step_frac = (uint32_t)step;
+}
+
+void bt_app_asrc_init(bt_app_asrc_t *s, uint32_t in_rate, uint32_t out_rate)
+{
+    memset(s, 0, sizeof(bt_app_asrc_t));
+    s->base_step = ((uint64_t)in_rate << 32) / out_rate;
+    s->need = 1;
+    bt_app_asrc_update_step(s);
+}
+
+void bt_app_asrc_set_drift(bt_app_asrc_t *s, int32_t ppb)
+{
+    if (ppb > BT_APP_ASRC_MAX_PPB) {
+        ppb = BT_APP_ASRC_MAX_PPB;
+    } else if (ppb < -BT_APP_ASRC_MAX_PPB) {
+        ppb = -BT_APP_ASRC_MAX_PPB;
+    }
+    if (ppb != s->ppb) {
+        s->ppb = ppb;
+        bt_app_asrc_update_step(s);
+    }
+}
+
+uint32_t bt_app_asrc_max_out(const bt_app_asrc_t *s, uint32_t in_frames)
+{
+    uint64_t step = ((uint64_t)s->step_int << 32) | s->step_frac;
+    return (uint32_t)(((uint64_t)in_frames << 32) / step) + 2;
+}
+
+uint32_t bt_app_asrc_process(bt_app_asrc_t *s, const int16_t *in, uint32_t in_frames, int16_t *out)
+{
+    int32_t l0 = s->hist[0][0], l1 = s->hist[1][0], l2 = s->hist[2][0], l3 = s->hist[3][0];
+    int32_t r0 = s->hist[0][1], r1 = s->hist[1][1], r2 = s->hist[2][1], r3 = s->hist[3][1];
+    uint32_t frac = s->frac;
+    uint32_t need = s->need;
+    int16_t *o = out;
+
+    while (in_frames--) {
+        l0 = l1; l1 = l2; l2 = l3; l3 = in[0];
+        r0 = r1; r1 = r2; r2 = r3; r3 = in[1];
+        in += 2;
+
+        if (--need > 0) {
+            continue;
+        }
+
+        do {
+            int32_t t = (int32_t)(frac >> 17);
+            o[0] = bt_app_asrc_hermite(l0, l1, l2, l3, t);
+            o[1] = bt_app_asrc_hermite(r0, r1, r2, r3, t);
+            o += 2;
+
+            uint32_t next = frac + s->step_frac;
+            need = s->step_int + (next < frac);
+            frac = next;
+        } while (need == 0);
+    }
+
+    s->hist[0][0] = l0; s->hist[1][0] = l1; s->hist[2][0] = l2; s->hist[3][0] = l3;
+    s->hist[0][1] = r0; s->hist[1][1] = r1; s->hist[2][1] = r2; s->hist[3][1] = r3;
+    s->frac = frac;
+    s->need = need;
+
+    return (uint32_t)(o - out) / 2;
+}
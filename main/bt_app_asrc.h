@@ -0,0 +1,65 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef __BT_APP_ASRC_H__
+#define __BT_APP_ASRC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* largest drift correction, in parts per billion (+-500 ppm) */
+#define BT_APP_ASRC_MAX_PPB          (500000)
+
+/**
+ * @brief     fixed-point fractional resampler for interleaved 16-bit stereo
+ *
+ * 4-point Hermite interpolation with a Q32.32 input step. The step is the nominal
+ * in/out rate ratio trimmed by a drift correction in parts per billion.
+ */
+typedef struct {
+    uint64_t             base_step;    /*!< nominal in_rate / out_rate, Q32.32 */
+    uint32_t             step_int;     /*!< integer part of the trimmed step */
+    uint32_t             step_frac;    /*!< fractional part of the trimmed step, Q0.32 */
+    uint32_t             frac;         /*!< output position between hist[1] and hist[2], Q0.32 */
+    uint32_t             need;         /*!< input frames to push before the next output */
+    int32_t              ppb;          /*!< current drift correction */
+    int16_t              hist[4][2];   /*!< last four input frames, oldest first */
+} bt_app_asrc_t;
+
+void bt_app_asrc_init(bt_app_asrc_t *s, uint32_t in_rate, uint32_t out_rate);
+
+/**
+ * @brief     trim the step by ppb parts per billion, clamped to BT_APP_ASRC_MAX_PPB
+ *
+ * Positive values consume input faster than nominal.
+ */
+void bt_app_asrc_set_drift(bt_app_asrc_t *s, int32_t ppb);
+
+/**
+ * @brief     upper bound of output frames produced from in_frames input frames
+ */
+uint32_t bt_app_asrc_max_out(const bt_app_asrc_t *s, uint32_t in_frames);
+
+/**
+ * @brief     resample in_frames frames from in into out
+ *
+ * out must hold bt_app_asrc_max_out(s, in_frames) frames.
+ *
+ * @return    number of frames written to out
+ */
+uint32_t bt_app_asrc_process(bt_app_asrc_t *s, const int16_t *in, uint32_t in_frames, int16_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BT_APP_ASRC_H__ */
@@ -15,6 +15,12 @@
 
 #include "bt_app_core.h"
 #include "bt_app_av.h"
+#include "bt_app_i2s.h"
+#include "bt_app_dsp.h"
+#include "bt_app_volume.h"
+#include "bt_app_clock.h"
+#include "bt_app_rn.h"
+#include "bt_app_pt.h"
 #include "esp_bt_main.h"
 #include "esp_bt_device.h"
 #include "esp_gap_bt_api.h"
@@ -25,12 +31,24 @@
 #include "freertos/task.h"
 #include "driver/i2s.h"
 
+/* coalescing keys, a newer message of the same kind replaces one still queued */
+#define BT_AV_COALESCE_NOTIFY(evt)   (0x0100 | (evt))
+#define BT_AV_COALESCE_META(attr)    (0x0200 | (attr))
+#define BT_AV_COALESCE_VOLUME        (0x0300)
+
+/* periodic summary, logged from its own low priority task so the audio data path never waits on the console */
+#define BT_AV_STATS_PERIOD_MS        (2000)
+#define BT_AV_STATS_TASK_STACK       (3072)
+#define BT_AV_STATS_TASK_PRIO        (tskIDLE_PRIORITY + 1)
+
 /* a2dp event handler */
 static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param);
 /* avrc event handler */
 static void bt_av_hdl_avrc_evt(uint16_t event, void *p_param);
+/* avrc target event handler */
+static void bt_av_hdl_avrc_tg_evt(uint16_t event, void *p_param);
 
-static uint32_t m_pkt_cnt = 0;
+static volatile uint32_t m_pkt_cnt = 0;
 static esp_a2d_audio_state_t m_audio_state = ESP_A2D_AUDIO_STATE_STOPPED;
 static const char *m_a2d_conn_state_str[] = {"Disconnected", "Connecting", "Connected", "Disconnecting"};
 static const char *m_a2d_audio_state_str[] = {"Suspended", "Stopped", "Started"};
@@ -53,40 +71,131 @@ void bt_app_a2d_cb(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param)
 
 void bt_app_a2d_data_cb(const uint8_t *data, uint32_t len)
 {
-    i2s_write_bytes(0, (const char *)data, len, portMAX_DELAY);
-    if (++m_pkt_cnt % 100 == 0) {
-        ESP_LOGI(BT_AV_TAG, "Audio packet count %u", m_pkt_cnt);
+    bt_app_i2s_write(data, len);
+    m_pkt_cnt++;
+}
+
+static void bt_av_stats_task_handler(void *arg)
+{
+    uint32_t last_cnt = 0;
+
+    for (;;) {
+        vTaskDelay(BT_AV_STATS_PERIOD_MS / portTICK_PERIOD_MS);
+
+        /* nothing streamed since the last summary, nothing new to report */
+        uint32_t cnt = m_pkt_cnt;
+        if (cnt == last_cnt) {
+            continue;
+        }
+        last_cnt = cnt;
+
+        bt_app_i2s_stats_t stats;
+        bt_app_i2s_get_stats(&stats);
+        ESP_LOGI(BT_AV_TAG, "Audio packet count %u, ring fill %u/%u, overflow %u, underrun %u, concealed %u (max %u us), drift %d ppb, asrc %u/%u cycles/frame",
+                 cnt, stats.fill, stats.size, stats.overflow_cnt, stats.underrun_cnt,
+                 stats.conceal_cnt, stats.conceal_us_max, stats.drift_ppb, stats.asrc_cpf_avg, stats.asrc_cpf_max);
+#ifdef CONFIG_A2DP_SINK_DSP
+        bt_app_dsp_stats_t dsp;
+        bt_app_dsp_get_stats(&dsp);
+        ESP_LOGI(BT_AV_TAG, "DSP %u.%02u of %u cycles/sample",
+                 dsp.total_cps_x100 / 100, dsp.total_cps_x100 % 100, dsp.budget_cps);
+#endif
+        ESP_LOGI(BT_AV_TAG, "PCM copies %u bytes per packet, %u cycles per packet in the callback, writer stack %u bytes never used",
+                 stats.copy_bytes_per_pkt, stats.copy_cycles_per_pkt, stats.stack_free);
+        ESP_LOGI(BT_AV_TAG, "%s packet to DAC latency %u us, min %u avg %u max %u over %u samples",
+                 BT_I2S_LATENCY_PROFILE, stats.latency_us_last, stats.latency_us_min,
+                 stats.latency_us_avg, stats.latency_us_max, stats.latency_cnt);
+        bt_app_log_stats();
+
+        bt_app_clock_stats_t clk;
+        bt_app_clock_get_stats(&clk);
+        ESP_LOGI(BT_AV_TAG, "play position %u/%u ms, drift %d ms (max %u) over %u reports, %u seeks",
+                 bt_app_clock_position_ms(), bt_app_clock_length_ms(), clk.drift_ms_last, clk.drift_ms_max,
+                 clk.sync_cnt, clk.seek_cnt);
+
+        bt_app_rn_stats_t rn;
+        bt_app_rn_get_stats(&rn);
+        ESP_LOGI(BT_AV_TAG, "AVRC events armed 0x%04x of 0x%04x, %u notifications, %u metadata requests (%u coalesced, %u stale attributes), track info after %u us (max %u)",
+                 rn.armed, rn.supported, rn.notify_cnt, rn.md_req_cnt, rn.md_coalesced, rn.md_dropped, rn.track_us_last, rn.track_us_max);
+
+        for (uint8_t code = 0; code < BT_APP_PT_CODES; code++) {
+            bt_app_pt_stats_t pt;
+            bt_app_pt_get_stats(code, &pt);
+            if (pt.requested) {
+                ESP_LOGI(BT_AV_TAG, "PlayControl 0x%02x: %u presses, %u sent, %u answered after %u us (max %u)",
+                         code, pt.requested, pt.sent, pt.answered, pt.us_last, pt.us_max);
+            }
+        }
     }
 }
 
-void bt_app_alloc_meta_buffer(esp_avrc_ct_cb_param_t *param)
+void bt_app_av_stats_start_up(void)
+{
+    xTaskCreate(bt_av_stats_task_handler, "BtStatT", BT_AV_STATS_TASK_STACK, NULL, BT_AV_STATS_TASK_PRIO, NULL);
+}
+
+/* deep copy of the metadata text into the dispatcher arena, released after the handler */
+static void bt_app_copy_meta_buffer(bt_app_msg_t *msg, void *p_dest, void *p_src)
 {
-    esp_avrc_ct_cb_param_t *rc = (esp_avrc_ct_cb_param_t *)(param);
-    uint8_t *attr_text = (uint8_t *) malloc (rc->meta_rsp.attr_length + 1);
-    memcpy(attr_text, rc->meta_rsp.attr_text, rc->meta_rsp.attr_length);
-    attr_text[rc->meta_rsp.attr_length] = 0;
+    esp_avrc_ct_cb_param_t *dst = (esp_avrc_ct_cb_param_t *)(p_dest);
+    esp_avrc_ct_cb_param_t *src = (esp_avrc_ct_cb_param_t *)(p_src);
 
-    rc->meta_rsp.attr_text = attr_text;
+    dst->meta_rsp.attr_text = (uint8_t *)bt_app_msg_text_dup(msg, src->meta_rsp.attr_text,
+                              src->meta_rsp.attr_length, &dst->meta_rsp.attr_length);
 }
 
 void bt_app_rc_ct_cb(esp_avrc_ct_cb_event_t event, esp_avrc_ct_cb_param_t *param)
 {
     switch (event) {
     case ESP_AVRC_CT_METADATA_RSP_EVT:
-        bt_app_alloc_meta_buffer(param);
-    case ESP_AVRC_CT_CONNECTION_STATE_EVT:
-    case ESP_AVRC_CT_PASSTHROUGH_RSP_EVT:
+        bt_app_work_post(bt_av_hdl_avrc_evt, event, param, sizeof(esp_avrc_ct_cb_param_t), bt_app_copy_meta_buffer,
+                         BT_APP_LANE_LOW, BT_AV_COALESCE_META(param->meta_rsp.attr_id));
+        break;
     case ESP_AVRC_CT_CHANGE_NOTIFY_EVT:
-    case ESP_AVRC_CT_REMOTE_FEATURES_EVT: {
+        bt_app_work_post(bt_av_hdl_avrc_evt, event, param, sizeof(esp_avrc_ct_cb_param_t), NULL,
+                         BT_APP_LANE_LOW, BT_AV_COALESCE_NOTIFY(param->change_ntf.event_id));
+        break;
+    case ESP_AVRC_CT_CONNECTION_STATE_EVT: {
         bt_app_work_dispatch(bt_av_hdl_avrc_evt, event, param, sizeof(esp_avrc_ct_cb_param_t), NULL);
         break;
     }
+    case ESP_AVRC_CT_PASSTHROUGH_RSP_EVT:
+    case ESP_AVRC_CT_REMOTE_FEATURES_EVT:
+    case ESP_AVRC_CT_GET_RN_CAPABILITIES_RSP_EVT: {
+        bt_app_work_post(bt_av_hdl_avrc_evt, event, param, sizeof(esp_avrc_ct_cb_param_t), NULL,
+                         BT_APP_LANE_LOW, BT_APP_COALESCE_NONE);
+        break;
+    }
     default:
         ESP_LOGE(BT_AV_TAG, "Invalid AVRC event: %d", event);
         break;
     }
 }
 
+void bt_app_rc_tg_cb(esp_avrc_tg_cb_event_t event, esp_avrc_tg_cb_param_t *param)
+{
+    switch (event) {
+    case ESP_AVRC_TG_CONNECTION_STATE_EVT: {
+        bt_app_work_dispatch(bt_av_hdl_avrc_tg_evt, event, param, sizeof(esp_avrc_tg_cb_param_t), NULL);
+        break;
+    }
+    case ESP_AVRC_TG_SET_ABSOLUTE_VOLUME_CMD_EVT:
+        /* only the latest volume matters, but it should not wait behind metadata */
+        bt_app_work_post(bt_av_hdl_avrc_tg_evt, event, param, sizeof(esp_avrc_tg_cb_param_t), NULL,
+                         BT_APP_LANE_HIGH, BT_AV_COALESCE_VOLUME);
+        break;
+    case ESP_AVRC_TG_REMOTE_FEATURES_EVT:
+    case ESP_AVRC_TG_REGISTER_NOTIFICATION_EVT: {
+        bt_app_work_post(bt_av_hdl_avrc_tg_evt, event, param, sizeof(esp_avrc_tg_cb_param_t), NULL,
+                         BT_APP_LANE_LOW, BT_APP_COALESCE_NONE);
+        break;
+    }
+    default:
+        ESP_LOGE(BT_AV_TAG, "Invalid AVRC target event: %d", event);
+        break;
+    }
+}
+
 static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
 {
     ESP_LOGD(BT_AV_TAG, "%s evt %d", __func__, event);
@@ -105,6 +214,9 @@ static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
         m_audio_state = a2d->audio_stat.state;
         if (ESP_A2D_AUDIO_STATE_STARTED == a2d->audio_stat.state) {
             m_pkt_cnt = 0;
+            bt_app_clock_set_state(BT_APP_CLOCK_PLAYING);
+        } else {
+            bt_app_clock_set_state(BT_APP_CLOCK_PAUSED);
         }
         break;
     }
@@ -113,23 +225,20 @@ static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
         ESP_LOGI(BT_AV_TAG, "A2DP audio stream configuration, codec type %d", a2d->audio_cfg.mcc.type);
         // for now only SBC stream is supported
         if (a2d->audio_cfg.mcc.type == ESP_A2D_MCT_SBC) {
-            int sample_rate = 16000;
-            char oct0 = a2d->audio_cfg.mcc.cie.sbc[0];
-            if (oct0 & (0x01 << 6)) {
-                sample_rate = 32000;
-            } else if (oct0 & (0x01 << 5)) {
-                sample_rate = 44100;
-            } else if (oct0 & (0x01 << 4)) {
-                sample_rate = 48000;
+            bt_app_stream_desc_t desc;
+            if (!bt_app_stream_parse_sbc(a2d->audio_cfg.mcc.cie.sbc, &desc)) {
+                ESP_LOGW(BT_AV_TAG, "Incomplete SBC configuration, using defaults for missing fields");
             }
-            i2s_set_clk(0, sample_rate, 16, 2);
+            bt_app_i2s_configure(&desc);
 
             ESP_LOGI(BT_AV_TAG, "Configure audio player %x-%x-%x-%x",
                      a2d->audio_cfg.mcc.cie.sbc[0],
                      a2d->audio_cfg.mcc.cie.sbc[1],
                      a2d->audio_cfg.mcc.cie.sbc[2],
                      a2d->audio_cfg.mcc.cie.sbc[3]);
-            ESP_LOGI(BT_AV_TAG, "Audio player configured, sample rate=%d", sample_rate);
+            ESP_LOGI(BT_AV_TAG, "Audio player configured, sample rate=%u, channel mode %d, blocks %u, subbands %u, bitpool %u-%u, frame %u bytes, %u bps",
+                     desc.sample_rate, desc.channel_mode, desc.block_len, desc.subbands,
+                     desc.min_bitpool, desc.max_bitpool, desc.frame_len, desc.bitrate);
         }
         break;
     }
@@ -139,22 +248,6 @@ static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
     }
 }
 
-static void bt_av_new_track()
-{
-    //Register notifications and request metadata
-    esp_avrc_ct_send_metadata_cmd(0, ESP_AVRC_MD_ATTR_TITLE | ESP_AVRC_MD_ATTR_ARTIST | ESP_AVRC_MD_ATTR_ALBUM | ESP_AVRC_MD_ATTR_GENRE);
-    esp_avrc_ct_send_register_notification_cmd(1, ESP_AVRC_RN_TRACK_CHANGE, 0);
-}
-
-void bt_av_notify_evt_handler(uint8_t event_id, uint32_t event_parameter)
-{
-    switch (event_id) {
-    case ESP_AVRC_RN_TRACK_CHANGE:
-        bt_av_new_track();
-        break;
-    }
-}
-
 static void bt_av_hdl_avrc_evt(uint16_t event, void *p_param)
 {
     ESP_LOGD(BT_AV_TAG, "%s evt %d", __func__, event);
@@ -165,27 +258,69 @@ static void bt_av_hdl_avrc_evt(uint16_t event, void *p_param)
         ESP_LOGI(BT_AV_TAG, "AVRC conn_state evt: state %d, [%02x:%02x:%02x:%02x:%02x:%02x]",
                  rc->conn_stat.connected, bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
 
-        if (rc->conn_stat.connected) {
-            bt_av_new_track();
-        }
+        bt_app_rn_connected(rc->conn_stat.connected);
+        bt_app_pt_connected(rc->conn_stat.connected);
         break;
     }
     case ESP_AVRC_CT_PASSTHROUGH_RSP_EVT: {
         ESP_LOGI(BT_AV_TAG, "AVRC passthrough rsp: key_code 0x%x, key_state %d", rc->psth_rsp.key_code, rc->psth_rsp.key_state);
+        bt_app_pt_response(rc->psth_rsp.key_code, rc->psth_rsp.key_state);
         break;
     }
     case ESP_AVRC_CT_METADATA_RSP_EVT: {
         ESP_LOGI(BT_AV_TAG, "AVRC metadata rsp: attribute id 0x%x, %s", rc->meta_rsp.attr_id, rc->meta_rsp.attr_text);
-        free(rc->meta_rsp.attr_text);
+        bt_app_rn_metadata(rc->meta_rsp.attr_id, rc->meta_rsp.attr_text, rc->meta_rsp.attr_length);
         break;
     }
     case ESP_AVRC_CT_CHANGE_NOTIFY_EVT: {
-        ESP_LOGI(BT_AV_TAG, "AVRC event notification: %d, param: %d", rc->change_ntf.event_id, rc->change_ntf.event_parameter);
-        bt_av_notify_evt_handler(rc->change_ntf.event_id, rc->change_ntf.event_parameter);
+        ESP_LOGI(BT_AV_TAG, "AVRC event notification: %d", rc->change_ntf.event_id);
+        bt_app_rn_notify(rc->change_ntf.event_id, &rc->change_ntf.event_parameter);
         break;
     }
     case ESP_AVRC_CT_REMOTE_FEATURES_EVT: {
         ESP_LOGI(BT_AV_TAG, "AVRC remote features %x", rc->rmt_feats.feat_mask);
+        bt_app_rn_remote_features(rc->rmt_feats.feat_mask);
+        break;
+    }
+    case ESP_AVRC_CT_GET_RN_CAPABILITIES_RSP_EVT: {
+        ESP_LOGI(BT_AV_TAG, "AVRC remote notification capabilities: count %d, bitmask 0x%x", rc->get_rn_caps_rsp.cap_count,
+                 rc->get_rn_caps_rsp.evt_set.bits);
+        bt_app_rn_capabilities(&rc->get_rn_caps_rsp.evt_set);
+        break;
+    }
+    default:
+        ESP_LOGE(BT_AV_TAG, "%s unhandled evt %d", __func__, event);
+        break;
+    }
+}
+
+static void bt_av_hdl_avrc_tg_evt(uint16_t event, void *p_param)
+{
+    ESP_LOGD(BT_AV_TAG, "%s evt %d", __func__, event);
+    esp_avrc_tg_cb_param_t *rc = (esp_avrc_tg_cb_param_t *)(p_param);
+    switch (event) {
+    case ESP_AVRC_TG_CONNECTION_STATE_EVT: {
+        uint8_t *bda = rc->conn_stat.remote_bda;
+        ESP_LOGI(BT_AV_TAG, "AVRC target conn_state evt: state %d, [%02x:%02x:%02x:%02x:%02x:%02x]",
+                 rc->conn_stat.connected, bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
+        break;
+    }
+    case ESP_AVRC_TG_REMOTE_FEATURES_EVT: {
+        ESP_LOGI(BT_AV_TAG, "AVRC target remote features %x, CT features %x", rc->rmt_feats.feat_mask, rc->rmt_feats.ct_feat_flag);
+        break;
+    }
+    case ESP_AVRC_TG_SET_ABSOLUTE_VOLUME_CMD_EVT: {
+        ESP_LOGI(BT_AV_TAG, "AVRC set absolute volume: %d%%", (int)rc->set_abs_vol.volume * 100 / BT_APP_VOLUME_MAX);
+        bt_app_volume_set(rc->set_abs_vol.volume);
+        break;
+    }
+    case ESP_AVRC_TG_REGISTER_NOTIFICATION_EVT: {
+        ESP_LOGI(BT_AV_TAG, "AVRC register event notification: %d, param: 0x%x", rc->reg_ntf.event_id, rc->reg_ntf.event_parameter);
+        if (rc->reg_ntf.event_id == ESP_AVRC_RN_VOLUME_CHANGE) {
+            esp_avrc_rn_param_t rn_param;
+            rn_param.volume = bt_app_volume_get();
+            esp_avrc_tg_send_rn_rsp(ESP_AVRC_RN_VOLUME_CHANGE, ESP_AVRC_RN_RSP_INTERIM, &rn_param);
+        }
         break;
     }
     default:
@@ -25,9 +25,20 @@ void bt_app_a2d_cb(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param);
  */
 void bt_app_a2d_data_cb(const uint8_t *data, uint32_t len);
 
+/**
+ * @brief     start the low priority task that logs the audio, dispatcher and AVRC summary
+ *            every couple of seconds while audio streams
+ */
+void bt_app_av_stats_start_up(void);
+
 /**
  * @brief     callback function for AVRCP controller
  */
 void bt_app_rc_ct_cb(esp_avrc_ct_cb_event_t event, esp_avrc_ct_cb_param_t *param);
 
+/**
+ * @brief     callback function for AVRCP target
+ */
+void bt_app_rc_tg_cb(esp_avrc_tg_cb_event_t event, esp_avrc_tg_cb_param_t *param);
+
 #endif /* __BT_APP_AV_H__*/
@@ -0,0 +1,134 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "bt_app_clock.h"
+
+/* played time, written by the I2S writer task only */
+static volatile uint32_t m_played_ms = 0;
+static uint32_t m_played_frac = 0;
+
+/*
+ * Anchor, written by the BtAppT task. The track position is m_played_ms plus m_offset_ms,
+ * modulo 2^32, so re-anchoring is a single store and every getter is a plain atomic load
+ * from any task. Length and state are words of their own; a reader may pair a new offset
+ * with the previous length for one call, which only affects the clamp.
+ */
+static uint32_t m_offset_ms = 0;
+static uint32_t m_length_ms = 0;
+static uint32_t m_state = BT_APP_CLOCK_STOPPED;
+
+static bt_app_clock_stats_t m_stats;
+
+static volatile bt_app_clock_cb_t m_cb = NULL;
+
+void bt_app_clock_register_callback(bt_app_clock_cb_t cb)
+{
+    m_cb = cb;
+}
+
+static void bt_clock_changed(void)
+{
+    bt_app_clock_cb_t cb = m_cb;
+
+    if (cb) {
+        cb();
+    }
+}
+
+void bt_app_clock_advance(uint32_t frames, uint32_t sample_rate)
+{
+    if (sample_rate == 0) {
+        return;
+    }
+    /* carry the remainder so rounding never accumulates */
+    m_played_frac += frames * 1000;
+    uint32_t ms = m_played_frac / sample_rate;
+    m_played_frac -= ms * sample_rate;
+    __atomic_store_n(&m_played_ms, m_played_ms + ms, __ATOMIC_RELAXED);
+}
+
+/* re-anchor so the position is pos_ms now */
+static void bt_clock_anchor(uint32_t pos_ms)
+{
+    __atomic_store_n(&m_offset_ms, pos_ms - __atomic_load_n(&m_played_ms, __ATOMIC_RELAXED), __ATOMIC_RELEASE);
+}
+
+void bt_app_clock_new_track(void)
+{
+    __atomic_store_n(&m_length_ms, 0, __ATOMIC_RELEASE);
+    bt_clock_anchor(0);
+    bt_clock_changed();
+}
+
+void bt_app_clock_sync(uint32_t pos_ms)
+{
+    int32_t drift = (int32_t)(bt_app_clock_position_ms() - pos_ms);
+    bool seek = (uint32_t)abs(drift) > BT_APP_CLOCK_SEEK_MS;
+
+    m_stats.sync_cnt++;
+    if (seek) {
+        m_stats.seek_cnt++;
+        ESP_LOGI(BT_CLOCK_TAG, "seek to %u ms", pos_ms);
+    } else {
+        m_stats.drift_ms_last = drift;
+        if ((uint32_t)abs(drift) > m_stats.drift_ms_max) {
+            m_stats.drift_ms_max = abs(drift);
+        }
+    }
+
+    /* re-anchoring on every report keeps the drift bounded by one report interval */
+    bt_clock_anchor(pos_ms);
+
+    if (seek) {
+        bt_clock_changed();
+    }
+}
+
+void bt_app_clock_set_length(uint32_t length_ms)
+{
+    __atomic_store_n(&m_length_ms, length_ms, __ATOMIC_RELEASE);
+}
+
+void bt_app_clock_set_state(bt_app_clock_state_t state)
+{
+    if (__atomic_load_n(&m_state, __ATOMIC_RELAXED) == state) {
+        return;
+    }
+    __atomic_store_n(&m_state, state, __ATOMIC_RELEASE);
+    bt_clock_changed();
+}
+
+uint32_t bt_app_clock_position_ms(void)
+{
+    uint32_t pos = __atomic_load_n(&m_played_ms, __ATOMIC_RELAXED) + __atomic_load_n(&m_offset_ms, __ATOMIC_ACQUIRE);
+    uint32_t length = __atomic_load_n(&m_length_ms, __ATOMIC_ACQUIRE);
+
+    if (length && pos > length) {
+        pos = length;
+    }
+    return pos;
+}
+
+uint32_t bt_app_clock_length_ms(void)
+{
+    return __atomic_load_n(&m_length_ms, __ATOMIC_ACQUIRE);
+}
+
+bt_app_clock_state_t bt_app_clock_state(void)
+{
+    return (bt_app_clock_state_t)__atomic_load_n(&m_state, __ATOMIC_ACQUIRE);
+}
+
+void bt_app_clock_get_stats(bt_app_clock_stats_t *stats)
+{
+    *stats = m_stats;
+}
@@ -0,0 +1,90 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef __BT_APP_CLOCK_H__
+#define __BT_APP_CLOCK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BT_CLOCK_TAG                 "BT_CLOCK"
+
+/* a reported position further than this from the local one is taken as a seek, not drift */
+#define BT_APP_CLOCK_SEEK_MS         (2000)
+
+typedef enum {
+    BT_APP_CLOCK_STOPPED = 0,
+    BT_APP_CLOCK_PLAYING,
+    BT_APP_CLOCK_PAUSED,
+} bt_app_clock_state_t;
+
+/**
+ * @brief     local clock against the phone
+ */
+typedef struct {
+    uint32_t             sync_cnt;        /*!< position reports from the phone */
+    uint32_t             seek_cnt;        /*!< reports that moved the position by more than BT_APP_CLOCK_SEEK_MS */
+    int32_t              drift_ms_last;   /*!< local minus reported position at the last report */
+    uint32_t             drift_ms_max;    /*!< largest drift magnitude outside seeks */
+} bt_app_clock_stats_t;
+
+/**
+ * @brief     called on the BtAppT task after a state change, a new track or a seek
+ */
+typedef void (* bt_app_clock_cb_t)(void);
+
+/**
+ * @brief     register a single listener, NULL to remove it. Must not block
+ */
+void bt_app_clock_register_callback(bt_app_clock_cb_t cb);
+
+/**
+ * @brief     I2S writer side: count PCM frames that reached the output at the given source rate
+ */
+void bt_app_clock_advance(uint32_t frames, uint32_t sample_rate);
+
+/**
+ * @brief     restart at position 0 with an unknown length
+ */
+void bt_app_clock_new_track(void);
+
+/**
+ * @brief     re-anchor on a position reported by the phone, records drift or a seek
+ */
+void bt_app_clock_sync(uint32_t pos_ms);
+
+void bt_app_clock_set_length(uint32_t length_ms);
+
+void bt_app_clock_set_state(bt_app_clock_state_t state);
+
+/**
+ * @brief     current track position, interpolated from played frames since the last report
+ *
+ * The getters below are plain atomic loads, they never retry or block and can be called
+ * from any task.
+ */
+uint32_t bt_app_clock_position_ms(void);
+
+/**
+ * @brief     track length, 0 if the phone did not report one
+ */
+uint32_t bt_app_clock_length_ms(void);
+
+bt_app_clock_state_t bt_app_clock_state(void);
+
+void bt_app_clock_get_stats(bt_app_clock_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BT_APP_CLOCK_H__ */
@@ -13,89 +13,418 @@
 #include "freertos/FreeRTOSConfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "esp_timer.h"
 #include "esp_log.h"
 #include "bt_app_core.h"
 
 static void bt_app_task_handler(void *arg);
-static bool bt_app_send_msg(bt_app_msg_t *msg);
+static bool bt_app_send_msg(bt_app_msg_t *msg, bt_app_lane_t lane);
 static void bt_app_work_dispatched(bt_app_msg_t *msg);
 
-static xQueueHandle bt_app_task_queue = NULL;
+/* one queue per lane, the semaphore counts messages queued on either */
+static xQueueHandle bt_app_task_queue[BT_APP_LANE_NUM] = {NULL};
+static xSemaphoreHandle bt_app_task_sem = NULL;
 static xTaskHandle bt_app_task_handle = NULL;
 
+static bt_app_lane_stats_t m_lane_stats[BT_APP_LANE_NUM];
+
+/* written by the dispatcher task only */
+static bt_app_evt_stats_t m_evt_stats[BT_APP_EVT_STATS_MAX];
+static volatile int m_evt_stats_cnt = 0;
+
+/* coalescing slots, a slot is busy from the first post until the task takes it; until the
+ * reference to it is queued it is also sending, and later posts with its key do not merge */
+typedef struct {
+    bool                 busy;
+    bool                 sending;
+    uint16_t             key;
+    uint32_t             claim;    /* tells the poster whether the slot is still the one it parked */
+    bt_app_msg_t         msg;
+} bt_app_coalesce_slot_t;
+
+static bt_app_coalesce_slot_t m_coalesce[BT_APP_COALESCE_SLOTS];
+static uint32_t m_coalesce_claims = 0;
+static portMUX_TYPE m_coalesce_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* text arena, a set bit in m_text_used marks a block owned by a queued message */
+static char m_text[BT_APP_TEXT_BLOCKS][BT_APP_TEXT_BLOCK_SIZE];
+static volatile uint32_t m_text_used = 0;
+static char m_text_empty[1];
+
+static uint8_t bt_app_text_alloc(void)
+{
+    uint32_t used = __atomic_load_n(&m_text_used, __ATOMIC_RELAXED);
+
+    for (;;) {
+        uint32_t free_bits = ~used & ((1u << BT_APP_TEXT_BLOCKS) - 1);
+        if (free_bits == 0) {
+            return BT_APP_TEXT_NONE;
+        }
+        uint8_t idx = __builtin_ctz(free_bits);
+        if (__atomic_compare_exchange_n(&m_text_used, &used, used | (1u << idx), false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return idx;
+        }
+    }
+}
+
+static void bt_app_text_release(uint8_t idx)
+{
+    if (idx < BT_APP_TEXT_BLOCKS) {
+        __atomic_fetch_and(&m_text_used, ~(1u << idx), __ATOMIC_RELEASE);
+    }
+}
+
+char *bt_app_msg_text_dup(bt_app_msg_t *msg, const uint8_t *text, int len, int *out_len)
+{
+    uint8_t idx = msg->text;
+
+    if (idx == BT_APP_TEXT_NONE) {
+        idx = bt_app_text_alloc();
+    }
+    if (idx == BT_APP_TEXT_NONE) {
+        ESP_LOGW(BT_APP_CORE_TAG, "%s text arena full, %d bytes dropped", __func__, len);
+        *out_len = 0;
+        return m_text_empty;
+    }
+    msg->text = idx;
+
+    if (text == NULL || len < 0) {
+        len = 0;
+    }
+    if (len > BT_APP_TEXT_BLOCK_SIZE - 1) {
+        len = BT_APP_TEXT_BLOCK_SIZE - 1;
+        /* do not cut a multi-byte character in half */
+        while (len > 0 && (text[len] & 0xC0) == 0x80) {
+            len--;
+        }
+    }
+
+    char *dst = m_text[idx];
+    memcpy(dst, text, len);
+    dst[len] = 0;
+    *out_len = len;
+    return dst;
+}
+
 bool bt_app_work_dispatch(bt_app_cb_t p_cback, uint16_t event, void *p_params, int param_len, bt_app_copy_cb_t p_copy_cback)
 {
-    ESP_LOGD(BT_APP_CORE_TAG, "%s event 0x%x, param len %d", __func__, event, param_len);
+    return bt_app_work_post(p_cback, event, p_params, param_len, p_copy_cback, BT_APP_LANE_HIGH, BT_APP_COALESCE_NONE);
+}
+
+/* merge msg into a pending message with the same handler and key, or park it in a free
+ * slot and return the slot index to queue, BT_APP_COALESCE_SLOTS if neither worked */
+static int bt_app_coalesce(bt_app_msg_t *msg, uint16_t key, bool *merged, uint32_t *claim)
+{
+    int free_slot = BT_APP_COALESCE_SLOTS;
+    uint8_t old_text = BT_APP_TEXT_NONE;
+
+    *merged = false;
+    portENTER_CRITICAL(&m_coalesce_lock);
+    for (int i = 0; i < BT_APP_COALESCE_SLOTS; i++) {
+        bt_app_coalesce_slot_t *slot = &m_coalesce[i];
+        if (!slot->busy) {
+            if (free_slot == BT_APP_COALESCE_SLOTS) {
+                free_slot = i;
+            }
+        } else if (slot->key == key && slot->msg.cb == msg->cb && !slot->sending) {
+            old_text = slot->msg.text;
+            slot->msg = *msg;
+            *merged = true;
+            free_slot = i;
+            break;
+        }
+    }
+    if (!*merged && free_slot < BT_APP_COALESCE_SLOTS) {
+        m_coalesce[free_slot].busy = true;
+        m_coalesce[free_slot].sending = true;
+        m_coalesce[free_slot].claim = ++m_coalesce_claims;
+        *claim = m_coalesce_claims;
+        m_coalesce[free_slot].key = key;
+        m_coalesce[free_slot].msg = *msg;
+    }
+    portEXIT_CRITICAL(&m_coalesce_lock);
+
+    bt_app_text_release(old_text);
+    return free_slot;
+}
+
+bool bt_app_work_post(bt_app_cb_t p_cback, uint16_t event, void *p_params, int param_len, bt_app_copy_cb_t p_copy_cback,
+                      bt_app_lane_t lane, uint16_t coalesce_key)
+{
+    ESP_LOGD(BT_APP_CORE_TAG, "%s event 0x%x, param len %d, lane %d", __func__, event, param_len, lane);
 
     bt_app_msg_t msg;
-    memset(&msg, 0, sizeof(bt_app_msg_t));
 
     msg.sig = BT_APP_SIG_WORK_DISPATCH;
     msg.event = event;
     msg.cb = p_cback;
+    msg.enq_us = 0;
+    msg.param_len = 0;
+    msg.text = BT_APP_TEXT_NONE;
 
-    if (param_len == 0) {
-        return bt_app_send_msg(&msg);
-    } else if (p_params && param_len > 0) {
-        if ((msg.param = malloc(param_len)) != NULL) {
-            memcpy(msg.param, p_params, param_len);
-            /* check if caller has provided a copy callback to do the deep copy */
-            if (p_copy_cback) {
-                p_copy_cback(&msg, msg.param, p_params);
+    if (lane >= BT_APP_LANE_NUM) {
+        return false;
+    }
+
+    if (param_len != 0) {
+        if (p_params == NULL || param_len < 0) {
+            return false;
+        }
+        if (param_len > sizeof(bt_app_param_t)) {
+            ESP_LOGE(BT_APP_CORE_TAG, "%s event 0x%x, param len %d exceeds %u", __func__, event, param_len,
+                     (unsigned)sizeof(bt_app_param_t));
+            return false;
+        }
+        memcpy(&msg.param, p_params, param_len);
+        msg.param_len = param_len;
+        /* check if caller has provided a copy callback to do the deep copy */
+        if (p_copy_cback) {
+            p_copy_cback(&msg, &msg.param, p_params);
+        }
+    }
+
+    if (coalesce_key != BT_APP_COALESCE_NONE) {
+        bool merged;
+        uint32_t claim;
+        int slot = bt_app_coalesce(&msg, coalesce_key, &merged, &claim);
+        if (merged) {
+            __atomic_fetch_add(&m_lane_stats[lane].coalesced, 1, __ATOMIC_RELAXED);
+            return true;
+        }
+        if (slot < BT_APP_COALESCE_SLOTS) {
+            /* the queue only carries a reference, the parameters stay in the slot */
+            bt_app_msg_t ref;
+            ref.sig = BT_APP_SIG_WORK_COALESCED;
+            ref.event = slot;
+            ref.cb = NULL;
+            ref.enq_us = 0;
+            ref.param_len = 0;
+            ref.text = BT_APP_TEXT_NONE;
+            bool sent = bt_app_send_msg(&ref, lane);
+
+            portENTER_CRITICAL(&m_coalesce_lock);
+            if (sent) {
+                /* the task may have taken the slot already, and another post claimed it again */
+                if (m_coalesce[slot].claim == claim) {
+                    m_coalesce[slot].sending = false;
+                }
+            } else {
+                /* nothing merged into the slot meanwhile, so only this message is lost */
+                msg = m_coalesce[slot].msg;
+                m_coalesce[slot].busy = false;
+                m_coalesce[slot].sending = false;
+            }
+            portEXIT_CRITICAL(&m_coalesce_lock);
+            if (sent) {
+                return true;
             }
-            return bt_app_send_msg(&msg);
+            bt_app_text_release(msg.text);
+            return false;
         }
+        /* every slot is waiting on another key, queue the message as it is */
     }
 
+    if (bt_app_send_msg(&msg, lane)) {
+        return true;
+    }
+    bt_app_text_release(msg.text);
     return false;
 }
 
-static bool bt_app_send_msg(bt_app_msg_t *msg)
+void bt_app_get_lane_stats(bt_app_lane_t lane, bt_app_lane_stats_t *stats)
+{
+    if (lane < BT_APP_LANE_NUM) {
+        *stats = m_lane_stats[lane];
+    }
+}
+
+static bool bt_app_send_msg(bt_app_msg_t *msg, bt_app_lane_t lane)
 {
     if (msg == NULL) {
         return false;
     }
 
-    if (xQueueSend(bt_app_task_queue, msg, 10 / portTICK_RATE_MS) != pdTRUE) {
-        ESP_LOGE(BT_APP_CORE_TAG, "%s xQueue send failed", __func__);
+    bt_app_lane_stats_t *st = &m_lane_stats[lane];
+
+    /* only the high lane may hold up the Bluetooth task, and only briefly */
+    TickType_t wait = (lane == BT_APP_LANE_HIGH) ? 10 / portTICK_RATE_MS : 0;
+    msg->enq_us = (uint32_t)esp_timer_get_time();
+    if (xQueueSend(bt_app_task_queue[lane], msg, wait) != pdTRUE) {
+        uint32_t dropped = __atomic_add_fetch(&st->dropped, 1, __ATOMIC_RELAXED);
+        ESP_LOGE(BT_APP_CORE_TAG, "%s xQueue send failed, lane %d, %u dropped", __func__, lane, dropped);
         return false;
     }
+    __atomic_fetch_add(&st->sent, 1, __ATOMIC_RELAXED);
+
+    uint32_t depth = uxQueueMessagesWaiting(bt_app_task_queue[lane]);
+    uint32_t hwm = __atomic_load_n(&st->depth_hwm, __ATOMIC_RELAXED);
+    while (depth > hwm &&
+            !__atomic_compare_exchange_n(&st->depth_hwm, &hwm, depth, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    xSemaphoreGive(bt_app_task_sem);
     return true;
 }
 
+static uint32_t bt_app_hist_bucket(uint32_t us)
+{
+    uint32_t b = 31 - __builtin_clz(us | 1);
+    return b < BT_APP_HIST_BUCKETS ? b : BT_APP_HIST_BUCKETS - 1;
+}
+
+/* find or claim the entry for this handler and event, NULL once the table is full */
+static bt_app_evt_stats_t *bt_app_evt_stats_entry(bt_app_cb_t cb, uint16_t event)
+{
+    int cnt = m_evt_stats_cnt;
+
+    for (int i = 0; i < cnt; i++) {
+        if (m_evt_stats[i].cb == cb && m_evt_stats[i].event == event) {
+            return &m_evt_stats[i];
+        }
+    }
+    if (cnt == BT_APP_EVT_STATS_MAX) {
+        return NULL;
+    }
+
+    bt_app_evt_stats_t *e = &m_evt_stats[cnt];
+    memset(e, 0, sizeof(bt_app_evt_stats_t));
+    e->cb = cb;
+    e->event = event;
+    __atomic_store_n(&m_evt_stats_cnt, cnt + 1, __ATOMIC_RELEASE);
+    return e;
+}
+
+static void bt_app_evt_stats_record(const bt_app_msg_t *msg, uint32_t queue_us, uint32_t handler_us)
+{
+    bt_app_evt_stats_t *e = bt_app_evt_stats_entry(msg->cb, msg->event);
+    if (e == NULL) {
+        return;
+    }
+
+    e->count++;
+    e->queue_hist[bt_app_hist_bucket(queue_us)]++;
+    e->handler_hist[bt_app_hist_bucket(handler_us)]++;
+    if (queue_us > e->queue_max) {
+        e->queue_max = queue_us;
+    }
+    if (handler_us > e->handler_max) {
+        e->handler_max = handler_us;
+    }
+}
+
+int bt_app_get_evt_stats(bt_app_evt_stats_t *stats, int max)
+{
+    int cnt = __atomic_load_n(&m_evt_stats_cnt, __ATOMIC_ACQUIRE);
+
+    if (cnt > max) {
+        cnt = max;
+    }
+    memcpy(stats, m_evt_stats, cnt * sizeof(bt_app_evt_stats_t));
+    return cnt;
+}
+
+/* upper edge in microseconds of the bucket holding the median */
+static uint32_t bt_app_hist_median(const uint32_t *hist, uint32_t count)
+{
+    uint32_t sum = 0;
+
+    for (int b = 0; b < BT_APP_HIST_BUCKETS - 1; b++) {
+        sum += hist[b];
+        if (sum * 2 >= count) {
+            return 2u << b;
+        }
+    }
+    return 1u << (BT_APP_HIST_BUCKETS - 1);
+}
+
+void bt_app_log_stats(void)
+{
+    static bt_app_evt_stats_t evt[BT_APP_EVT_STATS_MAX];
+    bt_app_lane_stats_t hi, lo;
+
+    bt_app_get_lane_stats(BT_APP_LANE_HIGH, &hi);
+    bt_app_get_lane_stats(BT_APP_LANE_LOW, &lo);
+    ESP_LOGI(BT_APP_CORE_TAG, "high lane %u sent %u dropped %u coalesced depth %u/%u, "
+             "low lane %u sent %u dropped %u coalesced depth %u/%u",
+             hi.sent, hi.dropped, hi.coalesced, hi.depth_hwm, BT_APP_HIGH_QUEUE_LEN,
+             lo.sent, lo.dropped, lo.coalesced, lo.depth_hwm, BT_APP_LOW_QUEUE_LEN);
+
+    int cnt = bt_app_get_evt_stats(evt, BT_APP_EVT_STATS_MAX);
+    for (int i = 0; i < cnt; i++) {
+        bt_app_evt_stats_t *e = &evt[i];
+        ESP_LOGI(BT_APP_CORE_TAG, "%p evt 0x%x: %u msgs, queued <%u us (max %u), handler <%u us (max %u)",
+                 e->cb, e->event, e->count,
+                 bt_app_hist_median(e->queue_hist, e->count), e->queue_max,
+                 bt_app_hist_median(e->handler_hist, e->count), e->handler_max);
+    }
+}
+
 static void bt_app_work_dispatched(bt_app_msg_t *msg)
 {
     if (msg->cb) {
-        msg->cb(msg->event, msg->param);
+        msg->cb(msg->event, msg->param_len ? &msg->param : NULL);
     }
 }
 
+/* take the parked message out of its slot, later posts with its key queue afresh */
+static void bt_app_work_take_coalesced(bt_app_msg_t *msg)
+{
+    uint16_t slot = msg->event;
+
+    if (slot >= BT_APP_COALESCE_SLOTS) {
+        return;
+    }
+    portENTER_CRITICAL(&m_coalesce_lock);
+    *msg = m_coalesce[slot].msg;
+    m_coalesce[slot].busy = false;
+    m_coalesce[slot].sending = false;
+    portEXIT_CRITICAL(&m_coalesce_lock);
+}
+
 static void bt_app_task_handler(void *arg)
 {
     bt_app_msg_t msg;
     for (;;) {
-        if (pdTRUE == xQueueReceive(bt_app_task_queue, &msg, (portTickType)portMAX_DELAY)) {
-            ESP_LOGD(BT_APP_CORE_TAG, "%s, sig 0x%x, 0x%x", __func__, msg.sig, msg.event);
-            switch (msg.sig) {
-            case BT_APP_SIG_WORK_DISPATCH:
-                bt_app_work_dispatched(&msg);
-                break;
-            default:
-                ESP_LOGW(BT_APP_CORE_TAG, "%s, unhandled sig: %d", __func__, msg.sig);
-                break;
-            } // switch (msg.sig)
-
-            if (msg.param) {
-                free(msg.param);
-            }
+        if (pdTRUE != xSemaphoreTake(bt_app_task_sem, (portTickType)portMAX_DELAY)) {
+            continue;
+        }
+        if (pdTRUE != xQueueReceive(bt_app_task_queue[BT_APP_LANE_HIGH], &msg, 0) &&
+                pdTRUE != xQueueReceive(bt_app_task_queue[BT_APP_LANE_LOW], &msg, 0)) {
+            continue;
         }
+
+        /* esp_timer is shared by both cores, posts come from tasks on either of them */
+        uint32_t now = (uint32_t)esp_timer_get_time();
+        uint32_t queue_us = now - msg.enq_us;
+
+        ESP_LOGD(BT_APP_CORE_TAG, "%s, sig 0x%x, 0x%x", __func__, msg.sig, msg.event);
+        switch (msg.sig) {
+        case BT_APP_SIG_WORK_COALESCED:
+            bt_app_work_take_coalesced(&msg);
+            bt_app_work_dispatched(&msg);
+            break;
+        case BT_APP_SIG_WORK_DISPATCH:
+            bt_app_work_dispatched(&msg);
+            break;
+        default:
+            ESP_LOGW(BT_APP_CORE_TAG, "%s, unhandled sig: %d", __func__, msg.sig);
+            break;
+        } // switch (msg.sig)
+
+        bt_app_evt_stats_record(&msg, queue_us, (uint32_t)esp_timer_get_time() - now);
+
+        bt_app_text_release(msg.text);
     }
 }
 
 void bt_app_task_start_up(void)
 {
-    bt_app_task_queue = xQueueCreate(10, sizeof(bt_app_msg_t));
+    bt_app_task_queue[BT_APP_LANE_HIGH] = xQueueCreate(BT_APP_HIGH_QUEUE_LEN, sizeof(bt_app_msg_t));
+    bt_app_task_queue[BT_APP_LANE_LOW] = xQueueCreate(BT_APP_LOW_QUEUE_LEN, sizeof(bt_app_msg_t));
+    bt_app_task_sem = xSemaphoreCreateCounting(BT_APP_HIGH_QUEUE_LEN + BT_APP_LOW_QUEUE_LEN, 0);
     xTaskCreate(bt_app_task_handler, "BtAppT", 2048, NULL, configMAX_PRIORITIES - 3, &bt_app_task_handle);
     return;
 }
@@ -106,8 +435,14 @@ void bt_app_task_shut_down(void)
         vTaskDelete(bt_app_task_handle);
         bt_app_task_handle = NULL;
     }
-    if (bt_app_task_queue) {
-        vQueueDelete(bt_app_task_queue);
-        bt_app_task_queue = NULL;
+    for (int i = 0; i < BT_APP_LANE_NUM; i++) {
+        if (bt_app_task_queue[i]) {
+            vQueueDelete(bt_app_task_queue[i]);
+            bt_app_task_queue[i] = NULL;
+        }
+    }
+    if (bt_app_task_sem) {
+        vSemaphoreDelete(bt_app_task_sem);
+        bt_app_task_sem = NULL;
     }
 }
@@ -12,22 +12,87 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include "esp_a2dp_api.h"
+#include "esp_avrc_api.h"
 
 #define BT_APP_CORE_TAG                   "BT_APP_CORE"
 
 #define BT_APP_SIG_WORK_DISPATCH          (0x01)
+#define BT_APP_SIG_WORK_COALESCED         (0x02)
+
+/* queue depth per lane */
+#define BT_APP_HIGH_QUEUE_LEN             (10)
+#define BT_APP_LOW_QUEUE_LEN              (16)
+
+/* (handler, event) pairs with their own latency histograms */
+#define BT_APP_EVT_STATS_MAX              (12)
+/* log2 buckets of microseconds, bucket n counts [2^n, 2^(n+1)), the last one everything above */
+#define BT_APP_HIST_BUCKETS               (24)
+
+/* pending messages that later posts with the same key overwrite in place */
+#define BT_APP_COALESCE_SLOTS             (8)
+#define BT_APP_COALESCE_NONE              (0)
+
+/* text arena for deep copies made by copy callbacks, one block per message */
+#define BT_APP_TEXT_BLOCKS                (8)
+#define BT_APP_TEXT_BLOCK_SIZE            (256)
+#define BT_APP_TEXT_NONE                  (0xFF)
+
+/**
+ * @brief     dispatch lanes, the task drains the high lane before touching the low one
+ */
+typedef enum {
+    BT_APP_LANE_HIGH = 0,          /*!< connection state, stream configuration, volume */
+    BT_APP_LANE_LOW,               /*!< metadata, notifications, everything that can wait */
+    BT_APP_LANE_NUM,
+} bt_app_lane_t;
+
+/**
+ * @brief     per-lane dispatcher counters
+ */
+typedef struct {
+    uint32_t             sent;            /*!< messages queued */
+    uint32_t             dropped;         /*!< xQueueSend failures, messages lost because the lane was full */
+    uint32_t             coalesced;       /*!< messages merged into a pending one with the same key */
+    uint32_t             depth_hwm;       /*!< most messages waiting in the lane at once */
+} bt_app_lane_stats_t;
 
 /**
  * @brief     handler for the dispatched work
  */
 typedef void (* bt_app_cb_t) (uint16_t event, void *param);
 
+/**
+ * @brief     inline parameter storage, large enough for any Bluetooth callback parameter
+ */
+typedef union {
+    esp_a2d_cb_param_t       a2d;
+    esp_avrc_ct_cb_param_t   avrc_ct;
+    esp_avrc_tg_cb_param_t   avrc_tg;
+} bt_app_param_t;
+
+/**
+ * @brief     timing of one (handler, event) pair, in microseconds
+ */
+typedef struct {
+    bt_app_cb_t          cb;              /*!< handler the event is dispatched to */
+    uint16_t             event;           /*!< message event id */
+    uint32_t             count;           /*!< messages dispatched */
+    uint32_t             queue_max;       /*!< enqueue to dispatch, worst */
+    uint32_t             handler_max;     /*!< handler execution, worst */
+    uint32_t             queue_hist[BT_APP_HIST_BUCKETS];   /*!< enqueue to dispatch */
+    uint32_t             handler_hist[BT_APP_HIST_BUCKETS]; /*!< handler execution */
+} bt_app_evt_stats_t;
+
 /* message to be sent */
 typedef struct {
     uint16_t             sig;      /*!< signal to bt_app_task */
     uint16_t             event;    /*!< message event id */
     bt_app_cb_t          cb;       /*!< context switch callback */
-    void                 *param;   /*!< parameter area needs to be last */
+    uint32_t             enq_us;   /*!< esp_timer time when the message was queued, valid on either core */
+    uint16_t             param_len;/*!< bytes used in param, 0 if none */
+    uint8_t              text;     /*!< arena block owned by the message, BT_APP_TEXT_NONE if none */
+    bt_app_param_t       param;    /*!< parameter area needs to be last */
 } bt_app_msg_t;
 
 /**
@@ -36,10 +101,50 @@ typedef struct {
 typedef void (* bt_app_copy_cb_t) (bt_app_msg_t *msg, void *p_dest, void *p_src);
 
 /**
- * @brief     work dispatcher for the application task
+ * @brief     work dispatcher for the application task, posts on the high lane
+ *
+ * Parameters are copied into the message itself, param_len must not exceed
+ * sizeof(bt_app_param_t). Nothing is allocated from the heap.
  */
 bool bt_app_work_dispatch(bt_app_cb_t p_cback, uint16_t event, void *p_params, int param_len, bt_app_copy_cb_t p_copy_cback);
 
+/**
+ * @brief     work dispatcher with an explicit lane and coalescing key
+ *
+ * While a message with the same handler and a non-zero coalesce_key is still waiting,
+ * the new parameters replace the pending ones instead of queueing a second message.
+ * The low lane never blocks the caller, a full lane drops the message.
+ */
+bool bt_app_work_post(bt_app_cb_t p_cback, uint16_t event, void *p_params, int param_len, bt_app_copy_cb_t p_copy_cback,
+                      bt_app_lane_t lane, uint16_t coalesce_key);
+
+void bt_app_get_lane_stats(bt_app_lane_t lane, bt_app_lane_stats_t *stats);
+
+/**
+ * @brief     copy out the per-event timing recorded by the dispatcher task
+ *
+ * Counters are updated by a single task without locks, a snapshot taken while an
+ * event is dispatched may be off by that one event.
+ *
+ * @return    number of entries written to stats
+ */
+int bt_app_get_evt_stats(bt_app_evt_stats_t *stats, int max);
+
+/**
+ * @brief     log lane counters and median and worst latency of every tracked event
+ */
+void bt_app_log_stats(void);
+
+/**
+ * @brief     copy text into an arena block owned by msg, for use in copy callbacks
+ *
+ * The copy is NUL terminated and truncated to the block size on a UTF-8 character
+ * boundary. The block is released after the handler for msg returns.
+ *
+ * @return    the copy, or an empty string when the arena is exhausted
+ */
+char *bt_app_msg_text_dup(bt_app_msg_t *msg, const uint8_t *text, int len, int *out_len);
+
 void bt_app_task_start_up(void);
 
 void bt_app_task_shut_down(void);
@@ -0,0 +1,149 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "esp_log.h"
+#include "xtensa/hal.h"
+#include "bt_app_dac.h"
+
+/* largest error fed back, 2 LSB of the DAC, keeps the loop stable when the output clips */
+#define BT_DAC_ERR_MAX               (512)
+
+#define BT_DAC_BENCH_FRAMES          (256)
+#define BT_DAC_BENCH_BLOCKS          (64)
+/* the error below this frequency is reported as in-band noise */
+#define BT_DAC_BENCH_LP_HZ           (4000)
+/* one-pole sections of the in-band measurement filter */
+#define BT_DAC_BENCH_LP_ORDER        (4)
+
+/* dither generator, xorshift32 gives four usable bytes per step */
+static uint32_t m_rand = 0x12345678;
+/* last two requantization errors per channel */
+static int32_t m_err[2][2];
+
+void bt_app_dac_init(void)
+{
+    memset(m_err, 0, sizeof(m_err));
+}
+
+static inline uint16_t bt_dac_requantize(int32_t x, int32_t *e, uint32_t r)
+{
+    /* difference of two uniform bytes, triangular over +-1 LSB of the DAC */
+    int32_t d = (int32_t)(r & 0xFF) - (int32_t)((r >> 8) & 0xFF);
+    /* error feedback with (1 - z^-1)^2 noise transfer */
+    int32_t v = x - 2 * e[0] + e[1];
+    int32_t q = (v + d + 128) >> 8;
+
+    if (q > 127) {
+        q = 127;
+    } else if (q < -128) {
+        q = -128;
+    }
+
+    int32_t err = (q << 8) - v;
+    if (err > BT_DAC_ERR_MAX) {
+        err = BT_DAC_ERR_MAX;
+    } else if (err < -BT_DAC_ERR_MAX) {
+        err = -BT_DAC_ERR_MAX;
+    }
+    e[1] = e[0];
+    e[0] = err;
+
+    return (uint16_t)((q + 128) << 8);
+}
+
+void bt_app_dac_process(int16_t *pcm, uint32_t frames)
+{
+    uint16_t *out = (uint16_t *)pcm;
+    uint32_t r = m_rand;
+
+    for (uint32_t i = 0; i < frames; i++) {
+        r ^= r << 13;
+        r ^= r >> 17;
+        r ^= r << 5;
+        out[0] = bt_dac_requantize(pcm[0], m_err[0], r);
+        out[1] = bt_dac_requantize(pcm[1], m_err[1], r >> 16);
+        pcm += 2;
+        out += 2;
+    }
+    m_rand = r;
+}
+
+/* what the DAC does with plain 16-bit samples: keep the high byte */
+static void bt_dac_truncate(int16_t *pcm, uint32_t frames)
+{
+    uint16_t *out = (uint16_t *)pcm;
+
+    for (uint32_t i = 0; i < frames * 2; i++) {
+        out[i] = ((uint16_t)pcm[i] & 0xFF00) ^ 0x8000;
+    }
+}
+
+typedef struct {
+    uint32_t             cycles;
+    float                err_pow;
+    float                lp_pow;
+    float                lp[BT_DAC_BENCH_LP_ORDER];
+} bt_dac_bench_t;
+
+static void bt_dac_bench_run(bt_dac_bench_t *b, void (*fn)(int16_t *, uint32_t), uint32_t sample_rate)
+{
+    static int16_t pcm[BT_DAC_BENCH_FRAMES * 2];
+    static int16_t ref[BT_DAC_BENCH_FRAMES * 2];
+    float k = 1.0f - expf(-2.0f * (float)M_PI * BT_DAC_BENCH_LP_HZ / sample_rate);
+    float w = 2.0f * (float)M_PI * 1000.0f / sample_rate;
+    uint32_t n = 0;
+
+    memset(b, 0, sizeof(bt_dac_bench_t));
+    for (uint32_t blk = 0; blk < BT_DAC_BENCH_BLOCKS; blk++) {
+        for (uint32_t i = 0; i < BT_DAC_BENCH_FRAMES; i++, n++) {
+            int16_t s = (int16_t)lrintf(3277.0f * sinf(w * n));
+            ref[i * 2] = ref[i * 2 + 1] = s;
+        }
+        memcpy(pcm, ref, sizeof(pcm));
+
+        uint32_t cc = xthal_get_ccount();
+        fn(pcm, BT_DAC_BENCH_FRAMES);
+        b->cycles += xthal_get_ccount() - cc;
+
+        /* left channel error, decoded back to 16-bit scale */
+        for (uint32_t i = 0; i < BT_DAC_BENCH_FRAMES; i++) {
+            float e = (float)(((int32_t)((uint16_t)pcm[i * 2] >> 8) - 128) * 256 - ref[i * 2]);
+            float lp = e;
+            for (int j = 0; j < BT_DAC_BENCH_LP_ORDER; j++) {
+                b->lp[j] += (lp - b->lp[j]) * k;
+                lp = b->lp[j];
+            }
+            b->err_pow += e * e;
+            b->lp_pow += lp * lp;
+        }
+    }
+    b->err_pow /= n;
+    b->lp_pow /= n;
+}
+
+void bt_app_dac_benchmark(uint32_t sample_rate)
+{
+    bt_dac_bench_t trunc, dith;
+    uint32_t samples = BT_DAC_BENCH_BLOCKS * BT_DAC_BENCH_FRAMES * 2;
+    float fs = 32768.0f * 32768.0f;
+
+    bt_dac_bench_run(&trunc, bt_dac_truncate, sample_rate);
+    bt_app_dac_init();
+    bt_dac_bench_run(&dith, bt_app_dac_process, sample_rate);
+    bt_app_dac_init();
+
+    ESP_LOGI(BT_DAC_TAG, "truncate: %u.%02u cycles/sample, noise %d dBFS, below %u Hz %d dBFS",
+             trunc.cycles / samples, trunc.cycles * 100 / samples % 100,
+             (int)(10.0f * log10f(trunc.err_pow / fs)), BT_DAC_BENCH_LP_HZ, (int)(10.0f * log10f(trunc.lp_pow / fs)));
+    ESP_LOGI(BT_DAC_TAG, "dither:   %u.%02u cycles/sample, noise %d dBFS, below %u Hz %d dBFS",
+             dith.cycles / samples, dith.cycles * 100 / samples % 100,
+             (int)(10.0f * log10f(dith.err_pow / fs)), BT_DAC_BENCH_LP_HZ, (int)(10.0f * log10f(dith.lp_pow / fs)));
+}
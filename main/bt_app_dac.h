@@ -0,0 +1,44 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef __BT_APP_DAC_H__
+#define __BT_APP_DAC_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BT_DAC_TAG                   "BT_DAC"
+
+/**
+ * @brief     clear the noise shaping state
+ */
+void bt_app_dac_init(void);
+
+/**
+ * @brief     requantize 16-bit stereo to the internal DAC in place
+ *
+ * One pass adds TPDF dither, rounds to 8 bits with second-order error feedback
+ * that moves the requantization noise towards Nyquist, and stores each sample
+ * in the DAC format: the unsigned 8-bit code in the high byte of a 16-bit slot.
+ */
+void bt_app_dac_process(int16_t *pcm, uint32_t frames);
+
+/**
+ * @brief     compare cycles per sample and requantization noise of plain truncation
+ *            and the dithered path on a -20 dBFS 1 kHz tone, results are logged
+ */
+void bt_app_dac_benchmark(uint32_t sample_rate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BT_APP_DAC_H__ */
@@ -0,0 +1,191 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "xtensa/hal.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "bt_app_dsp.h"
+#include "bt_app_eq.h"
+#include "dsp_pipeline.h"
+
+/* stages run in this order on every block written to I2S */
+typedef DspPipeline<DspMix, DspGain, DspBiquadCascade<BT_APP_EQ_BANDS>, DspLimiter> bt_dsp_chain_t;
+
+#define BT_DSP_STAGE_EQ              (2)
+
+static_assert(bt_dsp_chain_t::SIZE <= BT_APP_DSP_MAX_STAGES, "too many DSP stages");
+
+#define BT_DSP_BENCH_FRAMES          (256)
+#define BT_DSP_BENCH_BLOCKS          (32)
+
+/* time to glide between EQ presets */
+#define BT_DSP_EQ_RAMP_MS            (50)
+
+struct bt_dsp_ccount {
+    static uint32_t now()
+    {
+        return xthal_get_ccount();
+    }
+};
+
+static bt_dsp_chain_t m_chain;
+static uint32_t m_sample_rate = 0;
+static uint32_t m_eq_index = 0;
+
+/* writer task owned, read unlocked for logging */
+static uint64_t m_cycles[bt_dsp_chain_t::SIZE];
+static uint64_t m_samples = 0;
+
+/* coefficients of every band of a preset, the preamp is folded into the first section */
+static void bt_dsp_design_eq(uint32_t index, uint32_t sample_rate, DspBiquadCoeffs *c)
+{
+    float fs = (float)sample_rate;
+
+    for (uint32_t i = 0; i < BT_APP_EQ_BANDS; i++) {
+        const bt_app_eq_band_t *band = &bt_app_eq_bands[i];
+        float gain = bt_app_eq_gain_db10(index, i) / 10.0f;
+        float q = band->q_x100 / 100.0f;
+
+        /* keep bands above Nyquist at low sample rates out of the cascade */
+        if (gain == 0.0f || band->freq * 2 >= sample_rate) {
+            c[i] = DspBiquadCoeffs::flat();
+            continue;
+        }
+        switch (band->type) {
+        case BT_APP_EQ_LOW_SHELF:
+            c[i] = DspBiquadCoeffs::lowShelf(fs, band->freq, q, gain);
+            break;
+        case BT_APP_EQ_HIGH_SHELF:
+            c[i] = DspBiquadCoeffs::highShelf(fs, band->freq, q, gain);
+            break;
+        default:
+            c[i] = DspBiquadCoeffs::peaking(fs, band->freq, q, gain);
+            break;
+        }
+    }
+
+    int16_t preamp = bt_app_eq_preamp_db10(index);
+    if (preamp != 0) {
+        float g = powf(10.0f, preamp / 200.0f);
+        c[0].b0 = (int32_t)lrintf(c[0].b0 * g);
+        c[0].b1 = (int32_t)lrintf(c[0].b1 * g);
+        c[0].b2 = (int32_t)lrintf(c[0].b2 * g);
+    }
+}
+
+/* glide to a preset, runs on the writer task so the coefficients are never shared */
+static void bt_dsp_apply_eq(uint32_t index, uint32_t ramp_frames)
+{
+    DspBiquadCoeffs c[BT_APP_EQ_BANDS];
+
+    bt_dsp_design_eq(index, m_sample_rate, c);
+    m_chain.stage<BT_DSP_STAGE_EQ>().setTarget(c, ramp_frames);
+    m_eq_index = index;
+}
+
+void bt_app_dsp_init(uint32_t sample_rate)
+{
+    m_chain = bt_dsp_chain_t();
+    bt_app_dsp_set_sample_rate(sample_rate);
+}
+
+void bt_app_dsp_set_sample_rate(uint32_t sample_rate)
+{
+    m_sample_rate = sample_rate;
+    m_chain.reset();
+    bt_dsp_apply_eq(bt_app_eq_selected(), 0);
+    memset(m_cycles, 0, sizeof(m_cycles));
+    m_samples = 0;
+}
+
+void bt_app_dsp_process(int16_t *pcm, uint32_t frames)
+{
+    uint32_t cycles[bt_dsp_chain_t::SIZE] = { 0 };
+    uint32_t eq = bt_app_eq_selected();
+
+    if (eq != m_eq_index) {
+        uint32_t cc = xthal_get_ccount();
+        bt_dsp_apply_eq(eq, BT_DSP_EQ_RAMP_MS * m_sample_rate / 1000);
+        cycles[BT_DSP_STAGE_EQ] = xthal_get_ccount() - cc;
+        ESP_LOGI(BT_DSP_TAG, "EQ preset %u \"%s\", designed in %u cycles, stack %u bytes never used", eq,
+                 bt_app_eq_name(eq), cycles[BT_DSP_STAGE_EQ], uxTaskGetStackHighWaterMark(NULL));
+    }
+
+    m_chain.profile<bt_dsp_ccount>(pcm, frames, cycles);
+
+    for (size_t i = 0; i < bt_dsp_chain_t::SIZE; i++) {
+        m_cycles[i] += cycles[i];
+    }
+    m_samples += frames * 2;
+}
+
+static void bt_dsp_fill_stats(bt_app_dsp_stats_t *stats, const uint64_t *cycles, uint64_t samples,
+                              uint32_t sample_rate)
+{
+    uint64_t total = 0;
+
+    memset(stats, 0, sizeof(bt_app_dsp_stats_t));
+    stats->stages = bt_dsp_chain_t::SIZE;
+    bt_dsp_chain_t::names(stats->name);
+    for (size_t i = 0; i < bt_dsp_chain_t::SIZE; i++) {
+        stats->cps_x100[i] = samples ? (uint32_t)(cycles[i] * 100 / samples) : 0;
+        total += cycles[i];
+    }
+    stats->total_cps_x100 = samples ? (uint32_t)(total * 100 / samples) : 0;
+    stats->budget_cps = sample_rate ? CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * 1000000 / (sample_rate * 2) : 0;
+}
+
+void bt_app_dsp_get_stats(bt_app_dsp_stats_t *stats)
+{
+    bt_dsp_fill_stats(stats, m_cycles, m_samples, m_sample_rate);
+}
+
+void bt_app_dsp_benchmark(uint32_t sample_rate)
+{
+    static int16_t pcm[BT_DSP_BENCH_FRAMES * 2];
+    static bt_dsp_chain_t chain;
+    uint32_t cycles[bt_dsp_chain_t::SIZE] = { 0 };
+    uint64_t totals[bt_dsp_chain_t::SIZE];
+    uint32_t seed = 1;
+    bt_app_dsp_stats_t stats;
+
+    /* make every stage do its full per-sample work */
+    chain.stage<0>().setMatrix(DspMix::UNITY * 3 / 4, DspMix::UNITY / 4, DspMix::UNITY / 4, DspMix::UNITY * 3 / 4);
+    chain.stage<1>().setGainDb(3.0f);
+    DspBiquadCoeffs eq[BT_APP_EQ_BANDS];
+    for (uint32_t i = 0; i < BT_APP_EQ_BANDS; i++) {
+        eq[i] = DspBiquadCoeffs::peaking(sample_rate, bt_app_eq_bands[i].freq, 1.0f, 3.0f);
+    }
+    chain.stage<BT_DSP_STAGE_EQ>().setTarget(eq, 0);
+    chain.stage<3>().configure(sample_rate, -6.0f, 50.0f);
+
+    for (uint32_t b = 0; b < BT_DSP_BENCH_BLOCKS; b++) {
+        for (uint32_t i = 0; i < BT_DSP_BENCH_FRAMES * 2; i++) {
+            seed = seed * 1664525 + 1013904223;
+            pcm[i] = (int16_t)(seed >> 16);
+        }
+        chain.profile<bt_dsp_ccount>(pcm, BT_DSP_BENCH_FRAMES, cycles);
+    }
+
+    for (size_t i = 0; i < bt_dsp_chain_t::SIZE; i++) {
+        totals[i] = cycles[i];
+    }
+    bt_dsp_fill_stats(&stats, totals, (uint64_t)BT_DSP_BENCH_BLOCKS * BT_DSP_BENCH_FRAMES * 2, sample_rate);
+
+    for (uint32_t i = 0; i < stats.stages; i++) {
+        ESP_LOGI(BT_DSP_TAG, "bench %-8s %u.%02u cycles/sample", stats.name[i],
+                 stats.cps_x100[i] / 100, stats.cps_x100[i] % 100);
+    }
+    ESP_LOGI(BT_DSP_TAG, "bench chain %u.%02u cycles/sample, budget %u cycles/sample at %u Hz (%u%%)",
+             stats.total_cps_x100 / 100, stats.total_cps_x100 % 100, stats.budget_cps, sample_rate,
+             stats.budget_cps ? stats.total_cps_x100 / stats.budget_cps : 0);
+}
@@ -0,0 +1,60 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef __BT_APP_DSP_H__
+#define __BT_APP_DSP_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BT_DSP_TAG                   "BT_DSP"
+
+#define BT_APP_DSP_MAX_STAGES        (8)
+
+/**
+ * @brief     DSP chain cost, measured on the blocks actually played
+ */
+typedef struct {
+    uint32_t             stages;                              /*!< number of stages in the chain */
+    const char          *name[BT_APP_DSP_MAX_STAGES];         /*!< stage names, in processing order */
+    uint32_t             cps_x100[BT_APP_DSP_MAX_STAGES];     /*!< cycles per sample of each stage, x100 */
+    uint32_t             total_cps_x100;                      /*!< cycles per sample of the whole chain, x100 */
+    uint32_t             budget_cps;                          /*!< CPU cycles per sample at the output rate */
+} bt_app_dsp_stats_t;
+
+/**
+ * @brief     set up the chain for the I2S output rate, all stages start transparent
+ */
+void bt_app_dsp_init(uint32_t sample_rate);
+
+/**
+ * @brief     redesign rate dependent stages and clear filter state after an I2S clock change
+ */
+void bt_app_dsp_set_sample_rate(uint32_t sample_rate);
+
+/**
+ * @brief     run the chain in place over interleaved 16-bit stereo, writer task only
+ */
+void bt_app_dsp_process(int16_t *pcm, uint32_t frames);
+
+void bt_app_dsp_get_stats(bt_app_dsp_stats_t *stats);
+
+/**
+ * @brief     run synthetic noise through every stage with non-trivial settings and
+ *            log cycles per sample of each stage against the budget at sample_rate
+ */
+void bt_app_dsp_benchmark(uint32_t sample_rate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BT_APP_DSP_H__ */
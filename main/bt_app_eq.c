@@ -0,0 +1,101 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "bt_app_eq.h"
+
+typedef struct {
+    const char          *name;
+    int16_t              gain_db10[BT_APP_EQ_BANDS];
+} bt_eq_preset_t;
+
+const bt_app_eq_band_t bt_app_eq_bands[BT_APP_EQ_BANDS] = {
+    { BT_APP_EQ_LOW_SHELF,  100,  71 },
+    { BT_APP_EQ_PEAKING,    300, 100 },
+    { BT_APP_EQ_PEAKING,   1000, 100 },
+    { BT_APP_EQ_PEAKING,   3500, 100 },
+    { BT_APP_EQ_HIGH_SHELF, 8000, 71 },
+};
+
+/* in the order the iPod lists its EQ settings, which head units index into */
+static const bt_eq_preset_t m_presets[] = {
+    { "Off",            {   0,   0,   0,   0,   0 } },
+    { "Acoustic",       {  45,  10,  15,  30,  20 } },
+    { "Bass Booster",   {  55,  15,   0,   0,   0 } },
+    { "Bass Reducer",   { -55, -15,   0,   0,   0 } },
+    { "Classical",      {  40,   0, -15,   0,  35 } },
+    { "Dance",          {  45,   0,  20,  40,  20 } },
+    { "Deep",           {  45,  15, -10, -20, -40 } },
+    { "Electronic",     {  40,   0, -10,  20,  35 } },
+    { "Flat",           {   0,   0,   0,   0,   0 } },
+    { "Hip-Hop",        {  50,  10, -10,  15,  20 } },
+    { "Jazz",           {  30,  15, -15,  15,  30 } },
+    { "Latin",          {  25,   0, -15,   0,  35 } },
+    { "Loudness",       {  55,   0, -10,   0,  30 } },
+    { "Lounge",         { -20, -10,  30,  10, -10 } },
+    { "Piano",          {  25,  15,  10,  30,  25 } },
+    { "Pop",            { -10,  25,  45,  15, -10 } },
+    { "R&B",            {  60,  15, -15,  15,  25 } },
+    { "Rock",           {  45,  20,  -5,  25,  35 } },
+    { "Small Speakers", {  55,  30,  10, -10, -40 } },
+    { "Spoken Word",    { -35,  10,  35,  35,  10 } },
+    { "Treble Booster", {   0,   0,   0,  25,  55 } },
+    { "Treble Reducer", {   0,   0,   0, -25, -55 } },
+    { "Vocal Booster",  { -15, -15,  30,  25,   0 } },
+};
+
+#define BT_EQ_PRESET_COUNT           (sizeof(m_presets) / sizeof(m_presets[0]))
+
+static volatile uint32_t m_selected = 0;
+
+uint32_t bt_app_eq_count(void)
+{
+    return BT_EQ_PRESET_COUNT;
+}
+
+const char *bt_app_eq_name(uint32_t index)
+{
+    return index < BT_EQ_PRESET_COUNT ? m_presets[index].name : NULL;
+}
+
+int16_t bt_app_eq_gain_db10(uint32_t index, uint32_t band)
+{
+    if (index >= BT_EQ_PRESET_COUNT || band >= BT_APP_EQ_BANDS) {
+        return 0;
+    }
+    return m_presets[index].gain_db10[band];
+}
+
+int16_t bt_app_eq_preamp_db10(uint32_t index)
+{
+    int16_t boost = 0;
+
+    for (uint32_t i = 0; i < BT_APP_EQ_BANDS; i++) {
+        int16_t g = bt_app_eq_gain_db10(index, i);
+        if (g > boost) {
+            boost = g;
+        }
+    }
+    return -boost;
+}
+
+bool bt_app_eq_select(uint32_t index)
+{
+    if (index >= BT_EQ_PRESET_COUNT) {
+        return false;
+    }
+    __atomic_store_n(&m_selected, index, __ATOMIC_RELEASE);
+    return true;
+}
+
+uint32_t bt_app_eq_selected(void)
+{
+    return __atomic_load_n(&m_selected, __ATOMIC_ACQUIRE);
+}
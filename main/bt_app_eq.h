@@ -0,0 +1,80 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef __BT_APP_EQ_H__
+#define __BT_APP_EQ_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BT_EQ_TAG                    "BT_EQ"
+
+/*
+ * Biquad sections in every preset. Each non-flat band costs about 60 cycles per
+ * sample by instruction count (five 32x32->64 MACs plus error feedback), so a
+ * preset using all bands at 48 kHz stereo takes about 29 M cycles/s, 12% of a
+ * 240 MHz core. Flat bands are skipped. A2DP_SINK_DSP_BENCHMARK logs the
+ * measured figure.
+ */
+#define BT_APP_EQ_BANDS              (5)
+
+typedef enum {
+    BT_APP_EQ_LOW_SHELF = 0,
+    BT_APP_EQ_PEAKING,
+    BT_APP_EQ_HIGH_SHELF,
+} bt_app_eq_band_type_t;
+
+/**
+ * @brief     one section of the EQ cascade, shared by all presets
+ */
+typedef struct {
+    bt_app_eq_band_type_t type;
+    uint16_t             freq;        /*!< centre or corner frequency, Hz */
+    uint16_t             q_x100;      /*!< quality factor, x100 */
+} bt_app_eq_band_t;
+
+extern const bt_app_eq_band_t bt_app_eq_bands[BT_APP_EQ_BANDS];
+
+/**
+ * @brief     number of presets, index 0 is a flat response
+ */
+uint32_t bt_app_eq_count(void);
+
+const char *bt_app_eq_name(uint32_t index);
+
+/**
+ * @brief     gain of one band in a preset, in tenths of a dB
+ */
+int16_t bt_app_eq_gain_db10(uint32_t index, uint32_t band);
+
+/**
+ * @brief     gain applied ahead of the cascade so boosted bands do not clip, tenths of a dB
+ */
+int16_t bt_app_eq_preamp_db10(uint32_t index);
+
+/**
+ * @brief     request a preset, safe from any task, the audio path picks it up on its next block
+ *
+ * @return    false if index is out of range
+ */
+bool bt_app_eq_select(uint32_t index);
+
+/**
+ * @brief     last requested preset
+ */
+uint32_t bt_app_eq_selected(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BT_APP_EQ_H__ */
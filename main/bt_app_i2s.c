@@ -0,0 +1,785 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "xtensa/hal.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "driver/i2s.h"
+#include "bt_app_ringbuf.h"
+#include "bt_app_asrc.h"
+#include "bt_app_jbuf.h"
+#include "bt_app_dsp.h"
+#include "bt_app_volume.h"
+#include "bt_app_dac.h"
+#include "bt_app_clock.h"
+#include "bt_app_i2s.h"
+
+/* largest chunk handed to the I2S driver in one call */
+#define BT_I2S_CHUNK_BYTES        (1024)
+
+/* input frames resampled per block */
+#define BT_I2S_BLOCK_FRAMES       (256)
+/* worst case output per block, a 16 kHz source into a 48 kHz DAC */
+#define BT_I2S_OUT_FRAMES_MAX     (BT_I2S_BLOCK_FRAMES * 3 + 4)
+/* frames widened to 32 bits per I2S write */
+#define BT_I2S_WIDE_FRAMES        (128)
+
+/* writer task stack in bytes. It runs the DSP chain, whose EQ design calls powf/sinf/cosf,
+ * the resampler and the volume stage, and logs through vprintf on reconfigurations */
+#define BT_I2S_TASK_STACK         (4096)
+
+/* synthetic packets pushed through the copy benchmark */
+#define BT_I2S_BENCH_PACKETS      (64)
+
+/* fade length used around stream reconfiguration */
+#define BT_I2S_FADE_MS            (8)
+/* fade length used to conceal an underrun */
+#define BT_I2S_CONCEAL_FADE_MS    (4)
+/* silence is fed to the DMA this long before the writer goes idle */
+#define BT_I2S_CONCEAL_MAX_MS     (1000)
+#define BT_I2S_GAIN_UNITY         (32768)
+
+#ifdef CONFIG_A2DP_SINK_RINGBUF_IN_PSRAM
+#define BT_I2S_RINGBUF_CAPS       (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+#else
+#define BT_I2S_RINGBUF_CAPS       (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#endif
+
+typedef enum {
+    BT_I2S_STATE_BUFFERING = 0,   /*!< waiting for the ring to reach the high watermark */
+    BT_I2S_STATE_PLAYING,         /*!< draining the ring into the I2S DMA */
+    BT_I2S_STATE_CONCEALING,      /*!< feeding silence to the DMA until the ring refills */
+} bt_i2s_state_t;
+
+typedef enum {
+    BT_I2S_RECONFIG_IDLE = 0,     /*!< running at the active configuration */
+    BT_I2S_RECONFIG_FADING,       /*!< fading out before switching to m_next_desc */
+    BT_I2S_RECONFIG_MEASURING,    /*!< switched, waiting for the first sample at the new config */
+} bt_i2s_reconfig_t;
+
+static void bt_i2s_task_handler(void *arg);
+
+static bt_app_ringbuf_t m_pcm_rb;
+static xTaskHandle bt_i2s_task_handle = NULL;
+static volatile bool m_i2s_waiting = false;
+static uint32_t m_in_rate = BT_I2S_DEFAULT_SAMPLE_RATE;
+static uint32_t m_out_rate = BT_I2S_DEFAULT_SAMPLE_RATE;
+static uint32_t m_high_watermark = 0;
+static uint32_t m_low_watermark = 0;
+
+/* configuration handoff from the app task, m_desc_seq is odd while it is written */
+static bt_app_stream_desc_t m_pending_desc;
+static int64_t m_pending_us = 0;
+static volatile uint32_t m_desc_seq = 0;
+static uint32_t m_applied_seq = 0;
+
+/* writer task owned */
+static bt_i2s_state_t m_state = BT_I2S_STATE_BUFFERING;
+static bt_app_stream_desc_t m_desc;
+static bt_app_stream_desc_t m_next_desc;
+static bt_i2s_reconfig_t m_reconfig = BT_I2S_RECONFIG_IDLE;
+static int64_t m_reconfig_start_us = 0;
+static uint32_t m_reconfig_cnt = 0;
+static uint32_t m_reconfig_us_last = 0;
+static uint32_t m_reconfig_us_max = 0;
+static int32_t m_ramp_gain = 0;
+static int32_t m_ramp_target = 0;
+static int32_t m_ramp_step = 1;
+static bool m_conceal_fading = false;
+static int64_t m_conceal_start_us = 0;
+static uint32_t m_conceal_cnt = 0;
+static uint32_t m_conceal_us_last = 0;
+static uint32_t m_conceal_us_max = 0;
+static uint64_t m_conceal_us_total = 0;
+
+/* fed to the DMA while concealing, mid-scale codes for the internal DAC */
+static uint8_t m_silence[BT_I2S_CHUNK_BYTES];
+
+#ifdef CONFIG_A2DP_SINK_I2S_32BIT
+static int32_t m_wide_block[BT_I2S_WIDE_FRAMES * 2];
+#endif
+
+/* bytes moved between decoded SBC and the DMA, by the side that moves them */
+static uint32_t m_pkt_cnt = 0;
+static uint64_t m_in_copy_bytes = 0;
+static uint64_t m_in_copy_cycles = 0;
+static uint64_t m_out_copy_bytes = 0;
+
+/* one packet at a time is tagged with its ring position and arrival time, the writer
+ * times it when the chunk holding that position reaches the DMA */
+static volatile bool m_lat_armed = false;
+static uint32_t m_lat_pos = 0;
+static int64_t m_lat_arrival_us = 0;
+static uint32_t m_lat_cnt = 0;
+static uint32_t m_lat_us_last = 0;
+static uint32_t m_lat_us_min = UINT32_MAX;
+static uint32_t m_lat_us_max = 0;
+static uint64_t m_lat_us_total = 0;
+
+#ifdef CONFIG_A2DP_SINK_ASRC
+static bt_app_asrc_t m_asrc;
+static bt_app_jbuf_t m_jbuf;
+#ifndef CONFIG_A2DP_SINK_ZERO_COPY
+static int16_t m_in_block[BT_I2S_BLOCK_FRAMES * 2];
+#endif
+static int16_t m_out_block[BT_I2S_OUT_FRAMES_MAX * 2];
+static uint64_t m_asrc_cycles = 0;
+static uint64_t m_asrc_frames = 0;
+static uint32_t m_asrc_cpf_max = 0;
+#endif
+
+void bt_app_i2s_write(const uint8_t *data, uint32_t len)
+{
+    if (m_pcm_rb.storage == NULL) {
+        return;
+    }
+
+    uint32_t head = m_pcm_rb.head;
+    uint32_t cc = xthal_get_ccount();
+    uint32_t written = bt_app_ringbuf_write(&m_pcm_rb, data, len);
+    m_in_copy_cycles += xthal_get_ccount() - cc;
+    m_in_copy_bytes += written;
+    m_pkt_cnt++;
+
+    if (written && !__atomic_load_n(&m_lat_armed, __ATOMIC_ACQUIRE)) {
+        m_lat_pos = head;
+        m_lat_arrival_us = esp_timer_get_time();
+        __atomic_store_n(&m_lat_armed, true, __ATOMIC_RELEASE);
+    }
+
+    if (m_i2s_waiting) {
+        xTaskNotifyGive(bt_i2s_task_handle);
+    }
+}
+
+void bt_app_i2s_configure(const bt_app_stream_desc_t *desc)
+{
+    uint32_t seq = m_desc_seq;
+
+    __atomic_store_n(&m_desc_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    m_pending_desc = *desc;
+    m_pending_us = esp_timer_get_time();
+    __atomic_store_n(&m_desc_seq, seq + 2, __ATOMIC_RELEASE);
+
+    if (m_i2s_waiting) {
+        xTaskNotifyGive(bt_i2s_task_handle);
+    }
+}
+
+void bt_app_i2s_get_stats(bt_app_i2s_stats_t *stats)
+{
+    stats->fill = bt_app_ringbuf_fill(&m_pcm_rb);
+    stats->size = m_pcm_rb.size;
+    stats->peak_fill = m_pcm_rb.peak_fill;
+    stats->overflow_cnt = m_pcm_rb.overflow_cnt;
+    stats->overflow_bytes = m_pcm_rb.overflow_bytes;
+    stats->underrun_cnt = m_pcm_rb.underrun_cnt;
+    stats->low_water_cnt = m_pcm_rb.low_water_cnt;
+    stats->in_rate = m_in_rate;
+    stats->out_rate = m_out_rate;
+#ifdef CONFIG_A2DP_SINK_ASRC
+    stats->drift_ppb = m_asrc.ppb;
+    stats->asrc_cpf_avg = m_asrc_frames ? (uint32_t)(m_asrc_cycles / m_asrc_frames) : 0;
+    stats->asrc_cpf_max = m_asrc_cpf_max;
+#else
+    stats->drift_ppb = 0;
+    stats->asrc_cpf_avg = 0;
+    stats->asrc_cpf_max = 0;
+#endif
+    stats->reconfig_cnt = m_reconfig_cnt;
+    stats->reconfig_us_last = m_reconfig_us_last;
+    stats->reconfig_us_max = m_reconfig_us_max;
+    stats->conceal_cnt = m_conceal_cnt;
+    stats->conceal_us_last = m_conceal_us_last;
+    stats->conceal_us_max = m_conceal_us_max;
+    stats->conceal_us_total = m_conceal_us_total;
+    stats->pkt_cnt = m_pkt_cnt;
+    stats->copy_bytes_per_pkt = m_pkt_cnt ? (uint32_t)((m_in_copy_bytes + m_out_copy_bytes) / m_pkt_cnt) : 0;
+    stats->copy_cycles_per_pkt = m_pkt_cnt ? (uint32_t)(m_in_copy_cycles / m_pkt_cnt) : 0;
+    stats->latency_cnt = m_lat_cnt;
+    stats->stack_free = bt_i2s_task_handle ? uxTaskGetStackHighWaterMark(bt_i2s_task_handle) : 0;
+    stats->latency_us_last = m_lat_us_last;
+    stats->latency_us_min = m_lat_cnt ? m_lat_us_min : 0;
+    stats->latency_us_max = m_lat_us_max;
+    stats->latency_us_avg = m_lat_cnt ? (uint32_t)(m_lat_us_total / m_lat_cnt) : 0;
+}
+
+static bool bt_i2s_config_pending(void)
+{
+    return __atomic_load_n(&m_desc_seq, __ATOMIC_ACQUIRE) != m_applied_seq;
+}
+
+/* take a consistent copy of the pending configuration, false if none or mid-update */
+static bool bt_i2s_fetch_config(bt_app_stream_desc_t *desc, int64_t *t_us)
+{
+    uint32_t seq = __atomic_load_n(&m_desc_seq, __ATOMIC_ACQUIRE);
+    if (seq == m_applied_seq || (seq & 1)) {
+        return false;
+    }
+
+    *desc = m_pending_desc;
+    *t_us = m_pending_us;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&m_desc_seq, __ATOMIC_RELAXED) != seq) {
+        return false;
+    }
+
+    m_applied_seq = seq;
+    return true;
+}
+
+static void bt_i2s_ramp_to(int32_t target, uint32_t fade_ms)
+{
+    uint32_t frames = fade_ms * m_out_rate / 1000;
+    m_ramp_target = target;
+    m_ramp_step = BT_I2S_GAIN_UNITY / (frames ? frames : 1);
+    if (m_ramp_step == 0) {
+        m_ramp_step = 1;
+    }
+}
+
+/* apply the fade ramp in place, untouched at unity gain */
+static void bt_i2s_apply_ramp(int16_t *pcm, uint32_t frames)
+{
+    if (m_ramp_gain == m_ramp_target) {
+        if (m_ramp_gain == 0) {
+            memset(pcm, 0, frames * 4);
+        }
+        return;
+    }
+
+    int32_t gain = m_ramp_gain;
+    for (uint32_t i = 0; i < frames; i++) {
+        if (gain < m_ramp_target) {
+            gain += m_ramp_step;
+            if (gain > m_ramp_target) {
+                gain = m_ramp_target;
+            }
+        } else if (gain > m_ramp_target) {
+            gain -= m_ramp_step;
+            if (gain < m_ramp_target) {
+                gain = m_ramp_target;
+            }
+        }
+        pcm[0] = (int16_t)((pcm[0] * gain) >> 15);
+        pcm[1] = (int16_t)((pcm[1] * gain) >> 15);
+        pcm += 2;
+    }
+    m_ramp_gain = gain;
+}
+
+/* size the prefill and jitter target so one late media packet does not underrun */
+static uint32_t bt_i2s_size_buffers(void)
+{
+    uint32_t cap = m_pcm_rb.size / 4 * 3 / 4;
+    uint32_t burst = m_desc.burst_frames * 2;
+    uint32_t prefill = m_high_watermark / 4;
+    uint32_t low = m_low_watermark;
+
+#ifdef CONFIG_A2DP_SINK_ASRC
+    prefill = CONFIG_A2DP_SINK_JBUF_TARGET_MS * m_in_rate / 1000;
+#endif
+    if (prefill < burst) {
+        prefill = burst;
+    }
+    if (prefill > cap) {
+        prefill = cap;
+    }
+    /* concealment fades out below low and resumes at high, keep them apart */
+    if (low > prefill * 2) {
+        low = prefill * 2;
+    }
+    bt_app_ringbuf_set_watermarks(&m_pcm_rb, prefill * 4, low);
+    return prefill;
+}
+
+/* leave silence in the DMA buffers the driver replays while no new data arrives */
+static void bt_i2s_silence_dma(void)
+{
+#ifdef CONFIG_A2DP_SINK_OUTPUT_INTERNAL_DAC
+    /* code 0 is the bottom rail of the DAC, queue a full DMA worth of mid-scale instead */
+    for (uint32_t n = 0; n < BT_I2S_DMA_BYTES; n += sizeof(m_silence)) {
+        i2s_write_bytes(0, (const char *)m_silence, sizeof(m_silence), portMAX_DELAY);
+    }
+#else
+    i2s_zero_dma_buffer(0);
+#endif
+}
+
+/* close a concealment event and record how long the output was faded or silent */
+static void bt_i2s_conceal_end(void)
+{
+    if (!m_conceal_fading) {
+        return;
+    }
+    m_conceal_fading = false;
+
+    uint32_t dt = (uint32_t)(esp_timer_get_time() - m_conceal_start_us);
+
+    m_conceal_us_last = dt;
+    m_conceal_us_total += dt;
+    if (dt > m_conceal_us_max) {
+        m_conceal_us_max = dt;
+    }
+    ESP_LOGI(BT_I2S_TAG, "underrun concealed for %u us, %u events", dt, m_conceal_cnt);
+}
+
+/* the ring is about to run dry, fade out over a few ms instead of clicking */
+static void bt_i2s_conceal_begin(void)
+{
+    m_conceal_cnt++;
+    m_conceal_start_us = esp_timer_get_time();
+    m_conceal_fading = true;
+    bt_i2s_ramp_to(0, BT_I2S_CONCEAL_FADE_MS);
+}
+
+/* runs on the writer task once the old stream has faded out */
+static void bt_i2s_switch_stream(const bt_app_stream_desc_t *desc)
+{
+    bool rate_changed = (desc->sample_rate != m_in_rate);
+
+    m_desc = *desc;
+
+    if (rate_changed) {
+        uint32_t out_rate = desc->sample_rate;
+#ifdef CONFIG_A2DP_SINK_FIXED_OUTPUT_RATE
+        out_rate = CONFIG_A2DP_SINK_OUTPUT_SAMPLE_RATE;
+#endif
+        /* whatever is queued was decoded for the old rate */
+        bt_app_ringbuf_flush(&m_pcm_rb);
+        if (out_rate != m_out_rate) {
+            bt_i2s_silence_dma();
+            i2s_set_clk(0, out_rate, BT_I2S_BITS_PER_SAMPLE, 2);
+        }
+        m_in_rate = desc->sample_rate;
+        if (out_rate != m_out_rate) {
+            m_out_rate = out_rate;
+#ifdef CONFIG_A2DP_SINK_DSP
+            bt_app_dsp_set_sample_rate(m_out_rate);
+#endif
+        }
+#ifdef CONFIG_A2DP_SINK_ASRC
+        bt_app_asrc_init(&m_asrc, m_in_rate, m_out_rate);
+        m_asrc_cycles = 0;
+        m_asrc_frames = 0;
+        m_asrc_cpf_max = 0;
+#endif
+        m_state = BT_I2S_STATE_BUFFERING;
+        m_ramp_gain = 0;
+    }
+    bt_i2s_conceal_end();
+    bt_i2s_ramp_to(BT_I2S_GAIN_UNITY, BT_I2S_FADE_MS);
+
+    uint32_t prefill = bt_i2s_size_buffers();
+#ifdef CONFIG_A2DP_SINK_ASRC
+    if (rate_changed) {
+        bt_app_jbuf_init(&m_jbuf, prefill, bt_app_ringbuf_fill(&m_pcm_rb) / 4);
+    } else {
+        /* keep the learned drift across a same-rate reconfiguration */
+        bt_app_jbuf_set_target(&m_jbuf, prefill);
+    }
+#else
+    (void)prefill;
+#endif
+
+    ESP_LOGI(BT_I2S_TAG, "stream %u -> %u Hz, burst %u frames, prefill %u frames, budget %u cycles/frame",
+             m_in_rate, m_out_rate, m_desc.burst_frames, m_pcm_rb.high_watermark / 4,
+             CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * 1000000 / m_out_rate);
+
+    m_reconfig = BT_I2S_RECONFIG_MEASURING;
+}
+
+/* pick up a new configuration and drive the fade-out, switch, fade-in sequence */
+static void bt_i2s_poll_config(void)
+{
+    bt_app_stream_desc_t desc;
+    int64_t t_us;
+
+    if (bt_i2s_fetch_config(&desc, &t_us)) {
+        m_next_desc = desc;
+        m_reconfig_start_us = t_us;
+        m_reconfig = BT_I2S_RECONFIG_FADING;
+        /* at the same rate the queued PCM stays valid and simply plays out */
+        if (desc.sample_rate != m_in_rate) {
+            if (m_state == BT_I2S_STATE_PLAYING) {
+                bt_i2s_conceal_end();
+                bt_i2s_ramp_to(0, BT_I2S_FADE_MS);
+            } else {
+                m_ramp_gain = 0;
+            }
+        }
+    }
+
+    if (m_reconfig == BT_I2S_RECONFIG_FADING &&
+            (m_ramp_gain == 0 || m_next_desc.sample_rate == m_in_rate)) {
+        bt_i2s_switch_stream(&m_next_desc);
+    }
+}
+
+/* called after PCM at the active configuration reached the DMA */
+static void bt_i2s_first_sample_check(void)
+{
+    if (m_reconfig != BT_I2S_RECONFIG_MEASURING) {
+        return;
+    }
+
+    uint32_t dt = (uint32_t)(esp_timer_get_time() - m_reconfig_start_us);
+    m_reconfig_us_last = dt;
+    if (dt > m_reconfig_us_max) {
+        m_reconfig_us_max = dt;
+    }
+    m_reconfig_cnt++;
+    m_reconfig = BT_I2S_RECONFIG_IDLE;
+
+    ESP_LOGI(BT_I2S_TAG, "reconfigured to %u Hz, first sample after %u us, stack %u bytes never used",
+             m_in_rate, dt, uxTaskGetStackHighWaterMark(NULL));
+}
+
+/* block the writer until the ring holds at least len bytes or a new configuration arrives */
+static void bt_i2s_wait_fill(uint32_t len)
+{
+    while (bt_app_ringbuf_fill(&m_pcm_rb) < len && !bt_i2s_config_pending()) {
+        m_i2s_waiting = true;
+        /* re-check after publishing the flag so a concurrent write is not missed */
+        if (bt_app_ringbuf_fill(&m_pcm_rb) >= len || bt_i2s_config_pending()) {
+            break;
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    m_i2s_waiting = false;
+}
+
+/* apply the volume and hand PCM to the DMA in the configured sample width */
+static void bt_i2s_output(int16_t *pcm, uint32_t frames)
+{
+#ifdef CONFIG_A2DP_SINK_I2S_32BIT
+    while (frames) {
+        uint32_t n = frames < BT_I2S_WIDE_FRAMES ? frames : BT_I2S_WIDE_FRAMES;
+        bt_app_volume_process32(pcm, m_wide_block, n);
+        i2s_write_bytes(0, (const char *)m_wide_block, n * 8, portMAX_DELAY);
+        m_out_copy_bytes += n * 8;
+        pcm += n * 2;
+        frames -= n;
+    }
+#else
+    bt_app_volume_process16(pcm, frames);
+#ifdef CONFIG_A2DP_SINK_OUTPUT_INTERNAL_DAC
+    bt_app_dac_process(pcm, frames);
+#endif
+    i2s_write_bytes(0, (const char *)pcm, frames * 4, portMAX_DELAY);
+    m_out_copy_bytes += frames * 4;
+#endif
+}
+
+/* write one chunk to the DMA, returns false when the ring ran dry */
+static bool bt_i2s_write_chunk(void)
+{
+#ifdef CONFIG_A2DP_SINK_ASRC
+    uint32_t fill = bt_app_ringbuf_fill(&m_pcm_rb) / 4;
+#ifdef CONFIG_A2DP_SINK_ZERO_COPY
+    /* resample straight out of the ring, a block may end early at the wrap point */
+    uint8_t *chunk;
+    uint32_t frames = bt_app_ringbuf_peek(&m_pcm_rb, &chunk) / 4;
+    const int16_t *in = (const int16_t *)chunk;
+    if (frames > BT_I2S_BLOCK_FRAMES) {
+        frames = BT_I2S_BLOCK_FRAMES;
+    }
+#else
+    uint32_t frames = bt_app_ringbuf_read(&m_pcm_rb, (uint8_t *)m_in_block, BT_I2S_BLOCK_FRAMES * 4) / 4;
+    const int16_t *in = m_in_block;
+    m_out_copy_bytes += frames * 4;
+#endif
+    if (frames == 0) {
+        return false;
+    }
+
+    bt_app_asrc_set_drift(&m_asrc, bt_app_jbuf_update(&m_jbuf, fill));
+
+    uint32_t cc = xthal_get_ccount();
+    uint32_t out = bt_app_asrc_process(&m_asrc, in, frames, m_out_block);
+    cc = xthal_get_ccount() - cc;
+#ifdef CONFIG_A2DP_SINK_ZERO_COPY
+    bt_app_ringbuf_consume(&m_pcm_rb, frames * 4);
+#endif
+    bt_app_clock_advance(frames, m_in_rate);
+
+    if (out) {
+        m_asrc_cycles += cc;
+        m_asrc_frames += out;
+        if (cc / out > m_asrc_cpf_max) {
+            m_asrc_cpf_max = cc / out;
+        }
+#ifdef CONFIG_A2DP_SINK_DSP
+        bt_app_dsp_process(m_out_block, out);
+#endif
+        bt_i2s_apply_ramp(m_out_block, out);
+        bt_i2s_output(m_out_block, out);
+    }
+#else
+    uint8_t *chunk;
+    uint32_t len = bt_app_ringbuf_peek(&m_pcm_rb, &chunk) & ~3u;
+    if (len == 0) {
+        return false;
+    }
+    if (len > BT_I2S_CHUNK_BYTES) {
+        len = BT_I2S_CHUNK_BYTES;
+    }
+
+    /* the consumer owns this region until it is consumed, so it can be modified in place */
+#ifdef CONFIG_A2DP_SINK_DSP
+    bt_app_dsp_process((int16_t *)chunk, len / 4);
+#endif
+    bt_i2s_apply_ramp((int16_t *)chunk, len / 4);
+    bt_i2s_output((int16_t *)chunk, len / 4);
+    bt_app_ringbuf_consume(&m_pcm_rb, len);
+    bt_app_clock_advance(len / 4, m_in_rate);
+#endif
+    return true;
+}
+
+/* time the tagged packet once the chunk consumed from tail onwards holding its first byte was queued */
+static void bt_i2s_latency_check(uint32_t tail)
+{
+    if (!__atomic_load_n(&m_lat_armed, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    uint32_t pos = m_lat_pos;
+    uint32_t end = m_pcm_rb.tail;
+    if ((int32_t)(pos - tail) < 0) {
+        /* flushed before it was played, tag the next packet instead */
+        __atomic_store_n(&m_lat_armed, false, __ATOMIC_RELEASE);
+        return;
+    }
+    if ((int32_t)(pos - end) >= 0) {
+        return;
+    }
+
+    /* i2s_write_bytes returns with the chunk at the back of the DMA chain, ahead of it
+     * are the other buffers and on average half of the one being played */
+    uint64_t dma_us = (uint64_t)(BT_I2S_DMA_BUF_COUNT * BT_I2S_DMA_BUF_LEN - BT_I2S_DMA_BUF_LEN / 2) * 1000000 / m_out_rate;
+    /* the tagged sample went out this far before the end of the chunk */
+    uint64_t behind_us = (uint64_t)((end - pos) / 4) * 1000000 / m_in_rate;
+    int64_t dt = esp_timer_get_time() - m_lat_arrival_us + (int64_t)dma_us - (int64_t)behind_us;
+
+    if (dt < 0) {
+        dt = 0;
+    }
+    m_lat_us_last = (uint32_t)dt;
+    m_lat_us_total += m_lat_us_last;
+    if (m_lat_us_last < m_lat_us_min) {
+        m_lat_us_min = m_lat_us_last;
+    }
+    if (m_lat_us_last > m_lat_us_max) {
+        m_lat_us_max = m_lat_us_last;
+    }
+    m_lat_cnt++;
+    __atomic_store_n(&m_lat_armed, false, __ATOMIC_RELEASE);
+}
+
+/* keep the DMA fed with silence, never waits for the ring */
+static void bt_i2s_conceal(void)
+{
+    uint32_t fill = bt_app_ringbuf_fill(&m_pcm_rb);
+
+    if (fill >= m_pcm_rb.high_watermark) {
+        bt_i2s_conceal_end();
+        bt_i2s_ramp_to(BT_I2S_GAIN_UNITY, BT_I2S_CONCEAL_FADE_MS);
+        m_state = BT_I2S_STATE_PLAYING;
+        return;
+    }
+
+    if (esp_timer_get_time() - m_conceal_start_us > BT_I2S_CONCEAL_MAX_MS * 1000LL) {
+        /* the source stopped rather than stalled, go idle on silent DMA buffers */
+        bt_i2s_conceal_end();
+        bt_i2s_ramp_to(BT_I2S_GAIN_UNITY, BT_I2S_FADE_MS);
+        bt_i2s_silence_dma();
+        m_state = BT_I2S_STATE_BUFFERING;
+        return;
+    }
+
+    i2s_write_bytes(0, (const char *)m_silence, sizeof(m_silence), portMAX_DELAY);
+}
+
+static void bt_i2s_task_handler(void *arg)
+{
+    for (;;) {
+        bt_i2s_poll_config();
+
+        if (m_state == BT_I2S_STATE_BUFFERING) {
+            bt_i2s_wait_fill(m_pcm_rb.high_watermark);
+            if (bt_i2s_config_pending()) {
+                continue;
+            }
+            ESP_LOGD(BT_I2S_TAG, "%s prefill done, %u bytes", __func__, bt_app_ringbuf_fill(&m_pcm_rb));
+            m_state = BT_I2S_STATE_PLAYING;
+        } else if (m_state == BT_I2S_STATE_CONCEALING) {
+            bt_i2s_conceal();
+            continue;
+        }
+
+        if (m_reconfig != BT_I2S_RECONFIG_FADING) {
+            uint32_t fill = bt_app_ringbuf_fill(&m_pcm_rb);
+            if (!m_conceal_fading && m_ramp_target != 0 && fill < m_pcm_rb.low_watermark) {
+                bt_i2s_conceal_begin();
+            } else if (m_conceal_fading && m_ramp_gain != 0 && fill >= m_pcm_rb.low_watermark) {
+                /* refilled before reaching silence, ramp straight back */
+                bt_i2s_conceal_end();
+                bt_i2s_ramp_to(BT_I2S_GAIN_UNITY, BT_I2S_CONCEAL_FADE_MS);
+            }
+        }
+
+        uint32_t tail = m_pcm_rb.tail;
+        if (bt_i2s_write_chunk()) {
+            bt_i2s_latency_check(tail);
+            bt_i2s_first_sample_check();
+            if (m_conceal_fading && m_ramp_gain == 0) {
+                m_state = BT_I2S_STATE_CONCEALING;
+            }
+        } else {
+            /* ran dry before the fade finished, nothing left to fade out */
+            m_pcm_rb.underrun_cnt++;
+            m_ramp_gain = 0;
+            if (m_reconfig == BT_I2S_RECONFIG_FADING) {
+                bt_i2s_conceal_end();
+                m_state = BT_I2S_STATE_BUFFERING;
+                continue;
+            }
+            if (!m_conceal_fading) {
+                bt_i2s_conceal_begin();
+            }
+            m_state = BT_I2S_STATE_CONCEALING;
+        }
+    }
+}
+
+/* push synthetic packets through ring and a stand-in for the driver copy, with and
+ * without the intermediate block copy, and log bytes copied and cycles per packet */
+static void bt_i2s_copy_benchmark(void)
+{
+    uint32_t pkt_len = m_desc.burst_frames * 4;
+    uint8_t *pkt = malloc(pkt_len);
+    uint8_t *dma = malloc(BT_I2S_CHUNK_BYTES);
+
+    if (pkt == NULL || dma == NULL || pkt_len > m_pcm_rb.size) {
+        free(pkt);
+        free(dma);
+        return;
+    }
+    memset(pkt, 0x55, pkt_len);
+
+    for (int zero_copy = 0; zero_copy < 2; zero_copy++) {
+        uint64_t bytes = 0;
+        uint32_t cycles = 0;
+
+        for (uint32_t p = 0; p < BT_I2S_BENCH_PACKETS; p++) {
+            uint32_t cc = xthal_get_ccount();
+            bytes += bt_app_ringbuf_write(&m_pcm_rb, pkt, pkt_len);
+            for (;;) {
+                uint8_t *chunk;
+                uint32_t len;
+                if (zero_copy) {
+                    len = bt_app_ringbuf_peek(&m_pcm_rb, &chunk);
+                    len = len > BT_I2S_CHUNK_BYTES ? BT_I2S_CHUNK_BYTES : len;
+                } else {
+                    chunk = dma;
+                    len = bt_app_ringbuf_read(&m_pcm_rb, dma, BT_I2S_CHUNK_BYTES);
+                    bytes += len;
+                }
+                if (len == 0) {
+                    break;
+                }
+                /* what i2s_write_bytes does with the chunk */
+                memcpy(dma, chunk, len);
+                bytes += len;
+                if (zero_copy) {
+                    bt_app_ringbuf_consume(&m_pcm_rb, len);
+                }
+            }
+            cycles += xthal_get_ccount() - cc;
+        }
+
+        ESP_LOGI(BT_I2S_TAG, "copy bench %s: %u byte packets, %u bytes copied and %u cycles per packet",
+                 zero_copy ? "zero-copy" : "block copy", pkt_len,
+                 (uint32_t)(bytes / BT_I2S_BENCH_PACKETS), cycles / BT_I2S_BENCH_PACKETS);
+    }
+
+    bt_app_ringbuf_flush(&m_pcm_rb);
+    free(pkt);
+    free(dma);
+}
+
+void bt_app_i2s_task_start_up(void)
+{
+    if (!bt_app_ringbuf_init(&m_pcm_rb, CONFIG_A2DP_SINK_RINGBUF_SIZE, BT_I2S_RINGBUF_CAPS)) {
+#ifdef CONFIG_A2DP_SINK_RINGBUF_IN_PSRAM
+        ESP_LOGW(BT_I2S_TAG, "%s PSRAM allocation failed, using internal RAM", __func__);
+        if (!bt_app_ringbuf_init(&m_pcm_rb, CONFIG_A2DP_SINK_RINGBUF_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT))
+#endif
+        {
+            ESP_LOGE(BT_I2S_TAG, "%s ring buffer allocation failed", __func__);
+            return;
+        }
+    }
+    m_high_watermark = m_pcm_rb.size * CONFIG_A2DP_SINK_RINGBUF_HIGH_WATERMARK / 100;
+    m_low_watermark = m_pcm_rb.size * CONFIG_A2DP_SINK_RINGBUF_LOW_WATERMARK / 100;
+    bt_app_ringbuf_set_watermarks(&m_pcm_rb, m_high_watermark, m_low_watermark);
+
+    ESP_LOGI(BT_I2S_TAG, "%s profile, PCM ring %u bytes, watermarks high %u low %u, DMA %u x %u frames",
+             BT_I2S_LATENCY_PROFILE, m_pcm_rb.size, m_pcm_rb.high_watermark, m_pcm_rb.low_watermark,
+             BT_I2S_DMA_BUF_COUNT, BT_I2S_DMA_BUF_LEN);
+
+    /* start out at the clock app_main installed the driver with */
+    bt_app_stream_default(&m_desc, BT_I2S_DEFAULT_SAMPLE_RATE);
+#ifdef CONFIG_A2DP_SINK_ASRC
+    bt_app_asrc_init(&m_asrc, m_in_rate, m_out_rate);
+#endif
+#ifdef CONFIG_A2DP_SINK_DSP
+    bt_app_dsp_init(m_out_rate);
+#ifdef CONFIG_A2DP_SINK_DSP_BENCHMARK
+    bt_app_dsp_benchmark(m_out_rate);
+#endif
+#endif
+    bt_app_volume_init();
+#ifdef CONFIG_A2DP_SINK_OUTPUT_INTERNAL_DAC
+    memset(m_silence, 0x80, sizeof(m_silence));
+    bt_app_dac_init();
+#ifdef CONFIG_A2DP_SINK_DAC_BENCHMARK
+    bt_app_dac_benchmark(m_out_rate);
+#endif
+#endif
+#ifdef CONFIG_A2DP_SINK_COPY_BENCHMARK
+    bt_i2s_copy_benchmark();
+#endif
+    bt_i2s_ramp_to(BT_I2S_GAIN_UNITY, BT_I2S_FADE_MS);
+#ifdef CONFIG_A2DP_SINK_ASRC
+    bt_app_jbuf_init(&m_jbuf, bt_i2s_size_buffers(), 0);
+#else
+    bt_i2s_size_buffers();
+#endif
+
+    xTaskCreatePinnedToCore(bt_i2s_task_handler, "BtI2ST", BT_I2S_TASK_STACK, NULL, configMAX_PRIORITIES - 3,
+                            &bt_i2s_task_handle, CONFIG_A2DP_SINK_I2S_TASK_CORE);
+}
+
+void bt_app_i2s_task_shut_down(void)
+{
+    if (bt_i2s_task_handle) {
+        vTaskDelete(bt_i2s_task_handle);
+        bt_i2s_task_handle = NULL;
+    }
+    bt_app_ringbuf_deinit(&m_pcm_rb);
+}
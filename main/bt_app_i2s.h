@@ -0,0 +1,100 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef __BT_APP_I2S_H__
+#define __BT_APP_I2S_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "bt_app_stream.h"
+
+#define BT_I2S_TAG                   "BT_I2S"
+
+/* I2S clock the driver is installed with in app_main */
+#ifdef CONFIG_A2DP_SINK_FIXED_OUTPUT_RATE
+#define BT_I2S_DEFAULT_SAMPLE_RATE   CONFIG_A2DP_SINK_OUTPUT_SAMPLE_RATE
+#else
+#define BT_I2S_DEFAULT_SAMPLE_RATE   (44100)
+#endif
+
+/* DMA buffers the driver is installed with in app_main, sized by the latency profile */
+#define BT_I2S_DMA_BUF_COUNT         CONFIG_A2DP_SINK_DMA_BUF_COUNT
+#define BT_I2S_DMA_BUF_LEN           CONFIG_A2DP_SINK_DMA_BUF_LEN
+#define BT_I2S_DMA_BYTES             (BT_I2S_DMA_BUF_COUNT * BT_I2S_DMA_BUF_LEN * BT_I2S_BITS_PER_SAMPLE / 4)
+
+#if defined(CONFIG_A2DP_SINK_LATENCY_LOW)
+#define BT_I2S_LATENCY_PROFILE       "low-latency"
+#elif defined(CONFIG_A2DP_SINK_LATENCY_ROBUST)
+#define BT_I2S_LATENCY_PROFILE       "robust"
+#elif defined(CONFIG_A2DP_SINK_LATENCY_CUSTOM)
+#define BT_I2S_LATENCY_PROFILE       "custom"
+#else
+#define BT_I2S_LATENCY_PROFILE       "balanced"
+#endif
+
+/* I2S slot width, PCM stays 16-bit up to the volume stage */
+#ifdef CONFIG_A2DP_SINK_I2S_32BIT
+#define BT_I2S_BITS_PER_SAMPLE       (32)
+#else
+#define BT_I2S_BITS_PER_SAMPLE       (16)
+#endif
+
+/**
+ * @brief     snapshot of the PCM ring and writer task counters
+ */
+typedef struct {
+    uint32_t             fill;            /*!< bytes currently queued */
+    uint32_t             size;            /*!< ring capacity in bytes */
+    uint32_t             peak_fill;       /*!< highest fill level seen */
+    uint32_t             overflow_cnt;    /*!< packets truncated because the ring was full */
+    uint32_t             overflow_bytes;  /*!< bytes dropped on overflow */
+    uint32_t             underrun_cnt;    /*!< times the writer ran the ring dry */
+    uint32_t             low_water_cnt;   /*!< times the fill dropped below the low watermark */
+    uint32_t             in_rate;         /*!< source sample rate */
+    uint32_t             out_rate;        /*!< I2S sample rate */
+    int32_t              drift_ppb;       /*!< current resampler drift correction */
+    uint32_t             asrc_cpf_avg;    /*!< resampler CPU cycles per output frame, average */
+    uint32_t             asrc_cpf_max;    /*!< resampler CPU cycles per output frame, worst block */
+    uint32_t             reconfig_cnt;    /*!< stream reconfigurations applied */
+    uint32_t             reconfig_us_last;/*!< config event to first sample at the new config, last */
+    uint32_t             reconfig_us_max; /*!< config event to first sample at the new config, worst */
+    uint32_t             conceal_cnt;     /*!< underruns concealed by fading to silence */
+    uint32_t             conceal_us_last; /*!< fade-out to fade-in time of the last concealment */
+    uint32_t             conceal_us_max;  /*!< fade-out to fade-in time, worst */
+    uint64_t             conceal_us_total;/*!< total time spent concealing */
+    uint32_t             pkt_cnt;         /*!< A2DP packets queued */
+    uint32_t             copy_bytes_per_pkt;  /*!< bytes copied from the A2DP callback buffer up to the DMA, per packet */
+    uint32_t             copy_cycles_per_pkt; /*!< cycles spent queueing a packet in the A2DP callback */
+    uint32_t             latency_cnt;     /*!< packet to DAC latency samples taken */
+    uint32_t             latency_us_last; /*!< A2DP packet arrival to the DAC playing its first sample, last */
+    uint32_t             latency_us_min;  /*!< packet to DAC latency, best */
+    uint32_t             latency_us_max;  /*!< packet to DAC latency, worst */
+    uint32_t             latency_us_avg;  /*!< packet to DAC latency, average */
+    uint32_t             stack_free;      /*!< writer task stack bytes never used so far */
+} bt_app_i2s_stats_t;
+
+/**
+ * @brief     queue decoded PCM for the I2S writer task, never blocks
+ */
+void bt_app_i2s_write(const uint8_t *data, uint32_t len);
+
+/**
+ * @brief     switch to a new A2DP stream configuration
+ *
+ * Returns immediately. The writer task fades out, flushes PCM queued at the old
+ * rate, switches the I2S clock, resizes its buffers for the stream and fades back in.
+ */
+void bt_app_i2s_configure(const bt_app_stream_desc_t *desc);
+
+void bt_app_i2s_get_stats(bt_app_i2s_stats_t *stats);
+
+void bt_app_i2s_task_start_up(void);
+
+void bt_app_i2s_task_shut_down(void);
+
+#endif /* __BT_APP_I2S_H__ */
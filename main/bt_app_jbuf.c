@@ -0,0 +1,54 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "bt_app_asrc.h"
+#include "bt_app_jbuf.h"
+
+/* fill smoothing, 1/256 per block is about 1.5 s at 256-frame blocks */
+#define BT_APP_JBUF_AVG_SHIFT        (8)
+/* proportional gain, ppb per frame of error */
+#define BT_APP_JBUF_KP               (1000)
+/* integral gain, ppb per frame of error per block, as a right shift (1/16) */
+#define BT_APP_JBUF_KI_SHIFT         (4)
+
+void bt_app_jbuf_init(bt_app_jbuf_t *jb, uint32_t target_frames, uint32_t fill_frames)
+{
+    memset(jb, 0, sizeof(bt_app_jbuf_t));
+    jb->target = target_frames;
+    jb->avg_q8 = (int32_t)(fill_frames << 8);
+}
+
+void bt_app_jbuf_set_target(bt_app_jbuf_t *jb, uint32_t target_frames)
+{
+    jb->target = target_frames;
+}
+
+int32_t bt_app_jbuf_update(bt_app_jbuf_t *jb, uint32_t fill_frames)
+{
+    jb->avg_q8 += ((int32_t)(fill_frames << 8) - jb->avg_q8) >> BT_APP_JBUF_AVG_SHIFT;
+
+    int32_t err_q8 = jb->avg_q8 - (int32_t)(jb->target << 8);
+
+    jb->integ_q8 += err_q8 >> BT_APP_JBUF_KI_SHIFT;
+    if (jb->integ_q8 > (BT_APP_ASRC_MAX_PPB << 8)) {
+        jb->integ_q8 = BT_APP_ASRC_MAX_PPB << 8;
+    } else if (jb->integ_q8 < -(BT_APP_ASRC_MAX_PPB << 8)) {
+        jb->integ_q8 = -(BT_APP_ASRC_MAX_PPB << 8);
+    }
+
+    int64_t ppb = ((int64_t)err_q8 * BT_APP_JBUF_KP + jb->integ_q8) >> 8;
+    if (ppb > BT_APP_ASRC_MAX_PPB) {
+        ppb = BT_APP_ASRC_MAX_PPB;
+    } else if (ppb < -BT_APP_ASRC_MAX_PPB) {
+        ppb = -BT_APP_ASRC_MAX_PPB;
+    }
+    jb->ppb = (int32_t)ppb;
+    return jb->ppb;
+}
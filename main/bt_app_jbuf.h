@@ -0,0 +1,51 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef __BT_APP_JBUF_H__
+#define __BT_APP_JBUF_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief     jitter buffer fill tracker
+ *
+ * Smooths the PCM ring fill level over about 1.5 s of blocks and runs a PI
+ * controller on the error against the target fill. The output is the drift
+ * correction for bt_app_asrc_set_drift(), so the buffer holds its target latency
+ * while the source and DAC clocks wander apart.
+ */
+typedef struct {
+    uint32_t             target;      /*!< target fill in frames */
+    int32_t              avg_q8;      /*!< smoothed fill, frames in Q8 */
+    int32_t              integ_q8;    /*!< integral term, ppb in Q8 */
+    int32_t              ppb;         /*!< last correction */
+} bt_app_jbuf_t;
+
+void bt_app_jbuf_init(bt_app_jbuf_t *jb, uint32_t target_frames, uint32_t fill_frames);
+
+/**
+ * @brief     move the target fill without resetting the learned drift
+ */
+void bt_app_jbuf_set_target(bt_app_jbuf_t *jb, uint32_t target_frames);
+
+/**
+ * @brief     feed the current fill level, call once per processed block
+ *
+ * @return    drift correction in parts per billion
+ */
+int32_t bt_app_jbuf_update(bt_app_jbuf_t *jb, uint32_t fill_frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BT_APP_JBUF_H__ */
@@ -0,0 +1,157 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_avrc_api.h"
+#include "bt_app_meta.h"
+
+typedef struct {
+    uint32_t             gen;             /*!< track generation */
+    uint32_t             truncated;       /*!< bit per attribute cut to fit */
+    uint16_t             len[BT_APP_META_NUM];
+    char                 text[BT_APP_META_NUM][BT_APP_META_TEXT_LEN];
+} bt_meta_store_t;
+
+/*
+ * Triple buffer. The single writer (the BtAppT task) updates m_buf[m_back] and swaps it
+ * into m_mid to publish. The single reader (the iPod task) swaps m_mid into m_front when
+ * it holds a newer snapshot and copies from m_front. Neither side retries, spins or waits,
+ * and the reader never sees a buffer the writer is filling.
+ */
+#define BT_META_BUFS                 (3)
+#define BT_META_MID_INDEX            (0x3)
+#define BT_META_MID_NEW              (0x4)
+
+static bt_meta_store_t m_buf[BT_META_BUFS];
+static uint32_t m_back = 0;                /*!< writer only */
+static uint32_t m_front = 1;               /*!< reader only */
+static uint32_t m_mid = 2;                 /*!< published index, BT_META_MID_NEW until the reader takes it */
+
+/* published next to the snapshot, readable from any task */
+static uint32_t m_gen = 0;
+static uint32_t m_truncated = 0;
+static uint32_t m_version = 0;
+
+bt_app_meta_attr_t bt_app_meta_attr_from_avrc(uint8_t attr_id)
+{
+    switch (attr_id) {
+    case ESP_AVRC_MD_ATTR_TITLE:
+        return BT_APP_META_TITLE;
+    case ESP_AVRC_MD_ATTR_ARTIST:
+        return BT_APP_META_ARTIST;
+    case ESP_AVRC_MD_ATTR_ALBUM:
+        return BT_APP_META_ALBUM;
+    case ESP_AVRC_MD_ATTR_GENRE:
+        return BT_APP_META_GENRE;
+    default:
+        return BT_APP_META_NUM;
+    }
+}
+
+static void bt_meta_publish(void)
+{
+    uint32_t pub = m_back;
+
+    m_back = __atomic_exchange_n(&m_mid, pub | BT_META_MID_NEW, __ATOMIC_ACQ_REL) & BT_META_MID_INDEX;
+    /* the reader may be copying from pub as well, both sides only read it */
+    memcpy(&m_buf[m_back], &m_buf[pub], sizeof(bt_meta_store_t));
+
+    __atomic_store_n(&m_gen, m_buf[pub].gen, __ATOMIC_RELEASE);
+    __atomic_store_n(&m_truncated, m_buf[pub].truncated, __ATOMIC_RELEASE);
+    /* bumped after the snapshot is out, a cache keyed on it refetches rather than keeps stale text */
+    __atomic_add_fetch(&m_version, 1, __ATOMIC_RELEASE);
+}
+
+void bt_app_meta_new_track(void)
+{
+    bt_meta_store_t *s = &m_buf[m_back];
+
+    s->gen++;
+    s->truncated = 0;
+    for (int i = 0; i < BT_APP_META_NUM; i++) {
+        s->len[i] = 0;
+        s->text[i][0] = 0;
+    }
+    bt_meta_publish();
+}
+
+void bt_app_meta_set(bt_app_meta_attr_t attr, const uint8_t *text, uint32_t len)
+{
+    bt_meta_store_t *s = &m_buf[m_back];
+    bool cut = false;
+
+    if (attr >= BT_APP_META_NUM) {
+        return;
+    }
+    if (text == NULL) {
+        len = 0;
+    }
+    if (len > BT_APP_META_TEXT_LEN - 1) {
+        len = BT_APP_META_TEXT_LEN - 1;
+        /* do not cut a multi-byte character in half */
+        while (len > 0 && (text[len] & 0xC0) == 0x80) {
+            len--;
+        }
+        cut = true;
+    }
+
+    memcpy(s->text[attr], text, len);
+    s->text[attr][len] = 0;
+    s->len[attr] = len;
+    if (cut) {
+        s->truncated |= 1u << attr;
+    } else {
+        s->truncated &= ~(1u << attr);
+    }
+    bt_meta_publish();
+
+    /* s is the snapshot just published, the writer only reads it from here on */
+    ESP_LOGD(BT_META_TAG, "%s attr %d gen %u: %s%s", __func__, attr, s->gen, s->text[attr], cut ? "..." : "");
+}
+
+uint32_t bt_app_meta_get(bt_app_meta_attr_t attr, char *buf, uint32_t size, uint32_t *gen)
+{
+    if (attr >= BT_APP_META_NUM || size == 0) {
+        return 0;
+    }
+
+    /* take the latest snapshot if the writer published one since the last read */
+    if (__atomic_load_n(&m_mid, __ATOMIC_ACQUIRE) & BT_META_MID_NEW) {
+        m_front = __atomic_exchange_n(&m_mid, m_front, __ATOMIC_ACQ_REL) & BT_META_MID_INDEX;
+    }
+
+    const bt_meta_store_t *s = &m_buf[m_front];
+    uint32_t len = s->len[attr];
+    if (len > size - 1) {
+        len = size - 1;
+    }
+    memcpy(buf, s->text[attr], len);
+    buf[len] = 0;
+    if (gen) {
+        *gen = s->gen;
+    }
+    return len;
+}
+
+uint32_t bt_app_meta_generation(void)
+{
+    return __atomic_load_n(&m_gen, __ATOMIC_ACQUIRE);
+}
+
+uint32_t bt_app_meta_version(void)
+{
+    return __atomic_load_n(&m_version, __ATOMIC_ACQUIRE);
+}
+
+bool bt_app_meta_truncated(bt_app_meta_attr_t attr)
+{
+    return attr < BT_APP_META_NUM && (__atomic_load_n(&m_truncated, __ATOMIC_ACQUIRE) & (1u << attr));
+}
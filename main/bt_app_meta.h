@@ -0,0 +1,78 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef __BT_APP_META_H__
+#define __BT_APP_META_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BT_META_TAG                  "BT_META"
+
+/* storage per attribute including the terminating NUL */
+#define BT_APP_META_TEXT_LEN         (128)
+
+typedef enum {
+    BT_APP_META_TITLE = 0,
+    BT_APP_META_ARTIST,
+    BT_APP_META_ALBUM,
+    BT_APP_META_GENRE,
+    BT_APP_META_NUM,
+} bt_app_meta_attr_t;
+
+/**
+ * @brief     map an AVRCP metadata attribute id to a store slot, BT_APP_META_NUM if not stored
+ */
+bt_app_meta_attr_t bt_app_meta_attr_from_avrc(uint8_t attr_id);
+
+/**
+ * @brief     writer side: start a new track, clears all attributes and bumps the track generation
+ */
+void bt_app_meta_new_track(void);
+
+/**
+ * @brief     writer side: store an attribute, truncated on a UTF-8 character boundary
+ */
+void bt_app_meta_set(bt_app_meta_attr_t attr, const uint8_t *text, uint32_t len);
+
+/**
+ * @brief     reader side: copy an attribute from the latest published snapshot
+ *
+ * Never retries, spins or sleeps, and the copy is never torn. There is one reader, the
+ * iPod task; a second task calling this would share its snapshot buffer.
+ *
+ * @param     gen : if not NULL, receives the track generation the text belongs to
+ *
+ * @return    length of the copy without the NUL, which always fits in size - 1
+ */
+uint32_t bt_app_meta_get(bt_app_meta_attr_t attr, char *buf, uint32_t size, uint32_t *gen);
+
+/**
+ * @brief     track generation, incremented by bt_app_meta_new_track
+ */
+uint32_t bt_app_meta_generation(void);
+
+/**
+ * @brief     changes on every update of the store, for caches derived from it
+ */
+uint32_t bt_app_meta_version(void);
+
+/**
+ * @brief     true if the stored attribute was cut to fit BT_APP_META_TEXT_LEN
+ */
+bool bt_app_meta_truncated(bt_app_meta_attr_t attr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BT_APP_META_H__ */
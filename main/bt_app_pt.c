@@ -0,0 +1,224 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_avrc_api.h"
+#include "bt_app_core.h"
+#include "bt_app_clock.h"
+#include "bt_app_pt.h"
+
+/* transaction label of all passthrough commands */
+#define BT_PT_TL                     (14)
+
+#define BT_PT_KEY_NONE               (0xFF)
+
+/* dispatcher coalescing key of a repeated code */
+#define BT_PT_COALESCE(code)         (0x0400 | (code))
+
+/* iPod PlayControl codes, see IPOD_PLAY_CONTROL */
+enum {
+    BT_PT_TOGGLE_PLAY_PAUSE = 0x01,
+    BT_PT_STOP,
+    BT_PT_NEXT_TRACK,
+    BT_PT_PREVIOUS_TRACK,
+    BT_PT_START_FF,
+    BT_PT_START_REW,
+    BT_PT_END_FF_REW,
+    BT_PT_NEXT,
+    BT_PT_PREVIOUS,
+    BT_PT_PLAY,
+    BT_PT_PAUSE,
+    BT_PT_NEXT_CHAPTER,
+    BT_PT_PREVIOUS_CHAPTER,
+};
+
+typedef struct {
+    uint8_t              code;            /*!< iPod PlayControl code */
+    int64_t              t_us;            /*!< when the head unit asked */
+} bt_pt_req_t;
+
+/* press sent and not yet answered, per AVRCP key */
+typedef struct {
+    uint8_t              key;
+    uint8_t              code;
+    int64_t              t_us;
+} bt_pt_inflight_t;
+
+/* requested is bumped by the iPod thread, everything else is owned by BtAppT */
+static bt_app_pt_stats_t m_stats[BT_APP_PT_CODES];
+static bt_pt_inflight_t m_inflight[4] = {
+    [0 ... 3] = { .key = BT_PT_KEY_NONE },
+};
+static uint8_t m_held_key = BT_PT_KEY_NONE;
+
+static void bt_pt_hdl_evt(uint16_t event, void *p_param);
+
+/* AVRCP key for a PlayControl code, BT_PT_KEY_NONE if there is none */
+static uint8_t bt_pt_key(uint8_t code)
+{
+    switch (code) {
+    case BT_PT_TOGGLE_PLAY_PAUSE:
+        return bt_app_clock_state() == BT_APP_CLOCK_PLAYING ? ESP_AVRC_PT_CMD_PAUSE : ESP_AVRC_PT_CMD_PLAY;
+    case BT_PT_STOP:
+        return ESP_AVRC_PT_CMD_STOP;
+    case BT_PT_NEXT_TRACK:
+    case BT_PT_NEXT:
+    case BT_PT_NEXT_CHAPTER:
+        return ESP_AVRC_PT_CMD_FORWARD;
+    case BT_PT_PREVIOUS_TRACK:
+    case BT_PT_PREVIOUS:
+    case BT_PT_PREVIOUS_CHAPTER:
+        return ESP_AVRC_PT_CMD_BACKWARD;
+    case BT_PT_START_FF:
+        return ESP_AVRC_PT_CMD_FAST_FORWARD;
+    case BT_PT_START_REW:
+        return ESP_AVRC_PT_CMD_REWIND;
+    case BT_PT_PLAY:
+        return ESP_AVRC_PT_CMD_PLAY;
+    case BT_PT_PAUSE:
+        return ESP_AVRC_PT_CMD_PAUSE;
+    default:
+        return BT_PT_KEY_NONE;
+    }
+}
+
+static bool bt_pt_is_skip(uint8_t code)
+{
+    return code == BT_PT_NEXT_TRACK || code == BT_PT_PREVIOUS_TRACK;
+}
+
+bool bt_app_pt_play_control(uint8_t code)
+{
+    if (code >= BT_APP_PT_CODES || (code != BT_PT_END_FF_REW && bt_pt_key(code) == BT_PT_KEY_NONE)) {
+        return false;
+    }
+    __atomic_fetch_add(&m_stats[code].requested, 1, __ATOMIC_RELAXED);
+
+    bt_pt_req_t req = {
+        .code = code,
+        .t_us = esp_timer_get_time(),
+    };
+    /* the low lane never waits, a skip still queued absorbs the repeat */
+    return bt_app_work_post(bt_pt_hdl_evt, 0, &req, sizeof(req), NULL, BT_APP_LANE_LOW,
+                            bt_pt_is_skip(code) ? BT_PT_COALESCE(code) : BT_APP_COALESCE_NONE);
+}
+
+static bt_pt_inflight_t *bt_pt_inflight(uint8_t key)
+{
+    for (int i = 0; i < sizeof(m_inflight) / sizeof(m_inflight[0]); i++) {
+        if (m_inflight[i].key == key) {
+            return &m_inflight[i];
+        }
+    }
+    return NULL;
+}
+
+static void bt_pt_send(uint8_t key, uint8_t state, const bt_pt_req_t *req)
+{
+    if (esp_avrc_ct_send_passthrough_cmd(BT_PT_TL, key, state) != ESP_OK) {
+        ESP_LOGW(BT_PT_TAG, "%s key 0x%x state %d failed", __func__, key, state);
+        return;
+    }
+    if (state != ESP_AVRC_PT_CMD_STATE_PRESSED || req == NULL) {
+        return;
+    }
+
+    bt_pt_inflight_t *f = bt_pt_inflight(key);
+    if (f == NULL) {
+        f = bt_pt_inflight(BT_PT_KEY_NONE);
+    }
+    if (f == NULL) {
+        f = &m_inflight[0];
+    }
+    f->key = key;
+    f->code = req->code;
+    f->t_us = req->t_us;
+    m_stats[req->code].sent++;
+}
+
+static void bt_pt_release_held(void)
+{
+    if (m_held_key != BT_PT_KEY_NONE) {
+        bt_pt_send(m_held_key, ESP_AVRC_PT_CMD_STATE_RELEASED, NULL);
+        m_held_key = BT_PT_KEY_NONE;
+    }
+}
+
+static void bt_pt_hdl_evt(uint16_t event, void *p_param)
+{
+    bt_pt_req_t *req = (bt_pt_req_t *)p_param;
+    uint8_t key = bt_pt_key(req->code);
+
+    ESP_LOGD(BT_PT_TAG, "%s PlayControl 0x%02x -> key 0x%02x", __func__, req->code, key);
+
+    switch (req->code) {
+    case BT_PT_START_FF:
+    case BT_PT_START_REW:
+        /* held until END_FF_REW */
+        if (m_held_key != key) {
+            bt_pt_release_held();
+            bt_pt_send(key, ESP_AVRC_PT_CMD_STATE_PRESSED, req);
+            m_held_key = key;
+        }
+        break;
+    case BT_PT_END_FF_REW:
+        bt_pt_release_held();
+        break;
+    default: {
+        bt_pt_inflight_t *f = bt_pt_inflight(key);
+        if (bt_pt_is_skip(req->code) && f && f->code == req->code &&
+                req->t_us - f->t_us < BT_APP_PT_REPEAT_MS * 1000LL) {
+            /* the phone has not answered the last skip yet, this is the same press repeating */
+            break;
+        }
+        bt_pt_release_held();
+        bt_pt_send(key, ESP_AVRC_PT_CMD_STATE_PRESSED, req);
+        bt_pt_send(key, ESP_AVRC_PT_CMD_STATE_RELEASED, NULL);
+        break;
+    }
+    }
+}
+
+void bt_app_pt_response(uint8_t key_code, uint8_t key_state)
+{
+    if (key_state != ESP_AVRC_PT_CMD_STATE_PRESSED) {
+        return;
+    }
+
+    bt_pt_inflight_t *f = bt_pt_inflight(key_code);
+    if (f == NULL) {
+        return;
+    }
+
+    bt_app_pt_stats_t *s = &m_stats[f->code];
+    uint32_t dt = (uint32_t)(esp_timer_get_time() - f->t_us);
+    s->answered++;
+    s->us_last = dt;
+    if (dt > s->us_max) {
+        s->us_max = dt;
+    }
+    f->key = BT_PT_KEY_NONE;
+}
+
+void bt_app_pt_connected(bool connected)
+{
+    m_held_key = BT_PT_KEY_NONE;
+    for (int i = 0; i < sizeof(m_inflight) / sizeof(m_inflight[0]); i++) {
+        m_inflight[i].key = BT_PT_KEY_NONE;
+    }
+}
+
+void bt_app_pt_get_stats(uint8_t code, bt_app_pt_stats_t *stats)
+{
+    if (code < BT_APP_PT_CODES) {
+        *stats = m_stats[code];
+    }
+}
@@ -0,0 +1,61 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef __BT_APP_PT_H__
+#define __BT_APP_PT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BT_PT_TAG                    "BT_PT"
+
+/* iPod PlayControl codes 0x00 .. 0x0D */
+#define BT_APP_PT_CODES              (0x0E)
+
+/* a repeated track skip arriving this soon after an unanswered one is merged into it */
+#define BT_APP_PT_REPEAT_MS          (300)
+
+/**
+ * @brief     per PlayControl code counters
+ */
+typedef struct {
+    uint32_t             requested;       /*!< presses received from the head unit */
+    uint32_t             sent;            /*!< AVRCP passthrough commands sent, the rest were coalesced or dropped */
+    uint32_t             answered;        /*!< press responses from the phone */
+    uint32_t             us_last;         /*!< head unit press to AVRCP response, last */
+    uint32_t             us_max;          /*!< head unit press to AVRCP response, worst */
+} bt_app_pt_stats_t;
+
+/**
+ * @brief     forward an iPod PlayControl code to the phone, never blocks
+ *
+ * @return    false if the code has no AVRCP equivalent or the dispatcher queue is full
+ */
+bool bt_app_pt_play_control(uint8_t code);
+
+/**
+ * @brief     BtAppT side: an AVRCP passthrough response arrived
+ */
+void bt_app_pt_response(uint8_t key_code, uint8_t key_state);
+
+/**
+ * @brief     BtAppT side: controller connection changed, a held key is dropped on disconnect
+ */
+void bt_app_pt_connected(bool connected);
+
+void bt_app_pt_get_stats(uint8_t code, bt_app_pt_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BT_APP_PT_H__ */
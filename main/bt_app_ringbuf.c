@@ -0,0 +1,154 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "esp_heap_caps.h"
+#include "bt_app_ringbuf.h"
+
+/* keep everything aligned to one 16-bit stereo frame */
+#define BT_APP_RINGBUF_ALIGN(x)   ((x) & ~3u)
+
+static inline uint32_t bt_app_ringbuf_load(const volatile uint32_t *idx)
+{
+    return __atomic_load_n(idx, __ATOMIC_ACQUIRE);
+}
+
+static inline void bt_app_ringbuf_store(volatile uint32_t *idx, uint32_t val)
+{
+    __atomic_store_n(idx, val, __ATOMIC_RELEASE);
+}
+
+bool bt_app_ringbuf_init(bt_app_ringbuf_t *rb, uint32_t size, uint32_t caps)
+{
+    uint32_t cap = 4;
+    while (cap < size) {
+        cap <<= 1;
+    }
+
+    memset(rb, 0, sizeof(bt_app_ringbuf_t));
+    rb->storage = heap_caps_malloc(cap, caps);
+    if (rb->storage == NULL) {
+        return false;
+    }
+    rb->size = cap;
+    rb->mask = cap - 1;
+    bt_app_ringbuf_set_watermarks(rb, cap / 2, cap / 8);
+    return true;
+}
+
+void bt_app_ringbuf_deinit(bt_app_ringbuf_t *rb)
+{
+    if (rb->storage) {
+        heap_caps_free(rb->storage);
+    }
+    memset(rb, 0, sizeof(bt_app_ringbuf_t));
+}
+
+void bt_app_ringbuf_set_watermarks(bt_app_ringbuf_t *rb, uint32_t high, uint32_t low)
+{
+    if (high > rb->size) {
+        high = rb->size;
+    }
+    if (low > high) {
+        low = high;
+    }
+    rb->high_watermark = BT_APP_RINGBUF_ALIGN(high);
+    rb->low_watermark = BT_APP_RINGBUF_ALIGN(low);
+}
+
+uint32_t bt_app_ringbuf_fill(const bt_app_ringbuf_t *rb)
+{
+    return bt_app_ringbuf_load(&rb->head) - bt_app_ringbuf_load(&rb->tail);
+}
+
+uint32_t bt_app_ringbuf_free(const bt_app_ringbuf_t *rb)
+{
+    return rb->size - bt_app_ringbuf_fill(rb);
+}
+
+uint32_t bt_app_ringbuf_write(bt_app_ringbuf_t *rb, const uint8_t *data, uint32_t len)
+{
+    uint32_t head = rb->head;
+    uint32_t fill = head - bt_app_ringbuf_load(&rb->tail);
+    uint32_t space = BT_APP_RINGBUF_ALIGN(rb->size - fill);
+    /* whole frames only, so head stays aligned and the tail never peeks a partial frame */
+    uint32_t n = BT_APP_RINGBUF_ALIGN(len);
+
+    if (n > space) {
+        n = space;
+        rb->overflow_cnt++;
+        rb->overflow_bytes += len - n;
+    }
+
+    uint32_t off = head & rb->mask;
+    uint32_t first = rb->size - off;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(rb->storage + off, data, first);
+    memcpy(rb->storage, data + first, n - first);
+
+    bt_app_ringbuf_store(&rb->head, head + n);
+
+    if (fill + n > rb->peak_fill) {
+        rb->peak_fill = fill + n;
+    }
+    return n;
+}
+
+uint32_t bt_app_ringbuf_peek(bt_app_ringbuf_t *rb, uint8_t **ptr)
+{
+    uint32_t tail = rb->tail;
+    uint32_t fill = bt_app_ringbuf_load(&rb->head) - tail;
+    uint32_t off = tail & rb->mask;
+    uint32_t n = rb->size - off;
+
+    if (n > fill) {
+        n = fill;
+    }
+    *ptr = rb->storage + off;
+    return n;
+}
+
+void bt_app_ringbuf_consume(bt_app_ringbuf_t *rb, uint32_t len)
+{
+    uint32_t tail = rb->tail + len;
+    uint32_t fill = bt_app_ringbuf_load(&rb->head) - rb->tail;
+
+    bt_app_ringbuf_store(&rb->tail, tail);
+
+    if (fill >= rb->low_watermark && fill - len < rb->low_watermark) {
+        rb->low_water_cnt++;
+    }
+}
+
+uint32_t bt_app_ringbuf_read(bt_app_ringbuf_t *rb, uint8_t *data, uint32_t len)
+{
+    uint32_t done = 0;
+    while (done < len) {
+        uint8_t *src;
+        uint32_t n = bt_app_ringbuf_peek(rb, &src);
+        if (n == 0) {
+            break;
+        }
+        if (n > len - done) {
+            n = len - done;
+        }
+        memcpy(data + done, src, n);
+        bt_app_ringbuf_consume(rb, n);
+        done += n;
+    }
+    return done;
+}
+
+void bt_app_ringbuf_flush(bt_app_ringbuf_t *rb)
+{
+    bt_app_ringbuf_store(&rb->tail, bt_app_ringbuf_load(&rb->head));
+}
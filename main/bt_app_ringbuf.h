@@ -0,0 +1,89 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef __BT_APP_RINGBUF_H__
+#define __BT_APP_RINGBUF_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief     single-producer/single-consumer lock-free byte ring
+ *
+ * head is only advanced by the producer and tail only by the consumer, both as
+ * free-running 32-bit indices. Counters are owned by the side that updates them,
+ * so neither side ever takes a lock or blocks.
+ */
+typedef struct {
+    uint8_t              *storage;        /*!< ring storage, size bytes */
+    uint32_t             size;            /*!< capacity in bytes, power of two */
+    uint32_t             mask;            /*!< size - 1 */
+    volatile uint32_t    head;            /*!< write index, owned by producer */
+    volatile uint32_t    tail;            /*!< read index, owned by consumer */
+    uint32_t             high_watermark;  /*!< fill level to reach before playback (re)starts */
+    uint32_t             low_watermark;   /*!< fill level below which an underrun is imminent */
+    volatile uint32_t    peak_fill;       /*!< highest fill level seen by the producer */
+    volatile uint32_t    overflow_cnt;    /*!< writes truncated because the ring was full */
+    volatile uint32_t    overflow_bytes;  /*!< bytes dropped by truncated writes */
+    volatile uint32_t    underrun_cnt;    /*!< times the consumer found the ring empty */
+    volatile uint32_t    low_water_cnt;   /*!< times the fill level dropped below low_watermark */
+} bt_app_ringbuf_t;
+
+/**
+ * @brief     allocate ring storage, size is rounded up to a power of two
+ *
+ * @param     caps : heap capabilities, e.g. MALLOC_CAP_SPIRAM to place the ring in PSRAM
+ */
+bool bt_app_ringbuf_init(bt_app_ringbuf_t *rb, uint32_t size, uint32_t caps);
+
+void bt_app_ringbuf_deinit(bt_app_ringbuf_t *rb);
+
+/**
+ * @brief     set watermarks in bytes, both are rounded down to whole stereo frames
+ */
+void bt_app_ringbuf_set_watermarks(bt_app_ringbuf_t *rb, uint32_t high, uint32_t low);
+
+/**
+ * @brief     producer side: copy in as much of data as fits, in whole stereo frames, never blocks
+ *
+ * @return    number of bytes written, a multiple of 4; what did not fit is dropped and counted as overflow
+ */
+uint32_t bt_app_ringbuf_write(bt_app_ringbuf_t *rb, const uint8_t *data, uint32_t len);
+
+/**
+ * @brief     consumer side: copy out up to len bytes
+ */
+uint32_t bt_app_ringbuf_read(bt_app_ringbuf_t *rb, uint8_t *data, uint32_t len);
+
+/**
+ * @brief     consumer side: get a pointer to the contiguous readable region
+ *
+ * @return    number of contiguous bytes at *ptr, release them with bt_app_ringbuf_consume
+ */
+uint32_t bt_app_ringbuf_peek(bt_app_ringbuf_t *rb, uint8_t **ptr);
+
+void bt_app_ringbuf_consume(bt_app_ringbuf_t *rb, uint32_t len);
+
+/**
+ * @brief     consumer side: discard everything queued so far
+ */
+void bt_app_ringbuf_flush(bt_app_ringbuf_t *rb);
+
+uint32_t bt_app_ringbuf_fill(const bt_app_ringbuf_t *rb);
+
+uint32_t bt_app_ringbuf_free(const bt_app_ringbuf_t *rb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BT_APP_RINGBUF_H__ */
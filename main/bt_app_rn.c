@@ -0,0 +1,232 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "bt_app_meta.h"
+#include "bt_app_clock.h"
+#include "bt_app_rn.h"
+
+/* transaction labels, registrations use the event id so each stays distinct */
+#define BT_RN_TL_METADATA            (0)
+#define BT_RN_TL_CAPS                (15)
+
+#define BT_RN_BIT(evt)               (1u << (evt))
+
+/* events the sink follows when the phone supports them */
+#define BT_RN_WANTED                 (BT_RN_BIT(ESP_AVRC_RN_PLAY_STATUS_CHANGE) | BT_RN_BIT(ESP_AVRC_RN_TRACK_CHANGE) | \
+                                      BT_RN_BIT(ESP_AVRC_RN_PLAY_POS_CHANGED) | BT_RN_BIT(ESP_AVRC_RN_BATTERY_STATUS_CHANGE))
+
+/* registered without a capability list, every AVRCP 1.3 target has these */
+#define BT_RN_MANDATORY              (BT_RN_BIT(ESP_AVRC_RN_PLAY_STATUS_CHANGE) | BT_RN_BIT(ESP_AVRC_RN_TRACK_CHANGE))
+
+/* all state is owned by the BtAppT task */
+static bool m_connected = false;
+static uint8_t m_md_pending = 0;
+static uint32_t m_md_gen = 0;
+static bool m_md_again = false;
+static int64_t m_md_req_us = 0;
+static int64_t m_track_us = 0;
+static uint8_t m_battery = ESP_AVRC_BATT_NORMAL;
+static bt_app_rn_stats_t m_stats;
+
+static void bt_rn_register(uint8_t event_id)
+{
+    uint32_t param = (event_id == ESP_AVRC_RN_PLAY_POS_CHANGED) ? BT_APP_RN_PLAY_POS_INTERVAL_S : 0;
+
+    if (esp_avrc_ct_send_register_notification_cmd(event_id, event_id, param) == ESP_OK) {
+        m_stats.armed |= BT_RN_BIT(event_id);
+    }
+}
+
+static void bt_rn_register_all(uint16_t events)
+{
+    for (uint8_t evt = ESP_AVRC_RN_PLAY_STATUS_CHANGE; evt < ESP_AVRC_RN_MAX_EVT; evt++) {
+        if (events & BT_RN_BIT(evt)) {
+            bt_rn_register(evt);
+        }
+    }
+}
+
+static void bt_rn_send_metadata(void)
+{
+    if (esp_avrc_ct_send_metadata_cmd(BT_RN_TL_METADATA, BT_APP_RN_MD_ATTRS) != ESP_OK) {
+        return;
+    }
+    /* responses carry no label, so the request is tagged with the track it was sent for */
+    m_md_pending = BT_APP_RN_MD_ATTRS;
+    m_md_gen = bt_app_meta_generation();
+    m_md_again = false;
+    m_md_req_us = esp_timer_get_time();
+    m_stats.md_req_cnt++;
+}
+
+static bool bt_rn_md_expired(void)
+{
+    if (esp_timer_get_time() - m_md_req_us < BT_APP_RN_MD_TIMEOUT_MS * 1000LL) {
+        return false;
+    }
+    m_stats.md_timeout_cnt++;
+    ESP_LOGW(BT_RN_TAG, "%s attributes 0x%x never arrived", __func__, m_md_pending);
+    return true;
+}
+
+void bt_app_rn_request_metadata(void)
+{
+    if (!m_connected) {
+        return;
+    }
+
+    if (m_md_pending && !bt_rn_md_expired()) {
+        /* the answer in flight is stale by now, ask once more when it completes */
+        m_md_again = true;
+        m_stats.md_coalesced++;
+        return;
+    }
+    bt_rn_send_metadata();
+}
+
+static void bt_rn_new_track(void)
+{
+    bt_app_meta_new_track();
+    bt_app_clock_new_track();
+    m_track_us = esp_timer_get_time();
+    bt_app_rn_request_metadata();
+}
+
+void bt_app_rn_connected(bool connected)
+{
+    m_connected = connected;
+    m_md_pending = 0;
+    m_md_again = false;
+    m_stats.supported = 0;
+    m_stats.armed = 0;
+
+    if (connected) {
+        bt_rn_new_track();
+    }
+}
+
+void bt_app_rn_remote_features(uint32_t feat_mask)
+{
+    /* phones that do not report the target role or cannot list capabilities still have the mandatory events */
+    if (!(feat_mask & ESP_AVRC_FEAT_RCTG) || esp_avrc_ct_send_get_rn_capabilities_cmd(BT_RN_TL_CAPS) != ESP_OK) {
+        m_stats.supported = BT_RN_MANDATORY;
+        bt_rn_register_all(BT_RN_MANDATORY & ~m_stats.armed);
+    }
+}
+
+void bt_app_rn_capabilities(const esp_avrc_rn_evt_cap_mask_t *evt_set)
+{
+    m_stats.supported = evt_set->bits;
+    ESP_LOGI(BT_RN_TAG, "phone notifies events 0x%04x, following 0x%04x", evt_set->bits, evt_set->bits & BT_RN_WANTED);
+    bt_rn_register_all(evt_set->bits & BT_RN_WANTED & ~m_stats.armed);
+}
+
+static void bt_rn_play_status(esp_avrc_playback_stat_t playback)
+{
+    switch (playback) {
+    case ESP_AVRC_PLAYBACK_PLAYING:
+    case ESP_AVRC_PLAYBACK_FWD_SEEK:
+    case ESP_AVRC_PLAYBACK_REV_SEEK:
+        bt_app_clock_set_state(BT_APP_CLOCK_PLAYING);
+        break;
+    case ESP_AVRC_PLAYBACK_PAUSED:
+        bt_app_clock_set_state(BT_APP_CLOCK_PAUSED);
+        break;
+    default:
+        bt_app_clock_set_state(BT_APP_CLOCK_STOPPED);
+        break;
+    }
+}
+
+void bt_app_rn_notify(uint8_t event_id, esp_avrc_rn_param_t *param)
+{
+    m_stats.notify_cnt++;
+    /* a superseded request missing attributes would hold back the one for the current track */
+    if (m_md_again && m_connected && bt_rn_md_expired()) {
+        bt_rn_send_metadata();
+    }
+    if (event_id < ESP_AVRC_RN_MAX_EVT) {
+        /* a notification is one-shot, the registration is consumed */
+        m_stats.armed &= ~BT_RN_BIT(event_id);
+    }
+
+    switch (event_id) {
+    case ESP_AVRC_RN_TRACK_CHANGE:
+        bt_rn_new_track();
+        break;
+    case ESP_AVRC_RN_PLAY_POS_CHANGED:
+        bt_app_clock_sync(param->play_pos);
+        break;
+    case ESP_AVRC_RN_PLAY_STATUS_CHANGE:
+        bt_rn_play_status(param->playback);
+        break;
+    case ESP_AVRC_RN_BATTERY_STATUS_CHANGE:
+        m_battery = param->batt;
+        ESP_LOGI(BT_RN_TAG, "phone battery status %d", m_battery);
+        break;
+    default:
+        ESP_LOGD(BT_RN_TAG, "%s unhandled event %d", __func__, event_id);
+        return;
+    }
+
+    if (m_connected) {
+        bt_rn_register(event_id);
+    }
+}
+
+void bt_app_rn_metadata(uint8_t attr_id, const uint8_t *text, int len)
+{
+    /* the answer to a request sent before the last track change describes the previous track */
+    bool current = m_md_pending && m_md_gen == bt_app_meta_generation();
+
+    if (current) {
+        bt_app_meta_set(bt_app_meta_attr_from_avrc(attr_id), text, len);
+        if (attr_id == ESP_AVRC_MD_ATTR_PLAYING_TIME) {
+            bt_app_clock_set_length(strtoul((const char *)text, NULL, 10));
+        }
+    } else {
+        m_stats.md_dropped++;
+        ESP_LOGD(BT_RN_TAG, "%s attribute 0x%x of a superseded request dropped", __func__, attr_id);
+    }
+
+    if (!(m_md_pending & attr_id)) {
+        return;
+    }
+    m_md_pending &= ~attr_id;
+    if (m_md_pending) {
+        return;
+    }
+
+    if (current && m_track_us) {
+        uint32_t dt = (uint32_t)(esp_timer_get_time() - m_track_us);
+        m_stats.track_us_last = dt;
+        if (dt > m_stats.track_us_max) {
+            m_stats.track_us_max = dt;
+        }
+        m_track_us = 0;
+        ESP_LOGI(BT_RN_TAG, "track metadata complete %u us after the change", dt);
+    }
+    if (m_md_again) {
+        bt_rn_send_metadata();
+    }
+}
+
+uint8_t bt_app_rn_battery(void)
+{
+    return m_battery;
+}
+
+void bt_app_rn_get_stats(bt_app_rn_stats_t *stats)
+{
+    *stats = m_stats;
+}
@@ -0,0 +1,94 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef __BT_APP_RN_H__
+#define __BT_APP_RN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_avrc_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BT_RN_TAG                    "BT_RN"
+
+/* all metadata attributes requested in one command per track */
+#define BT_APP_RN_MD_ATTRS           (ESP_AVRC_MD_ATTR_TITLE | ESP_AVRC_MD_ATTR_ARTIST | ESP_AVRC_MD_ATTR_ALBUM | \
+                                      ESP_AVRC_MD_ATTR_GENRE | ESP_AVRC_MD_ATTR_PLAYING_TIME)
+
+/* a metadata request with attributes still missing after this long is given up */
+#define BT_APP_RN_MD_TIMEOUT_MS      (2000)
+
+/* seconds between play position reports requested from the phone */
+#define BT_APP_RN_PLAY_POS_INTERVAL_S    (1)
+
+/**
+ * @brief     notification manager counters
+ */
+typedef struct {
+    uint16_t             supported;       /*!< bit per event id the phone can notify */
+    uint16_t             armed;           /*!< bit per event id currently registered */
+    uint32_t             notify_cnt;      /*!< change notifications received */
+    uint32_t             md_req_cnt;      /*!< metadata commands sent */
+    uint32_t             md_coalesced;    /*!< metadata requests folded into one already in flight */
+    uint32_t             md_timeout_cnt;  /*!< metadata requests that never completed */
+    uint32_t             md_dropped;      /*!< attributes dropped, their request predates the track */
+    uint32_t             track_us_last;   /*!< track change notification to the last attribute stored */
+    uint32_t             track_us_max;    /*!< track change to complete metadata, worst */
+} bt_app_rn_stats_t;
+
+/**
+ * @brief     controller connection changed, on connect the current track metadata is fetched
+ */
+void bt_app_rn_connected(bool connected);
+
+/**
+ * @brief     remote features are known, asks a target for the events it can notify
+ *
+ * Without the target feature bit, or if the capability query cannot be sent, only the
+ * mandatory play status and track change events are registered.
+ */
+void bt_app_rn_remote_features(uint32_t feat_mask);
+
+/**
+ * @brief     register every supported event the sink follows
+ */
+void bt_app_rn_capabilities(const esp_avrc_rn_evt_cap_mask_t *evt_set);
+
+/**
+ * @brief     handle a change notification and re-arm it
+ */
+void bt_app_rn_notify(uint8_t event_id, esp_avrc_rn_param_t *param);
+
+/**
+ * @brief     store one metadata attribute of the outstanding request
+ *
+ * Attributes answering a request made before the last track change, or arriving with no
+ * request outstanding, are dropped so the old title never lands in the new track.
+ */
+void bt_app_rn_metadata(uint8_t attr_id, const uint8_t *text, int len);
+
+/**
+ * @brief     fetch all metadata attributes, coalesced with a request already in flight
+ */
+void bt_app_rn_request_metadata(void);
+
+/**
+ * @brief     last battery status reported by the phone, ESP_AVRC_BATT_NORMAL before any report
+ */
+uint8_t bt_app_rn_battery(void);
+
+void bt_app_rn_get_stats(bt_app_rn_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BT_APP_RN_H__ */
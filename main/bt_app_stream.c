@@ -0,0 +1,136 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "bt_app_stream.h"
+
+/* RTP header plus SBC media payload header */
+#define BT_APP_STREAM_PKT_OVERHEAD   (13)
+/* the SBC media payload header counts frames in 4 bits */
+#define BT_APP_STREAM_MAX_FRAMES     (15)
+
+static void bt_app_stream_update_sizes(bt_app_stream_desc_t *desc)
+{
+    uint32_t nsb = desc->subbands;
+    uint32_t nblk = desc->block_len;
+    uint32_t nch = desc->channels;
+    uint32_t bitpool = desc->max_bitpool;
+    uint32_t len = 4 + (4 * nsb * nch) / 8;
+
+    switch (desc->channel_mode) {
+    case BT_APP_SBC_CH_MODE_MONO:
+    case BT_APP_SBC_CH_MODE_DUAL:
+        len += (nblk * nch * bitpool + 7) / 8;
+        break;
+    case BT_APP_SBC_CH_MODE_STEREO:
+        len += (nblk * bitpool + 7) / 8;
+        break;
+    case BT_APP_SBC_CH_MODE_JOINT:
+        len += (nsb + nblk * bitpool + 7) / 8;
+        break;
+    }
+
+    desc->frame_len = len;
+    desc->bitrate = 8 * len * desc->sample_rate / (nsb * nblk);
+
+    uint32_t frames = (BT_APP_STREAM_MEDIA_MTU - BT_APP_STREAM_PKT_OVERHEAD) / len;
+    if (frames > BT_APP_STREAM_MAX_FRAMES) {
+        frames = BT_APP_STREAM_MAX_FRAMES;
+    } else if (frames == 0) {
+        frames = 1;
+    }
+    desc->burst_frames = frames * nsb * nblk;
+}
+
+void bt_app_stream_default(bt_app_stream_desc_t *desc, uint32_t sample_rate)
+{
+    memset(desc, 0, sizeof(bt_app_stream_desc_t));
+    desc->sample_rate = sample_rate;
+    desc->channel_mode = BT_APP_SBC_CH_MODE_JOINT;
+    desc->channels = 2;
+    desc->block_len = 16;
+    desc->subbands = 8;
+    desc->alloc_method = BT_APP_SBC_ALLOC_LOUDNESS;
+    desc->min_bitpool = 2;
+    desc->max_bitpool = 53;
+    bt_app_stream_update_sizes(desc);
+}
+
+bool bt_app_stream_parse_sbc(const uint8_t *cie, bt_app_stream_desc_t *desc)
+{
+    bool valid = true;
+    uint8_t oct0 = cie[0];
+    uint8_t oct1 = cie[1];
+
+    bt_app_stream_default(desc, 16000);
+
+    if (oct0 & (0x01 << 7)) {
+        desc->sample_rate = 16000;
+    } else if (oct0 & (0x01 << 6)) {
+        desc->sample_rate = 32000;
+    } else if (oct0 & (0x01 << 5)) {
+        desc->sample_rate = 44100;
+    } else if (oct0 & (0x01 << 4)) {
+        desc->sample_rate = 48000;
+    } else {
+        valid = false;
+    }
+
+    if (oct0 & (0x01 << 3)) {
+        desc->channel_mode = BT_APP_SBC_CH_MODE_MONO;
+    } else if (oct0 & (0x01 << 2)) {
+        desc->channel_mode = BT_APP_SBC_CH_MODE_DUAL;
+    } else if (oct0 & (0x01 << 1)) {
+        desc->channel_mode = BT_APP_SBC_CH_MODE_STEREO;
+    } else if (oct0 & (0x01 << 0)) {
+        desc->channel_mode = BT_APP_SBC_CH_MODE_JOINT;
+    } else {
+        valid = false;
+    }
+    desc->channels = (desc->channel_mode == BT_APP_SBC_CH_MODE_MONO) ? 1 : 2;
+
+    if (oct1 & (0x01 << 7)) {
+        desc->block_len = 4;
+    } else if (oct1 & (0x01 << 6)) {
+        desc->block_len = 8;
+    } else if (oct1 & (0x01 << 5)) {
+        desc->block_len = 12;
+    } else if (oct1 & (0x01 << 4)) {
+        desc->block_len = 16;
+    } else {
+        valid = false;
+    }
+
+    if (oct1 & (0x01 << 3)) {
+        desc->subbands = 4;
+    } else if (oct1 & (0x01 << 2)) {
+        desc->subbands = 8;
+    } else {
+        valid = false;
+    }
+
+    if (oct1 & (0x01 << 1)) {
+        desc->alloc_method = BT_APP_SBC_ALLOC_SNR;
+    } else if (oct1 & (0x01 << 0)) {
+        desc->alloc_method = BT_APP_SBC_ALLOC_LOUDNESS;
+    } else {
+        valid = false;
+    }
+
+    if (cie[2] >= 2 && cie[3] >= cie[2]) {
+        desc->min_bitpool = cie[2];
+        desc->max_bitpool = cie[3];
+    } else {
+        valid = false;
+    }
+
+    bt_app_stream_update_sizes(desc);
+    return valid;
+}
@@ -0,0 +1,67 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef __BT_APP_STREAM_H__
+#define __BT_APP_STREAM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* largest A2DP media payload assumed when sizing buffers, a common Android L2CAP MTU */
+#define BT_APP_STREAM_MEDIA_MTU      (1008)
+
+typedef enum {
+    BT_APP_SBC_CH_MODE_MONO = 0,
+    BT_APP_SBC_CH_MODE_DUAL,
+    BT_APP_SBC_CH_MODE_STEREO,
+    BT_APP_SBC_CH_MODE_JOINT,
+} bt_app_sbc_ch_mode_t;
+
+typedef enum {
+    BT_APP_SBC_ALLOC_LOUDNESS = 0,
+    BT_APP_SBC_ALLOC_SNR,
+} bt_app_sbc_alloc_t;
+
+/**
+ * @brief     negotiated A2DP stream parameters, decoded from the SBC codec info element
+ */
+typedef struct {
+    uint32_t             sample_rate;     /*!< Hz */
+    bt_app_sbc_ch_mode_t channel_mode;
+    uint8_t              channels;        /*!< 1 for mono, 2 otherwise */
+    uint8_t              block_len;       /*!< 4, 8, 12 or 16 */
+    uint8_t              subbands;        /*!< 4 or 8 */
+    bt_app_sbc_alloc_t   alloc_method;
+    uint8_t              min_bitpool;
+    uint8_t              max_bitpool;
+    uint16_t             frame_len;       /*!< SBC frame bytes at max bitpool */
+    uint32_t             bitrate;         /*!< bits per second at max bitpool */
+    uint32_t             burst_frames;    /*!< PCM frames decoded from one full media packet */
+} bt_app_stream_desc_t;
+
+/**
+ * @brief     fill desc from cie.sbc[0..3] of ESP_A2D_AUDIO_CFG_EVT
+ *
+ * @return    false if an octet has no valid selection, that field then keeps its default
+ */
+bool bt_app_stream_parse_sbc(const uint8_t *cie, bt_app_stream_desc_t *desc);
+
+/**
+ * @brief     descriptor for a plain 16-bit stereo stream at sample_rate
+ */
+void bt_app_stream_default(bt_app_stream_desc_t *desc, uint32_t sample_rate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BT_APP_STREAM_H__ */
@@ -0,0 +1,88 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <math.h>
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "bt_app_volume.h"
+
+#define BT_VOL_GAIN_UNITY            (32768)
+
+/* Q15 gain for every AVRCP volume step, linear in dB down to the configured range, 0 mutes */
+static int32_t m_gain_table[BT_APP_VOLUME_MAX + 1];
+
+static volatile uint8_t m_volume = BT_APP_VOLUME_MAX;
+
+/* writer task owned */
+static int32_t m_gain = BT_VOL_GAIN_UNITY;
+
+void bt_app_volume_init(void)
+{
+    m_gain_table[0] = 0;
+    for (int v = 1; v <= BT_APP_VOLUME_MAX; v++) {
+        float db = -(float)CONFIG_A2DP_SINK_VOLUME_RANGE_DB * (BT_APP_VOLUME_MAX - v) / BT_APP_VOLUME_MAX;
+        m_gain_table[v] = (int32_t)lrintf(powf(10.0f, db / 20.0f) * BT_VOL_GAIN_UNITY);
+    }
+    m_gain = m_gain_table[m_volume];
+}
+
+void bt_app_volume_set(uint8_t volume)
+{
+    if (volume > BT_APP_VOLUME_MAX) {
+        volume = BT_APP_VOLUME_MAX;
+    }
+    __atomic_store_n(&m_volume, volume, __ATOMIC_RELAXED);
+}
+
+uint8_t bt_app_volume_get(void)
+{
+    return __atomic_load_n(&m_volume, __ATOMIC_RELAXED);
+}
+
+/* per-sample increment that lands on the target at the end of the block */
+static int32_t bt_vol_step(int32_t target, uint32_t frames)
+{
+    return frames ? (target - m_gain) / (int32_t)frames : 0;
+}
+
+void bt_app_volume_process16(int16_t *pcm, uint32_t frames)
+{
+    int32_t target = m_gain_table[bt_app_volume_get()];
+    int32_t step = bt_vol_step(target, frames);
+    int32_t g = m_gain;
+
+    if (g == target && g == BT_VOL_GAIN_UNITY) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < frames; i++) {
+        g += step;
+        pcm[0] = (int16_t)((pcm[0] * g) >> 15);
+        pcm[1] = (int16_t)((pcm[1] * g) >> 15);
+        pcm += 2;
+    }
+    m_gain = target;
+}
+
+void bt_app_volume_process32(const int16_t *in, int32_t *out, uint32_t frames)
+{
+    int32_t target = m_gain_table[bt_app_volume_get()];
+    int32_t step = bt_vol_step(target, frames);
+    int32_t g = m_gain;
+
+    for (uint32_t i = 0; i < frames; i++) {
+        g += step;
+        /* 16 x Q15 leaves the product in the top 31 bits */
+        out[0] = (in[0] * g) << 1;
+        out[1] = (in[1] * g) << 1;
+        in += 2;
+        out += 2;
+    }
+    m_gain = target;
+}
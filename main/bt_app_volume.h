@@ -0,0 +1,50 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#ifndef __BT_APP_VOLUME_H__
+#define __BT_APP_VOLUME_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BT_VOL_TAG                   "BT_VOL"
+
+/* AVRCP absolute volume range */
+#define BT_APP_VOLUME_MAX            (127)
+
+/**
+ * @brief     build the gain table, volume starts at BT_APP_VOLUME_MAX
+ */
+void bt_app_volume_init(void);
+
+/**
+ * @brief     set the AVRCP absolute volume 0..127, safe from any task
+ */
+void bt_app_volume_set(uint8_t volume);
+
+uint8_t bt_app_volume_get(void);
+
+/**
+ * @brief     apply the volume in place, ramping linearly across the block to a new setting
+ */
+void bt_app_volume_process16(int16_t *pcm, uint32_t frames);
+
+/**
+ * @brief     apply the volume while widening to 32-bit I2S samples, keeping the bits
+ *            attenuation would otherwise shift out
+ */
+void bt_app_volume_process32(const int16_t *in, int32_t *out, uint32_t frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BT_APP_VOLUME_H__ */
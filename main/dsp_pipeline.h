@@ -0,0 +1,487 @@
+#ifndef _DSP_PIPELINE_H_
+#define _DSP_PIPELINE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <cmath>
+#include <type_traits>
+
+// Fixed-point DSP stages for interleaved 16-bit stereo, processed in place.
+//
+// Every stage provides
+//   void process(int16_t* pcm, uint32_t frames);
+//   void reset();
+//   static const char* name();
+// and DspPipeline<Stages...> chains them at compile time, so the whole chain
+// inlines into one function with no virtual calls and no allocation.
+
+static inline int16_t dsp_sat16(int32_t v)
+{
+    if (v > INT16_MAX)
+        return INT16_MAX;
+    if (v < INT16_MIN)
+        return INT16_MIN;
+    return (int16_t)v;
+}
+
+// Q15 gain, 32768 is unity, up to 4x (+12 dB)
+class DspGain
+{
+public:
+    static const int32_t UNITY = 32768;
+    static const int32_t MAX = 4 * UNITY;
+
+    DspGain(): _gain(UNITY) {}
+
+    static const char* name() { return "gain"; }
+
+    void reset() {}
+
+    void setGain(int32_t q15)
+    {
+        _gain = q15 < 0 ? 0 : (q15 > MAX ? MAX : q15);
+    }
+
+    void setGainDb(float db)
+    {
+        setGain((int32_t)lrintf(powf(10.0f, db / 20.0f) * UNITY));
+    }
+
+    int32_t gain() const { return _gain; }
+
+    void process(int16_t* pcm, uint32_t frames)
+    {
+        if (_gain == UNITY)
+            return;
+
+        // above 2x a full-scale sample times the gain no longer fits 32 bits
+        const int64_t g = _gain;
+        for (uint32_t i = 0; i < frames * 2; ++i)
+            pcm[i] = dsp_sat16((int32_t)((pcm[i] * g) >> 15));
+    }
+
+private:
+    int32_t _gain;
+};
+
+// 2x2 channel matrix in Q14, out_l = ll*l + lr*r, out_r = rl*l + rr*r
+class DspMix
+{
+public:
+    static const int32_t UNITY = 16384;
+
+    DspMix() { setStereo(); }
+
+    static const char* name() { return "mix"; }
+
+    void reset() {}
+
+    void setMatrix(int32_t ll, int32_t lr, int32_t rl, int32_t rr)
+    {
+        _ll = ll;
+        _lr = lr;
+        _rl = rl;
+        _rr = rr;
+        _identity = (ll == UNITY && lr == 0 && rl == 0 && rr == UNITY);
+    }
+
+    void setStereo() { setMatrix(UNITY, 0, 0, UNITY); }
+    void setSwap() { setMatrix(0, UNITY, UNITY, 0); }
+    void setMono() { setMatrix(UNITY / 2, UNITY / 2, UNITY / 2, UNITY / 2); }
+
+    void process(int16_t* pcm, uint32_t frames)
+    {
+        if (_identity)
+            return;
+
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            int32_t l = pcm[0];
+            int32_t r = pcm[1];
+            pcm[0] = dsp_sat16((_ll * l + _lr * r) >> 14);
+            pcm[1] = dsp_sat16((_rl * l + _rr * r) >> 14);
+            pcm += 2;
+        }
+    }
+
+private:
+    int32_t _ll, _lr, _rl, _rr;
+    bool _identity;
+};
+
+// Biquad coefficients in Q2.29, y = b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2
+struct DspBiquadCoeffs
+{
+    static const int SHIFT = 29;
+
+    int32_t b0, b1, b2, a1, a2;
+
+    bool isFlat() const
+    {
+        return b0 == (1 << SHIFT) && b1 == 0 && b2 == 0 && a1 == 0 && a2 == 0;
+    }
+
+    static DspBiquadCoeffs flat()
+    {
+        DspBiquadCoeffs c = { 1 << SHIFT, 0, 0, 0, 0 };
+        return c;
+    }
+
+    // RBJ audio EQ cookbook designs, evaluated in float off the audio path
+    static DspBiquadCoeffs peaking(float fs, float f0, float q, float gainDb)
+    {
+        float a = powf(10.0f, gainDb / 40.0f);
+        float w0 = 2.0f * (float)M_PI * f0 / fs;
+        float alpha = sinf(w0) / (2.0f * q);
+        float cw = cosf(w0);
+
+        return normalize(1.0f + alpha * a, -2.0f * cw, 1.0f - alpha * a,
+                         1.0f + alpha / a, -2.0f * cw, 1.0f - alpha / a);
+    }
+
+    static DspBiquadCoeffs lowShelf(float fs, float f0, float q, float gainDb)
+    {
+        float a = powf(10.0f, gainDb / 40.0f);
+        float w0 = 2.0f * (float)M_PI * f0 / fs;
+        float alpha = sinf(w0) / (2.0f * q);
+        float cw = cosf(w0);
+        float sa = 2.0f * sqrtf(a) * alpha;
+
+        return normalize(a * ((a + 1.0f) - (a - 1.0f) * cw + sa),
+                         2.0f * a * ((a - 1.0f) - (a + 1.0f) * cw),
+                         a * ((a + 1.0f) - (a - 1.0f) * cw - sa),
+                         (a + 1.0f) + (a - 1.0f) * cw + sa,
+                         -2.0f * ((a - 1.0f) + (a + 1.0f) * cw),
+                         (a + 1.0f) + (a - 1.0f) * cw - sa);
+    }
+
+    static DspBiquadCoeffs highShelf(float fs, float f0, float q, float gainDb)
+    {
+        float a = powf(10.0f, gainDb / 40.0f);
+        float w0 = 2.0f * (float)M_PI * f0 / fs;
+        float alpha = sinf(w0) / (2.0f * q);
+        float cw = cosf(w0);
+        float sa = 2.0f * sqrtf(a) * alpha;
+
+        return normalize(a * ((a + 1.0f) + (a - 1.0f) * cw + sa),
+                         -2.0f * a * ((a - 1.0f) + (a + 1.0f) * cw),
+                         a * ((a + 1.0f) + (a - 1.0f) * cw - sa),
+                         (a + 1.0f) - (a - 1.0f) * cw + sa,
+                         2.0f * ((a - 1.0f) - (a + 1.0f) * cw),
+                         (a + 1.0f) - (a - 1.0f) * cw - sa);
+    }
+
+private:
+    static int32_t toFixed(float v)
+    {
+        return (int32_t)lrintf(v * (float)(1 << SHIFT));
+    }
+
+    static DspBiquadCoeffs normalize(float b0, float b1, float b2, float a0, float a1, float a2)
+    {
+        DspBiquadCoeffs c = {
+            toFixed(b0 / a0), toFixed(b1 / a0), toFixed(b2 / a0),
+            toFixed(a1 / a0), toFixed(a2 / a0)
+        };
+        return c;
+    }
+};
+
+// Direct form I biquad with error feedback, so low-frequency sections keep
+// their precision with 16-bit state
+class DspBiquad
+{
+public:
+    DspBiquad(): _c(DspBiquadCoeffs::flat()) { reset(); }
+
+    static const char* name() { return "biquad"; }
+
+    void reset()
+    {
+        for (int ch = 0; ch < 2; ++ch)
+        {
+            _s[ch].x1 = _s[ch].x2 = 0;
+            _s[ch].y1 = _s[ch].y2 = 0;
+            _s[ch].err = 0;
+        }
+    }
+
+    void setCoeffs(const DspBiquadCoeffs& c) { _c = c; }
+    const DspBiquadCoeffs& coeffs() const { return _c; }
+
+    void process(int16_t* pcm, uint32_t frames)
+    {
+        if (_c.isFlat())
+            return;
+
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            pcm[0] = step(_s[0], pcm[0]);
+            pcm[1] = step(_s[1], pcm[1]);
+            pcm += 2;
+        }
+    }
+
+private:
+    struct State
+    {
+        int32_t x1, x2, y1, y2;
+        int32_t err;
+    };
+
+    inline int16_t step(State& s, int32_t x)
+    {
+        int64_t acc = (int64_t)_c.b0 * x + (int64_t)_c.b1 * s.x1 + (int64_t)_c.b2 * s.x2
+                    - (int64_t)_c.a1 * s.y1 - (int64_t)_c.a2 * s.y2 + s.err;
+        int32_t y = (int32_t)(acc >> DspBiquadCoeffs::SHIFT);
+
+        s.err = (int32_t)(acc - ((int64_t)y << DspBiquadCoeffs::SHIFT));
+        s.x2 = s.x1;
+        s.x1 = x;
+        s.y2 = s.y1;
+        s.y1 = dsp_sat16(y);
+        return (int16_t)s.y1;
+    }
+
+    DspBiquadCoeffs _c;
+    State _s[2];
+};
+
+// N biquads in series. A new set of coefficients is reached by linear
+// interpolation, updated every SUB_FRAMES frames, so switching is click-free.
+// Flat sections are skipped outside of a ramp.
+template <size_t N>
+class DspBiquadCascade
+{
+public:
+    static const uint32_t SUB_FRAMES = 32;
+
+    DspBiquadCascade(): _rampPos(0), _rampSteps(0)
+    {
+        for (size_t i = 0; i < N; ++i)
+            _start[i] = _target[i] = DspBiquadCoeffs::flat();
+    }
+
+    static const char* name() { return "eq"; }
+
+    void reset()
+    {
+        for (size_t i = 0; i < N; ++i)
+        {
+            _sec[i].setCoeffs(_target[i]);
+            _sec[i].reset();
+        }
+        _rampPos = _rampSteps = 0;
+    }
+
+    // start moving from the current coefficients to c[0..N-1] over rampFrames
+    void setTarget(const DspBiquadCoeffs* c, uint32_t rampFrames)
+    {
+        for (size_t i = 0; i < N; ++i)
+        {
+            _start[i] = _sec[i].coeffs();
+            _target[i] = c[i];
+        }
+        _rampSteps = rampFrames / SUB_FRAMES;
+        if (_rampSteps == 0)
+            _rampSteps = 1;
+        _rampPos = 0;
+    }
+
+    bool ramping() const { return _rampPos < _rampSteps; }
+
+    void process(int16_t* pcm, uint32_t frames)
+    {
+        while (frames && ramping())
+        {
+            uint32_t n = frames < SUB_FRAMES ? frames : SUB_FRAMES;
+
+            ++_rampPos;
+            for (size_t i = 0; i < N; ++i)
+            {
+                _sec[i].setCoeffs(lerp(_start[i], _target[i], _rampPos, _rampSteps));
+                _sec[i].process(pcm, n);
+            }
+            pcm += n * 2;
+            frames -= n;
+        }
+
+        for (size_t i = 0; i < N; ++i)
+            _sec[i].process(pcm, frames);
+    }
+
+private:
+    static int32_t lerp(int32_t a, int32_t b, uint32_t pos, uint32_t steps)
+    {
+        return a + (int32_t)(((int64_t)b - a) * pos / steps);
+    }
+
+    static DspBiquadCoeffs lerp(const DspBiquadCoeffs& a, const DspBiquadCoeffs& b, uint32_t pos, uint32_t steps)
+    {
+        if (pos >= steps)
+            return b;
+
+        DspBiquadCoeffs c = {
+            lerp(a.b0, b.b0, pos, steps), lerp(a.b1, b.b1, pos, steps), lerp(a.b2, b.b2, pos, steps),
+            lerp(a.a1, b.a1, pos, steps), lerp(a.a2, b.a2, pos, steps)
+        };
+        return c;
+    }
+
+    DspBiquad _sec[N];
+    DspBiquadCoeffs _start[N];
+    DspBiquadCoeffs _target[N];
+    uint32_t _rampPos;
+    uint32_t _rampSteps;
+};
+
+// Stereo-linked peak limiter, instant attack and exponential release
+class DspLimiter
+{
+public:
+    DspLimiter(): _threshold(INT16_MAX), _release(0), _env(0) {}
+
+    static const char* name() { return "limiter"; }
+
+    void reset() { _env = 0; }
+
+    void configure(float fs, float thresholdDb, float releaseMs)
+    {
+        _threshold = (int32_t)lrintf(powf(10.0f, thresholdDb / 20.0f) * INT16_MAX);
+        // per-sample decay of the envelope, Q24
+        _release = (int32_t)lrintf((1.0f - expf(-1000.0f / (releaseMs * fs))) * (float)(1 << 24));
+        if (_release < 1)
+            _release = 1;
+    }
+
+    void process(int16_t* pcm, uint32_t frames)
+    {
+        if (_threshold >= INT16_MAX)
+            return;
+
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            int32_t l = pcm[0];
+            int32_t r = pcm[1];
+            int32_t peak = l < 0 ? -l : l;
+            int32_t pr = r < 0 ? -r : r;
+            if (pr > peak)
+                peak = pr;
+
+            // envelope in Q15 sample units
+            int32_t p = peak << 15;
+            if (p > _env)
+                _env = p;
+            else
+                _env -= (int32_t)(((int64_t)_env * _release) >> 24);
+
+            int32_t env = _env >> 15;
+            if (env > _threshold)
+            {
+                int32_t g = (_threshold << 15) / env;
+                pcm[0] = (int16_t)((l * g) >> 15);
+                pcm[1] = (int16_t)((r * g) >> 15);
+            }
+            pcm += 2;
+        }
+    }
+
+private:
+    int32_t _threshold;
+    int32_t _release;
+    int32_t _env;
+};
+
+template <size_t I, typename... Stages>
+struct DspStageType;
+
+template <typename Head, typename... Tail>
+struct DspStageType<0, Head, Tail...>
+{
+    typedef Head type;
+};
+
+template <size_t I, typename Head, typename... Tail>
+struct DspStageType<I, Head, Tail...>
+{
+    typedef typename DspStageType<I - 1, Tail...>::type type;
+};
+
+template <typename... Stages>
+class DspPipeline;
+
+template <>
+class DspPipeline<>
+{
+public:
+    static const size_t SIZE = 0;
+
+    void reset() {}
+    void process(int16_t*, uint32_t) {}
+
+    template <typename Clock>
+    void profile(int16_t*, uint32_t, uint32_t*) {}
+
+    static void names(const char**) {}
+};
+
+template <typename Head, typename... Tail>
+class DspPipeline<Head, Tail...>
+{
+public:
+    static const size_t SIZE = 1 + sizeof...(Tail);
+
+    template <size_t I>
+    typename DspStageType<I, Head, Tail...>::type& stage()
+    {
+        return at(std::integral_constant<size_t, I>());
+    }
+
+    void reset()
+    {
+        _head.reset();
+        _tail.reset();
+    }
+
+    void process(int16_t* pcm, uint32_t frames)
+    {
+        _head.process(pcm, frames);
+        _tail.process(pcm, frames);
+    }
+
+    // process and add the cycles spent in each stage to cycles[0..SIZE-1],
+    // Clock::now() returns a free-running cycle counter
+    template <typename Clock>
+    void profile(int16_t* pcm, uint32_t frames, uint32_t* cycles)
+    {
+        uint32_t t = Clock::now();
+        _head.process(pcm, frames);
+        cycles[0] += Clock::now() - t;
+        _tail.template profile<Clock>(pcm, frames, cycles + 1);
+    }
+
+    static void names(const char** out)
+    {
+        out[0] = Head::name();
+        DspPipeline<Tail...>::names(out + 1);
+    }
+
+private:
+    template <typename... S> friend class DspPipeline;
+
+    Head& at(std::integral_constant<size_t, 0>)
+    {
+        return _head;
+    }
+
+    template <size_t I>
+    typename DspStageType<I, Head, Tail...>::type& at(std::integral_constant<size_t, I>)
+    {
+        return _tail.at(std::integral_constant<size_t, I - 1>());
+    }
+
+    Head _head;
+    DspPipeline<Tail...> _tail;
+};
+
+#endif
@@ -1,27 +1,107 @@
 #include "iPod.h"
 #include "esp_log.h"
-#include <climits>
+#include "bt_app_eq.h"
+#include "bt_app_meta.h"
+#include "bt_app_clock.h"
+#include "bt_app_pt.h"
+#include "esp_timer.h"
+#include "ipod_packet.h"
+#include "nvs.h"
+
+using pkt::U8;
+using pkt::Be16;
+using pkt::Be32;
+using pkt::Str;
 
-template <typename T>
-T swap_endian(T u)
-{
-    static_assert (CHAR_BIT == 8, "CHAR_BIT != 8");
-
-    union
-    {
-        T u;
-        unsigned char u8[sizeof(T)];
-    } source, dest;
+const char TAG[] = "IPOD";
 
-    source.u = u;
+// accessory rates tried by autobaud, in this order
+static const uint32_t autobaudRates[] = { 57600, 19200, 38400, 115200, 9600 };
+static constexpr uint8_t AUTOBAUD_RATES = sizeof(autobaudRates) / sizeof(autobaudRates[0]);
 
-    for (size_t k = 0; k < sizeof(T); k++)
-        dest.u8[k] = source.u8[sizeof(T) - k - 1];
+// the playback clock calls back on the BT task, only the UART event queue is touched there
+static iPod* clockListener = nullptr;
 
-    return dest.u;
+static void onClockChanged()
+{
+    if (clockListener)
+        clockListener->wake();
 }
 
-const char TAG[] = "IPOD";
+// Replies that never change, framed at compile time and kept in flash
+typedef pkt::ConstFrame<
+    IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_RETURN_IPOD_MODEL_NUM,
+    0x00, 0x19, 0x00, 0x00, 0x4D, 0x43, 0x30, 0x38, 0x36, 0x52, 0x50, 0x00 // iPod 2G
+> ModelNumFrame;
+
+typedef pkt::ConstFrame<
+    IPOD_LINGO_EXTENDED_INTERFACE, 0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_PROTOCOL_VERSION,
+    0x01, // major version
+    0x1C  // minor version
+> ProtocolVersionFrame;
+
+typedef pkt::ConstFrame<
+    IPOD_LINGO_EXTENDED_INTERFACE, 0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_NUMBER_CATEGORIZED_DB_RECORDS,
+    0x00, 0x00, 0x00, 0x01 // 1 record
+> NumberCategorizedDBRecordsFrame;
+
+typedef pkt::ConstFrame<
+    IPOD_LINGO_EXTENDED_INTERFACE, 0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_CURRENT_PLAYING_TRACK_INDEX,
+    0x00, 0x00, 0x00, 0x00 // index
+> CurrentPlayingTrackIndexFrame;
+
+typedef pkt::ConstFrame<
+    IPOD_LINGO_EXTENDED_INTERFACE, 0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_NUM_PLAYING_TRACKS,
+    0x00, 0x00, 0x00, 0x01
+> NumPlayingTracksFrame;
+
+typedef pkt::ConstFrame<
+    IPOD_LINGO_EXTENDED_INTERFACE, 0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_MONO_DISPLAY_IMAGE_LIMITS,
+    0x00, 0xA6, // max width
+    0x00, 0x4C, // max height
+    0x01 // pixel format
+> MonoDisplayImageLimitsFrame;
+
+typedef pkt::ConstFrame<
+    IPOD_LINGO_EXTENDED_INTERFACE, 0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_COLOR_DISPLAY_IMAGE_LIMITS,
+    0x00, 0xA6, // max width
+    0x00, 0x4C, // max height
+    0x02, // pixel format
+    0x00, 0xA6, // max width2
+    0x00, 0x4C, // max height2
+    0x03 // pixel format2
+> ColorDisplayImageLimitsFrame;
+
+typedef pkt::ConstFrame<
+    IPOD_LINGO_EXTENDED_INTERFACE, 0x00, IPOD_CMD_EXTENDED_INTERFACE_PLAY_STATUS_CHANGE_NOTIFICATION,
+    IPOD_PLAY_STATUS_NOTIFICATION_PLAYBACK_STOPPED
+> PlaybackStoppedFrame;
+
+// Variable replies, sized at compile time
+typedef pkt::Frame<U8, U8, U8, U8> AckFrame;
+typedef pkt::Frame<U8, U8, U8, U8, U8, U8> ExtendedInterfaceAckFrame;
+typedef pkt::Frame<U8, U8, Be32> DisplayRemoteU32Frame;
+typedef pkt::Frame<U8, U8, U8, Be32, Be32, U8> PlayStatusFrame;
+typedef pkt::Frame<U8, U8, U8, U8, Be32> PlayStatusNotificationFrame;
+typedef pkt::Frame<U8, U8, U8, U8, U8> PlayStatusExtendedFrame;
+typedef pkt::Frame<U8, U8, U8, Str<BT_APP_META_TEXT_LEN>> TrackStringFrame;
+
+// frames checked byte for byte at build time
+static_assert(ModelNumFrame::size == 18, "model number frame size");
+static_assert(ModelNumFrame::bytes[0] == 0xFF && ModelNumFrame::bytes[1] == 0x55 && ModelNumFrame::bytes[2] == 14 &&
+              ModelNumFrame::bytes[3] == 0x00 && ModelNumFrame::bytes[4] == 0x0E && ModelNumFrame::bytes[6] == 0x19 &&
+              ModelNumFrame::bytes[16] == 0x00 && ModelNumFrame::bytes[17] == 0xFB, "model number frame bytes");
+static_assert(ProtocolVersionFrame::size == 9, "protocol version frame size");
+static_assert(ProtocolVersionFrame::bytes[2] == 5 && ProtocolVersionFrame::bytes[3] == 0x04 && ProtocolVersionFrame::bytes[4] == 0x00 &&
+              ProtocolVersionFrame::bytes[5] == 0x13 && ProtocolVersionFrame::bytes[6] == 0x01 && ProtocolVersionFrame::bytes[7] == 0x1C &&
+              ProtocolVersionFrame::bytes[8] == 0xC7, "protocol version frame bytes");
+static_assert(ColorDisplayImageLimitsFrame::size == 3 + 13 + 1, "color display image limits frame size");
+static_assert(AckFrame::maxSize == 3 + 4 + 1, "ACK frame size");
+static_assert(ExtendedInterfaceAckFrame::maxSize == 3 + 6 + 1, "extended interface ACK frame size");
+static_assert(PlayStatusFrame::maxSize == 3 + 12 + 1, "play status frame size");
+static_assert(PlayStatusNotificationFrame::maxSize == 3 + 8 + 1, "play status notification frame size");
+static_assert(PlaybackStoppedFrame::size == 3 + 4 + 1 && PlaybackStoppedFrame::bytes[7] == 0xD1, "playback stopped frame bytes");
+static_assert(TrackStringFrame::maxSize <= MAX_FRAME_SIZE, "track string frame fits the response cache");
 
 uint8_t iPod::checksum(const uint8_t* data, uint32_t len)
 {
@@ -32,11 +112,164 @@ uint8_t iPod::checksum(const uint8_t* data, uint32_t len)
     return 0x100 - (sum & 0xFF);
 }
 
-iPod::iPod(HardwareSerial& ser): _ser(ser), _playStatusNotifications(false), _playStatusNotificationTimer(0), _recvItr(0), _recvSize(0)
+iPod::iPod(uart_port_t port): _port(port), _uartQueue(nullptr), _notifyMask(0), _notify(), _notifySent(0),
+    _recvItr(0), _rxState(RX_SYNC), _rxNoise(false), _rxSum(0), _rxLen(0), _rxDone(0), _rxLastUs(0), _rxSink(nullptr),
+    _sinkCount(0), _rxFrames(0), _rxChecksumErrors(0), _rxResyncs(0), _cacheHits(0), _cacheMisses(0), _requestUs(0), _requestPending(false), _responseUsMax(0),
+    _replyMarks(), _replyMarkHead(0), _replyMarkTail(0),
+    _responseStatsTimer(0), _wakes(0), _busyUs(0), _rxOverflows(0), _rxLineErrors(0), _rxBytes(0), _statsRxFrames(0), _statsRxBytes(0),
+    _baudIndex(0), _baudLocked(false), _autobaudTimer(0), _baudFramesSeen(0), _baudErrorsSeen(0), _baudBytesSeen(0), _baudBadRun(0), _baudSwitches(0), _baud(IPOD_UART_BAUD), _txInflight(0), _txInflightUs(0),
+    _txBytes(0), _txBytesPerSec(0), _txDepthMax(0), _txDropped(0), _commandStats(), _unknown(), _nackSent(false),
+    _commandStatsTimer(COMMAND_STATS_INTERVAL)
 {
     _name = "iPepe";
+
+    for (auto& entry : _cache)
+        entry.valid = false;
+
+    for (auto& q : _tx)
+        q.head = q.tail = 0;
+
+    setSink(IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_SET_DISPLAY_IMAGE, &_imageSink);
+}
+
+// Handlers by (lingo, command). minLen counts the payload after the lingo, command bytes included
+struct iPodDispatch
+{
+    static constexpr iPod::Command commands[] = {
+        { IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_ENTER_REMOTE_UI_MODE, 1, &iPod::handleEnterRemoteUIMode, "EnterRemoteUIMode" },
+        { IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_REQUEST_IPOD_MODEL_NUM, 1, &iPod::handleRequestiPodModelNum, "RequestiPodModelNum" },
+        { IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_IDENTIFY_DEVICE_LINGOES, 1, &iPod::handleIdentifyDeviceLingoes, "IdentifyDeviceLingoes" },
+
+        { IPOD_LINGO_DISPLAY_REMOTE, IPOD_CMD_DISPLAY_REMOTE_GET_CURRENT_EQ_PROFILE_INDEX, 1, &iPod::handleGetCurrentEQProfileIndex, "GetCurrentEQProfileIndex" },
+        { IPOD_LINGO_DISPLAY_REMOTE, IPOD_CMD_DISPLAY_REMOTE_SET_CURRENT_EQ_PROFILE_INDEX, 5, &iPod::handleSetCurrentEQProfileIndex, "SetCurrentEQProfileIndex" },
+        { IPOD_LINGO_DISPLAY_REMOTE, IPOD_CMD_DISPLAY_REMOTE_GET_NUM_EQ_PROFILES, 1, &iPod::handleGetNumEQProfiles, "GetNumEQProfiles" },
+
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_REQUEST_PROTOCOL_VERSION, 2, &iPod::handleRequestProtocolVersion, "RequestProtocolVersion" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_REQUEST_IPOD_NAME, 2, &iPod::handleRequestiPodName, "RequestiPodName" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RESET_DB_SELECTION, 2, &iPod::handleAckOnly, "ResetDBSelection" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_SELECT_DB_RECORD, 2, &iPod::handleAckOnly, "SelectDBRecord" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_GET_NUMBER_CATEGORIZED_DB_RECORDS, 2, &iPod::handleGetNumberCategorizedDBRecords, "GetNumberCategorizedDBRecords" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETRIEVE_CATEGORIZED_DB_RECORDS, 11, &iPod::handleRetrieveCategorizedDBRecords, "RetrieveCategorizedDBRecords" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_GET_PLAY_STATUS, 2, &iPod::handleGetPlayStatus, "GetPlayStatus" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_GET_CURRENT_PLAYING_TRACK_INDEX, 2, &iPod::handleGetCurrentPlayingTrackIndex, "GetCurrentPlayingTrackIndex" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_GET_INDEXED_PLAYING_TRACK_TITLE, 6, &iPod::handleGetIndexedPlayingTrackString, "GetIndexedPlayingTrackTitle" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_GET_INDEXED_PLAYING_TRACK_ARTIST, 6, &iPod::handleGetIndexedPlayingTrackString, "GetIndexedPlayingTrackArtist" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_GET_INDEXED_PLAYING_TRACK_ALBUM, 6, &iPod::handleGetIndexedPlayingTrackString, "GetIndexedPlayingTrackAlbum" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_SET_PLAY_STATUS_CHANGE_NOTIFICATION, 3, &iPod::handleSetPlayStatusChangeNotification, "SetPlayStatusChangeNotification" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_PLAY_CURRENT_SELECTION, 2, &iPod::handleAckOnly, "PlayCurrentSelection" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_PLAY_CONTROL, 3, &iPod::handlePlayControl, "PlayControl" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_SET_SHUFFLE, 3, &iPod::handleSetShuffle, "SetShuffle" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_SET_REPEAT, 3, &iPod::handleSetRepeat, "SetRepeat" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_SET_DISPLAY_IMAGE, 2, &iPod::handleAckOnly, "SetDisplayImage" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_GET_MONO_DISPLAY_IMAGE_LIMITS, 2, &iPod::handleGetMonoDisplayImageLimits, "GetMonoDisplayImageLimits" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_GET_NUM_PLAYING_TRACKS, 2, &iPod::handleGetNumPlayingTracks, "GetNumPlayingTracks" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_SET_CURRENT_PLAYING_TRACK, 6, &iPod::handleSetCurrentPlayingTrack, "SetCurrentPlayingTrack" },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_GET_COLOR_DISPLAY_IMAGE_LIMITS, 2, &iPod::handleGetColorDisplayImageLimits, "GetColorDisplayImageLimits" },
+    };
+
+    static constexpr uint32_t count = sizeof(commands) / sizeof(commands[0]);
+
+    struct Reply
+    {
+        uint8_t lingo;
+        uint8_t cmd;
+    };
+
+    // ACKs and responses the head unit sends back. Answering them would start an ACK loop
+    static constexpr Reply replies[] = {
+        { IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_ACK },
+        { IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_RETURN_IPOD_MODEL_NUM },
+        { IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_RET_DEV_AUTHENTICATION_INFO },
+        { IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_RET_DEV_AUTHENTICATION_SIGNATURE },
+        { IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_RET_ACCESSORY_INFO },
+
+        { IPOD_LINGO_DISPLAY_REMOTE, IPOD_CMD_DISPLAY_REMOTE_ACK },
+        { IPOD_LINGO_DISPLAY_REMOTE, IPOD_CMD_DISPLAY_REMOTE_RET_CURRENT_EQ_PROFILE_INDEX },
+        { IPOD_LINGO_DISPLAY_REMOTE, IPOD_CMD_DISPLAY_REMOTE_RET_NUM_EQ_PROFILES },
+
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_ACK },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETURN_PROTOCOL_VERSION },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETURN_IPOD_NAME },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETURN_NUMBER_CATEGORIZED_DB_RECORDS },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETURN_CATEGORIZED_DB_RECORD },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETURN_PLAY_STATUS },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETURN_CURRENT_PLAYING_TRACK_INDEX },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETURN_INDEXED_PLAYING_TRACK_TITLE },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETURN_INDEXED_PLAYING_TRACK_ARTIST },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETURN_INDEXED_PLAYING_TRACK_ALBUM },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_PLAY_STATUS_CHANGE_NOTIFICATION },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETURN_SHUFFLE },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETURN_REPEAT },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETURN_MONO_DISPLAY_IMAGE_LIMITS },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETURN_NUM_PLAYING_TRACKS },
+        { IPOD_LINGO_EXTENDED_INTERFACE, IPOD_CMD_EXTENDED_INTERFACE_RETURN_COLOR_DISPLAY_IMAGE_LIMITS },
+    };
+
+    static constexpr uint32_t replyCount = sizeof(replies) / sizeof(replies[0]);
+};
+
+constexpr iPod::Command iPodDispatch::commands[];
+constexpr iPodDispatch::Reply iPodDispatch::replies[];
+
+static_assert(iPodDispatch::count <= MAX_COMMANDS, "raise MAX_COMMANDS");
+static_assert(iPodDispatch::count < REPLY_COMMAND, "slot numbers are uint8_t");
+
+constexpr bool isReply(uint8_t lingo, uint32_t cmd, uint32_t i = 0)
+{
+    return i < iPodDispatch::replyCount &&
+        ((iPodDispatch::replies[i].lingo == lingo && iPodDispatch::replies[i].cmd == cmd) || isReply(lingo, cmd, i+1));
 }
 
+// Slot of (lingo, cmd) in the command list, searched by the compiler
+constexpr uint8_t findCommand(uint8_t lingo, uint32_t cmd, uint32_t i = 0)
+{
+    return i == iPodDispatch::count ? (isReply(lingo, cmd) ? REPLY_COMMAND : NO_COMMAND) :
+        (iPodDispatch::commands[i].lingo == lingo && iPodDispatch::commands[i].cmd == cmd) ? uint8_t(i) :
+        findCommand(lingo, cmd, i+1);
+}
+
+template <uint32_t... I>
+struct Seq {};
+
+template <uint32_t N, uint32_t... I>
+struct MakeSeq : MakeSeq<N-1, N-1, I...> {};
+
+template <uint32_t... I>
+struct MakeSeq<0, I...>
+{
+    typedef Seq<I...> type;
+};
+
+// One slot per command byte of a lingo, a lookup is a single load
+template <uint8_t Lingo, typename S = MakeSeq<256>::type>
+struct CommandTable;
+
+template <uint8_t Lingo, uint32_t... C>
+struct CommandTable<Lingo, Seq<C...>>
+{
+    static constexpr uint8_t slots[sizeof...(C)] = { findCommand(Lingo, C)... };
+};
+
+template <uint8_t Lingo, uint32_t... C>
+constexpr uint8_t CommandTable<Lingo, Seq<C...>>::slots[];
+
+// indexed by lingo, null where no command is handled
+static constexpr const uint8_t* lingoTables[] = {
+    CommandTable<IPOD_LINGO_GENERAL>::slots,        // 0x00
+    nullptr,                                        // 0x01
+    nullptr,                                        // 0x02
+    CommandTable<IPOD_LINGO_DISPLAY_REMOTE>::slots, // 0x03
+    CommandTable<IPOD_LINGO_EXTENDED_INTERFACE>::slots, // 0x04
+};
+
+static_assert(CommandTable<IPOD_LINGO_EXTENDED_INTERFACE>::slots[IPOD_CMD_EXTENDED_INTERFACE_PLAY_CONTROL] != NO_COMMAND,
+              "command table built at compile time");
+static_assert(CommandTable<IPOD_LINGO_GENERAL>::slots[IPOD_CMD_GENERAL_ACK] == REPLY_COMMAND &&
+              CommandTable<IPOD_LINGO_EXTENDED_INTERFACE>::slots[IPOD_CMD_EXTENDED_INTERFACE_ACK] == REPLY_COMMAND,
+              "head unit ACKs are never NACKed");
+static_assert(CommandTable<IPOD_LINGO_GENERAL>::slots[IPOD_CMD_GENERAL_GET_ACCESSORY_INFO] == NO_COMMAND,
+              "command table built at compile time");
+
 void iPod::handlePacket(const uint8_t* data, uint32_t len)
 {
     uint8_t lingo = data[0];
@@ -45,440 +278,1250 @@ void iPod::handlePacket(const uint8_t* data, uint32_t len)
     const uint8_t* payload = data+1;
     uint32_t payload_len = len-1;
 
-    switch(lingo)
+    // commands are 16 bit on the extended interface lingo
+    uint32_t cmdSize = lingo == IPOD_LINGO_EXTENDED_INTERFACE ? 2 : 1;
+    if (payload_len < cmdSize)
     {
-        case IPOD_LINGO_GENERAL:
-            handleLingoGeneral(payload, payload_len);
-            break;
-        case IPOD_LINGO_DISPLAY_REMOTE:
-            handleLingoDisplayRemote(payload, payload_len);
-            break;
-        case IPOD_LINGO_EXTENDED_INTERFACE:
-            handleLingoExtendedInterface(payload, payload_len);
-            break;
-        default:
-            ESP_LOGE(TAG, "Unhandled lingo: 0x%02X", lingo);
+        ESP_LOGE(TAG, "Packet without command, lingo 0x%02X", lingo);
+        return;
     }
-}
 
-void iPod::handleLingoGeneral(const uint8_t* data, uint32_t len)
-{
-    uint8_t cmd = data[0];
+    uint16_t cmd = cmdSize == 2 ? pkt::getBe16(payload) : payload[0];
+    uint8_t slot = NO_COMMAND;
+
+    if (lingo < sizeof(lingoTables) / sizeof(lingoTables[0]) && lingoTables[lingo] && cmd <= 0xFF)
+        slot = lingoTables[lingo][cmd];
 
-    switch(cmd)
+    if (slot == REPLY_COMMAND)
     {
-        case IPOD_CMD_GENERAL_ENTER_REMOTE_UI_MODE:
-        {
-            const uint8_t resp[] = {
-                IPOD_LINGO_GENERAL,
-                IPOD_CMD_GENERAL_ACK,
-                IPOD_ERROR_OK,
-                cmd
-            };
-
-            send(resp, sizeof(resp));
-            break;
-        }
-        case IPOD_CMD_GENERAL_REQUEST_IPOD_MODEL_NUM:
-        {
-            const uint8_t resp[] = {
-                IPOD_LINGO_GENERAL,
-                IPOD_CMD_GENERAL_RETURN_IPOD_MODEL_NUM,
-                0x00, 0x19, 0x00, 0x00, 0x4D, 0x43, 0x30, 0x38, 0x36, 0x52, 0x50, 0x00 // iPod 2G
-            };
+        ESP_LOGD(TAG, "Reply from the head unit, lingo 0x%02X cmd 0x%04X", lingo, cmd);
+        countUnknown(lingo, cmd, true);
+        return;
+    }
 
-            send(resp, sizeof(resp));
-            break;
-        }
-        case IPOD_CMD_GENERAL_IDENTIFY_DEVICE_LINGOES:
-        {
-            const uint8_t resp[] = {
-                IPOD_LINGO_GENERAL,
-                IPOD_CMD_GENERAL_ACK,
-                IPOD_ERROR_OK,
-                cmd
-            };
+    if (slot == NO_COMMAND)
+    {
+        ESP_LOGE(TAG, "Unhandled lingo 0x%02X cmd 0x%04X", lingo, cmd);
+        countUnknown(lingo, cmd, false);
+        sendAck(lingo, IPOD_ERROR_UNKNOWN_ID, cmd);
+        return;
+    }
 
-            send(resp, sizeof(resp));
+    const Command& command = iPodDispatch::commands[slot];
+    CommandStats& stats = _commandStats[slot];
 
-            // iPod also sends IPOD_CMD_GENERAL_GET_ACCESSORY_INFO
+    stats.calls++;
 
-            break;
-        }
-        default:
-            ESP_LOGE(TAG, "Unhandled general lingo cmd: 0x%02X", cmd);
+    if (payload_len < command.minLen)
+    {
+        ESP_LOGE(TAG, "%s: %u bytes, needs %u", command.name, payload_len, command.minLen);
+        stats.nacks++;
+        sendAck(lingo, IPOD_ERROR_BAD_PARAMETER, cmd);
+        return;
     }
+
+    _nackSent = false;
+    int64_t start = esp_timer_get_time();
+
+    (this->*command.handler)(payload, payload_len);
+
+    uint32_t us = uint32_t(esp_timer_get_time() - start);
+    stats.usTotal += us;
+    if (us > stats.usMax)
+        stats.usMax = us;
+    if (_nackSent)
+        stats.nacks++;
 }
 
-void iPod::handleLingoDisplayRemote(const uint8_t* data, uint32_t len)
+void iPod::countUnknown(uint8_t lingo, uint16_t cmd, bool reply)
 {
-    uint8_t cmd = data[0];
-
-    switch(cmd)
+    for (auto& entry : _unknown)
     {
-        case IPOD_CMD_DISPLAY_REMOTE_SET_CURRENT_EQ_PROFILE_INDEX:
+        if (entry.calls == 0)
         {
-            const uint8_t resp[] = {
-                IPOD_LINGO_DISPLAY_REMOTE,
-                IPOD_CMD_DISPLAY_REMOTE_ACK,
-                IPOD_ERROR_OK,
-                cmd
-            };
-
-            send(resp, sizeof(resp));
-            break;
+            entry.lingo = lingo;
+            entry.cmd = cmd;
+            entry.reply = reply;
+        }
+
+        if (entry.lingo == lingo && entry.cmd == cmd)
+        {
+            entry.calls++;
+            return;
         }
-        default:
-            ESP_LOGE(TAG, "Unhandled display remote lingo cmd: 0x%02X", cmd);
     }
+
+    // table full, the rest are only logged
 }
 
-void iPod::handleLingoExtendedInterface(const uint8_t* data, uint32_t len)
+void iPod::dumpCommandStats() const
 {
-    // Commands are uint16_t, but higher byte is always 0
-    uint8_t cmd = data[1];
+    for (uint32_t i = 0; i < iPodDispatch::count; ++i)
+    {
+        const Command& command = iPodDispatch::commands[i];
+        const CommandStats& stats = _commandStats[i];
+
+        if (stats.calls == 0)
+            continue;
+
+        ESP_LOGI(TAG, "0x%02X/0x%02X %s: %u calls, %u NACKs, %u us avg, %u us max", command.lingo, command.cmd, command.name,
+            stats.calls, stats.nacks, uint32_t(stats.usTotal / stats.calls), stats.usMax);
+    }
 
-    switch(cmd)
+    for (const auto& entry : _unknown)
     {
-        case IPOD_CMD_EXTENDED_INTERFACE_REQUEST_PROTOCOL_VERSION:
-        {
-            const uint8_t resp[] = {
-                IPOD_LINGO_EXTENDED_INTERFACE,
-                0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_PROTOCOL_VERSION,
-                0x01, // major version
-                0x1C, // minor version
-            };
-
-            send(resp, sizeof(resp));
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_REQUEST_IPOD_NAME:
-        {
-            uint8_t resp[255] = {
-                IPOD_LINGO_EXTENDED_INTERFACE,
-                0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_IPOD_NAME
-            };
+        if (entry.calls)
+            ESP_LOGI(TAG, "0x%02X/0x%04X %s: %u calls", entry.lingo, entry.cmd, entry.reply ? "reply" : "unhandled", entry.calls);
+    }
+}
 
-            strcpy((char*)resp+3, _name.c_str());
+// General lingo
 
-            send(resp, 3+_name.size()+1);
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_RESET_DB_SELECTION:
-        {
-            sendExtendedInterfaceACK(IPOD_ERROR_OK, cmd);
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_SELECT_DB_RECORD:
-        {
-            sendExtendedInterfaceACK(IPOD_ERROR_OK, cmd);
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_GET_NUMBER_CATEGORIZED_DB_RECORDS:
-        {
-            const uint8_t resp[] = {
-                IPOD_LINGO_EXTENDED_INTERFACE,
-                0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_NUMBER_CATEGORIZED_DB_RECORDS,
-                0x00, 0x00, 0x00, 0x01 // 1 record
-            };
+void iPod::handleEnterRemoteUIMode(const uint8_t* data, uint32_t len)
+{
+    sendAck(IPOD_LINGO_GENERAL, IPOD_ERROR_OK, data[0]);
+}
 
-            send(resp, sizeof(resp));
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_RETRIEVE_CATEGORIZED_DB_RECORDS:
-        {
-            uint8_t category = data[2];
-            uint32_t start_index = swap_endian(*((uint32_t*)data+3));
-            uint32_t read_count = swap_endian(*((uint32_t*)data+7));
+void iPod::handleRequestiPodModelNum(const uint8_t* data, uint32_t len)
+{
+    writeFrame(ModelNumFrame::bytes, ModelNumFrame::size);
+}
+
+void iPod::handleIdentifyDeviceLingoes(const uint8_t* data, uint32_t len)
+{
+    sendAck(IPOD_LINGO_GENERAL, IPOD_ERROR_OK, data[0]);
 
-            ESP_LOGD(TAG, "RetrieveCategorizedDBRecords: Cat: 0x%02X, Start: %u, Count: %u", category, start_index, read_count);
+    // iPod also sends IPOD_CMD_GENERAL_GET_ACCESSORY_INFO
+}
 
-            // repeated for each record
-            uint8_t resp[255] = {
-                IPOD_LINGO_EXTENDED_INTERFACE,
-                0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_CATEGORIZED_DB_RECORD,
-                0x00, 0x00, 0x00, 0x00 // index
-            };
+// Display remote lingo
 
-            const char name[] = "Unknown";
-            strcpy((char*)resp+7, name);
+void iPod::handleGetCurrentEQProfileIndex(const uint8_t* data, uint32_t len)
+{
+    const DisplayRemoteU32Frame resp(IPOD_LINGO_DISPLAY_REMOTE, IPOD_CMD_DISPLAY_REMOTE_RET_CURRENT_EQ_PROFILE_INDEX,
+        bt_app_eq_selected());
 
-            send(resp, 7+sizeof(name));
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_GET_PLAY_STATUS:
-        {
-            const uint8_t resp[] = {
-                IPOD_LINGO_EXTENDED_INTERFACE,
-                0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_PLAY_STATUS,
-                0x00, 0x00, 0x08, 0x00, // length in ms
-                0x00, 0x00, 0x05, 0x00, // position in ms
-                IPOD_PLAYER_STATE_PLAYING
-            };
-
-            send(resp, sizeof(resp));
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_GET_CURRENT_PLAYING_TRACK_INDEX:
-        {
-            const uint8_t resp[] = {
-                IPOD_LINGO_EXTENDED_INTERFACE,
-                0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_CURRENT_PLAYING_TRACK_INDEX,
-                0x00, 0x00, 0x00, 0x00, // index
-            };
+    writeFrame(resp.bytes, resp.len);
+}
 
-            send(resp, sizeof(resp));
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_GET_INDEXED_PLAYING_TRACK_TITLE:
-        {
-            uint32_t index = swap_endian(*((uint32_t*)data+3));
+void iPod::handleSetCurrentEQProfileIndex(const uint8_t* data, uint32_t len)
+{
+    // index is big endian uint32_t, followed by restore on exit flag
+    uint8_t error = IPOD_ERROR_BAD_PARAMETER;
+    uint32_t index = pkt::getBe32(data+1);
 
-            ESP_LOGD(TAG, "GetIndexedPlayingTrackTitle: Index: %u", index);
+    if (bt_app_eq_select(index))
+    {
+        ESP_LOGI(TAG, "EQ profile %u: %s", index, bt_app_eq_name(index));
+        error = IPOD_ERROR_OK;
+    }
 
-            uint8_t resp[255] = {
-                IPOD_LINGO_EXTENDED_INTERFACE,
-                0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_INDEXED_PLAYING_TRACK_TITLE
-            };
+    sendAck(IPOD_LINGO_DISPLAY_REMOTE, error, data[0]);
+}
 
-            const char name[] = "KAPPA TITLE";
-            strcpy((char*)resp+3, name);
+void iPod::handleGetNumEQProfiles(const uint8_t* data, uint32_t len)
+{
+    const DisplayRemoteU32Frame resp(IPOD_LINGO_DISPLAY_REMOTE, IPOD_CMD_DISPLAY_REMOTE_RET_NUM_EQ_PROFILES,
+        bt_app_eq_count());
 
-            send(resp, 3+sizeof(name));
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_GET_INDEXED_PLAYING_TRACK_ARTIST:
-        {
-            uint32_t index = swap_endian(*((uint32_t*)data+3));
+    writeFrame(resp.bytes, resp.len);
+}
 
-            ESP_LOGD(TAG, "GetIndexedPlayingTrackArtist: Index: %u", index);
+// Extended interface lingo. Commands are uint16_t, but higher byte is always 0
 
-            uint8_t resp[255] = {
-                IPOD_LINGO_EXTENDED_INTERFACE,
-                0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_INDEXED_PLAYING_TRACK_ARTIST
-            };
+void iPod::handleAckOnly(const uint8_t* data, uint32_t len)
+{
+    sendExtendedInterfaceACK(IPOD_ERROR_OK, data[1]);
+}
 
-            const char name[] = "KAPPA ARTIST";
-            strcpy((char*)resp+3, name);
+void iPod::handleRequestProtocolVersion(const uint8_t* data, uint32_t len)
+{
+    writeFrame(ProtocolVersionFrame::bytes, ProtocolVersionFrame::size);
+}
 
-            send(resp, 3+sizeof(name));
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_GET_INDEXED_PLAYING_TRACK_ALBUM:
-        {
-            uint32_t index = swap_endian(*((uint32_t*)data+3));
+void iPod::handleRequestiPodName(const uint8_t* data, uint32_t len)
+{
+    // the name never changes, the frame is built once
+    if (sendCached(CACHE_IPOD_NAME, 0))
+        return;
 
-            ESP_LOGD(TAG, "GetIndexedPlayingTrackArtist: Album: %u", index);
+    const pkt::Frame<U8, U8, U8, Str<64>> resp(IPOD_LINGO_EXTENDED_INTERFACE,
+        0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_IPOD_NAME, _name.c_str());
 
-            uint8_t resp[255] = {
-                IPOD_LINGO_EXTENDED_INTERFACE,
-                0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_INDEXED_PLAYING_TRACK_ALBUM
-            };
+    sendAndCache(CACHE_IPOD_NAME, 0, resp.bytes, resp.len);
+}
 
-            const char name[] = "KAPPA ALBUM";
-            strcpy((char*)resp+3, name);
+void iPod::handleGetNumberCategorizedDBRecords(const uint8_t* data, uint32_t len)
+{
+    writeFrame(NumberCategorizedDBRecordsFrame::bytes, NumberCategorizedDBRecordsFrame::size);
+}
 
-            send(resp, 3+sizeof(name));
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_SET_PLAY_STATUS_CHANGE_NOTIFICATION:
-        {
-            // this command can be 4 byte (event mask). not handled
-            uint8_t set = data[2];
+void iPod::handleRetrieveCategorizedDBRecords(const uint8_t* data, uint32_t len)
+{
+    uint8_t category = data[2];
+    uint32_t start_index = pkt::getBe32(data+3);
+    uint32_t read_count = pkt::getBe32(data+7);
 
-            ESP_LOGD(TAG, "SetPlayStatusChangeNotification: 0x%02X", set);
+    ESP_LOGD(TAG, "RetrieveCategorizedDBRecords: Cat: 0x%02X, Start: %u, Count: %u", category, start_index, read_count);
 
-            if (set == 0x00)
-                _playStatusNotifications = false;
-            else if (set == 0x01)
-                _playStatusNotifications = true;
-            else
-                ESP_LOGE(TAG, "Unknown SetPlayStatusChangeNotification value: 0x%02X", set);
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_PLAY_CURRENT_SELECTION:
-        {
-            sendExtendedInterfaceACK(IPOD_ERROR_OK, cmd);
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_PLAY_CONTROL:
-        {
-            uint8_t code = data[2];
+    // repeated for each record
+    const pkt::Frame<U8, U8, U8, Be32, Str<8>> resp(IPOD_LINGO_EXTENDED_INTERFACE,
+        0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_CATEGORIZED_DB_RECORD,
+        0, // index
+        "Unknown");
 
-            ESP_LOGD(TAG, "PlayControl: 0x%02X", code);
+    writeFrame(resp.bytes, resp.len);
+}
 
-            sendExtendedInterfaceACK(IPOD_ERROR_OK, cmd);
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_SET_SHUFFLE:
-        {
-            uint8_t mode = data[2];
-            uint8_t restoreOnExit = data[3];
+void iPod::handleGetPlayStatus(const uint8_t* data, uint32_t len)
+{
+    // answered from the local playback clock, no AVRCP round trip
+    const PlayStatusFrame resp(IPOD_LINGO_EXTENDED_INTERFACE,
+        0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_PLAY_STATUS,
+        bt_app_clock_length_ms(), // length in ms
+        bt_app_clock_position_ms(), // position in ms
+        playerState());
+
+    writeFrame(resp.bytes, resp.len);
+}
 
-            ESP_LOGD(TAG, "SetShuffle: Mode: 0x%02X, Restore: 0x%02X", mode, restoreOnExit);
+void iPod::handleGetCurrentPlayingTrackIndex(const uint8_t* data, uint32_t len)
+{
+    writeFrame(CurrentPlayingTrackIndexFrame::bytes, CurrentPlayingTrackIndexFrame::size);
+}
 
-            sendExtendedInterfaceACK(IPOD_ERROR_OK, cmd);
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_SET_REPEAT:
-        {
-            uint8_t repeat = data[2];
-            uint8_t restoreOnExit = data[3];
+void iPod::handleGetIndexedPlayingTrackString(const uint8_t* data, uint32_t len)
+{
+    uint8_t cmd = data[1];
+    uint32_t index = pkt::getBe32(data+2);
 
-            ESP_LOGD(TAG, "SetRepeat: Repeat: 0x%02X, Restore: 0x%02X", repeat, restoreOnExit);
+    // title, artist and album differ only in the attribute and the reply
+    CacheSlot slot;
+    bt_app_meta_attr_t attr;
 
-            sendExtendedInterfaceACK(IPOD_ERROR_OK, cmd);
+    switch (cmd)
+    {
+        case IPOD_CMD_EXTENDED_INTERFACE_GET_INDEXED_PLAYING_TRACK_TITLE:
+            slot = CACHE_TRACK_TITLE;
+            attr = BT_APP_META_TITLE;
             break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_SET_DISPLAY_IMAGE:
-        {
-            sendExtendedInterfaceACK(IPOD_ERROR_OK, cmd);
+        case IPOD_CMD_EXTENDED_INTERFACE_GET_INDEXED_PLAYING_TRACK_ARTIST:
+            slot = CACHE_TRACK_ARTIST;
+            attr = BT_APP_META_ARTIST;
             break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_GET_MONO_DISPLAY_IMAGE_LIMITS:
-        {
-            const uint8_t resp[] = {
-                IPOD_LINGO_EXTENDED_INTERFACE,
-                0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_MONO_DISPLAY_IMAGE_LIMITS,
-                0x00, 0xA6, // max width
-                0x00, 0x4C, // max height
-                0x01 // pixel format
-            };
-
-            send(resp, sizeof(resp));
+        default:
+            slot = CACHE_TRACK_ALBUM;
+            attr = BT_APP_META_ALBUM;
             break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_GET_NUM_PLAYING_TRACKS:
-        {
-            const uint8_t resp[] = {
-                IPOD_LINGO_EXTENDED_INTERFACE,
-                0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_NUM_PLAYING_TRACKS,
-                0x00, 0x00, 0x00, 0x01
-            };
+    }
 
-            send(resp, sizeof(resp));
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_SET_CURRENT_PLAYING_TRACK:
-        {
-            uint32_t index = swap_endian(*((uint32_t*)data+3));
+    ESP_LOGD(TAG, "GetIndexedPlayingTrackString: Cmd: 0x%02X, Index: %u", cmd, index);
 
-            ESP_LOGD(TAG, "SetCurrentPlayingTrack: %u", index);
+    uint32_t version = bt_app_meta_version();
+    if (sendCached(slot, version))
+        return;
 
-            sendExtendedInterfaceACK(IPOD_ERROR_OK, cmd);
-            break;
-        }
-        case IPOD_CMD_EXTENDED_INTERFACE_GET_COLOR_DISPLAY_IMAGE_LIMITS:
-        {
-            const uint8_t resp[] = {
-                IPOD_LINGO_EXTENDED_INTERFACE,
-                0x00, IPOD_CMD_EXTENDED_INTERFACE_RETURN_COLOR_DISPLAY_IMAGE_LIMITS,
-                0x00, 0xA6, // max width
-                0x00, 0x4C, // max height
-                0x02, // pixel format
-                0x00, 0xA6, // max width2
-                0x00, 0x4C, // max height2
-                0x03 // pixel format2
-            };
-
-            send(resp, sizeof(resp));
-            break;
-        }
-        default:
-            ESP_LOGE(TAG, "Unhandled extended interface lingo cmd: 0x%02X", cmd);
+    // current track only, the string is copied from the AVRCP metadata store
+    char text[BT_APP_META_TEXT_LEN];
+    bt_app_meta_get(attr, text, sizeof(text), nullptr);
+
+    // each reply command follows its request
+    const TrackStringFrame resp(IPOD_LINGO_EXTENDED_INTERFACE, 0x00, uint8_t(cmd + 1), text);
+
+    sendAndCache(slot, version, resp.bytes, resp.len);
+}
+
+void iPod::handleSetPlayStatusChangeNotification(const uint8_t* data, uint32_t len)
+{
+    uint32_t mask;
+
+    // 4 byte event mask, or 1 byte on/off for the legacy set
+    if (len >= 2 + 4)
+        mask = pkt::getBe32(data+2);
+    else if (data[2] <= 0x01)
+        mask = data[2] ? IPOD_PLAY_STATUS_NOTIFICATION_MASK_LEGACY : 0;
+    else
+    {
+        ESP_LOGE(TAG, "Unknown SetPlayStatusChangeNotification value: 0x%02X", data[2]);
+        sendExtendedInterfaceACK(IPOD_ERROR_BAD_PARAMETER, data[1]);
+        return;
+    }
+
+    ESP_LOGD(TAG, "SetPlayStatusChangeNotification: 0x%08X", mask);
+
+    _notifyMask = mask;
+
+    // the head unit starts from what it can query now, only later changes are sent
+    uint32_t now = millis();
+    bt_app_clock_state_t state = bt_app_clock_state();
+    uint32_t pos = bt_app_clock_position_ms();
+
+    for (uint8_t e = 0; e < NOTIFY_EVENTS; ++e)
+    {
+        _notify[e].value = notifyValue(NotifyEvent(e), state, pos);
+        _notify[e].sentAt = now;
+        _notify[e].due = UINT32_MAX;
     }
+
+    sendExtendedInterfaceACK(IPOD_ERROR_OK, data[1]);
+}
+
+void iPod::handlePlayControl(const uint8_t* data, uint32_t len)
+{
+    uint8_t code = data[2];
+
+    ESP_LOGD(TAG, "PlayControl: 0x%02X", code);
+
+    // queued for the BT task, the ACK does not wait for the phone
+    if (code == IPOD_PLAY_CONTROL_RESERVED || code > IPOD_PLAY_CONTROL_PREVIOUS_CHAPTER)
+        sendExtendedInterfaceACK(IPOD_ERROR_BAD_PARAMETER, data[1]);
+    else if (!bt_app_pt_play_control(code))
+        sendExtendedInterfaceACK(IPOD_ERROR_COMMAND_FAILED, data[1]);
+    else
+        sendExtendedInterfaceACK(IPOD_ERROR_OK, data[1]);
+}
+
+void iPod::handleSetShuffle(const uint8_t* data, uint32_t len)
+{
+    uint8_t mode = data[2];
+    // restore on exit is optional
+    uint8_t restoreOnExit = len > 3 ? data[3] : 0;
+
+    ESP_LOGD(TAG, "SetShuffle: Mode: 0x%02X, Restore: 0x%02X", mode, restoreOnExit);
+
+    sendExtendedInterfaceACK(IPOD_ERROR_OK, data[1]);
+}
+
+void iPod::handleSetRepeat(const uint8_t* data, uint32_t len)
+{
+    uint8_t repeat = data[2];
+    uint8_t restoreOnExit = len > 3 ? data[3] : 0;
+
+    ESP_LOGD(TAG, "SetRepeat: Repeat: 0x%02X, Restore: 0x%02X", repeat, restoreOnExit);
+
+    sendExtendedInterfaceACK(IPOD_ERROR_OK, data[1]);
+}
+
+void iPod::handleGetMonoDisplayImageLimits(const uint8_t* data, uint32_t len)
+{
+    writeFrame(MonoDisplayImageLimitsFrame::bytes, MonoDisplayImageLimitsFrame::size);
+}
+
+void iPod::handleGetNumPlayingTracks(const uint8_t* data, uint32_t len)
+{
+    writeFrame(NumPlayingTracksFrame::bytes, NumPlayingTracksFrame::size);
+}
+
+void iPod::handleSetCurrentPlayingTrack(const uint8_t* data, uint32_t len)
+{
+    uint32_t index = pkt::getBe32(data+2);
+
+    ESP_LOGD(TAG, "SetCurrentPlayingTrack: %u", index);
+
+    sendExtendedInterfaceACK(IPOD_ERROR_OK, data[1]);
+}
+
+void iPod::handleGetColorDisplayImageLimits(const uint8_t* data, uint32_t len)
+{
+    writeFrame(ColorDisplayImageLimitsFrame::bytes, ColorDisplayImageLimitsFrame::size);
 }
 
 void iPod::sendTrackIndex(uint32_t index)
 {
-    uint8_t resp[20] = {
-        IPOD_LINGO_EXTENDED_INTERFACE,
+    const PlayStatusNotificationFrame resp(IPOD_LINGO_EXTENDED_INTERFACE,
         0x00, IPOD_CMD_EXTENDED_INTERFACE_PLAY_STATUS_CHANGE_NOTIFICATION,
-        IPOD_PLAY_STATUS_NOTIFICATION_TRACK_INDEX,
-    };
-
-    *(resp+3) = swap_endian<uint32_t>(index);
+        IPOD_PLAY_STATUS_NOTIFICATION_TRACK_INDEX, index);
 
-    send(resp, 4+4);
+    writeFrame(resp.bytes, resp.len, TX_NOTIFY);
 }
 
 void iPod::sendTrackTimeOffsetMS(uint32_t offset)
 {
-    uint8_t resp[20] = {
-        IPOD_LINGO_EXTENDED_INTERFACE,
+    const PlayStatusNotificationFrame resp(IPOD_LINGO_EXTENDED_INTERFACE,
         0x00, IPOD_CMD_EXTENDED_INTERFACE_PLAY_STATUS_CHANGE_NOTIFICATION,
-        IPOD_PLAY_STATUS_NOTIFICATION_TRACK_TIME_OFFSET_MS,
-    };
-
-    *(resp+3) = swap_endian<uint32_t>(offset);
+        IPOD_PLAY_STATUS_NOTIFICATION_TRACK_TIME_OFFSET_MS, offset);
 
-    send(resp, 4+4);
+    writeFrame(resp.bytes, resp.len, TX_NOTIFY);
 }
 
-void iPod::update()
+void iPod::sendTrackTimeOffsetSec(uint32_t offset)
 {
-    // process serial data
-    while (_ser.available())
-    {
-        char c = _ser.read();
+    const PlayStatusNotificationFrame resp(IPOD_LINGO_EXTENDED_INTERFACE,
+        0x00, IPOD_CMD_EXTENDED_INTERFACE_PLAY_STATUS_CHANGE_NOTIFICATION,
+        IPOD_PLAY_STATUS_NOTIFICATION_TRACK_TIME_OFFSET_SEC, offset);
 
-        if (_lastChar == 0xFF && c == 0x55)
-        {
-            _recvItr = 0;
-            _recvSize = 0;
-        }
-        else if (_recvItr == 0 && _recvSize == 0)
-        {
-            _recvSize = c;
-            ESP_LOGD(TAG, "Begin receiving. Len: %u", _recvSize);
-        }
-        else
-        {
-            _recv[_recvItr++] = c;
+    writeFrame(resp.bytes, resp.len, TX_NOTIFY);
+}
 
-            // plus checksum
-            if (_recvItr == _recvSize+1)
-            {
-                ESP_LOGD(TAG, "Received: ");
+void iPod::sendPlaybackStopped()
+{
+    writeFrame(PlaybackStoppedFrame::bytes, PlaybackStoppedFrame::size, TX_NOTIFY);
+}
 
-                uint8_t sum = iPod::checksum(_recv, _recvSize);
+void iPod::sendPlayStatusExtended(uint8_t status)
+{
+    const PlayStatusExtendedFrame resp(IPOD_LINGO_EXTENDED_INTERFACE,
+        0x00, IPOD_CMD_EXTENDED_INTERFACE_PLAY_STATUS_CHANGE_NOTIFICATION,
+        IPOD_PLAY_STATUS_NOTIFICATION_PLAYBACK_STATUS_EXTENDED, status);
 
-                if (sum == _recv[_recvSize])
-                    handlePacket(_recv, _recvSize);
-                else
-                    ESP_LOGE(TAG, "Checksum failed. Local: 0x%02X, Remote: 0x%02X", sum, _recv[_recvSize]);
-            }
-        }
+    writeFrame(resp.bytes, resp.len, TX_NOTIFY);
+}
 
-        _lastChar = c;
+uint32_t iPod::notifyMaskBit(NotifyEvent event)
+{
+    switch (event)
+    {
+        case NOTIFY_PLAY_STATE:
+            return IPOD_PLAY_STATUS_NOTIFICATION_MASK_BASIC_PLAY_STATE;
+        case NOTIFY_PLAY_STATE_EXTENDED:
+            return IPOD_PLAY_STATUS_NOTIFICATION_MASK_EXTENDED_PLAY_STATE;
+        case NOTIFY_TRACK_INDEX:
+            return IPOD_PLAY_STATUS_NOTIFICATION_MASK_TRACK_INDEX;
+        case NOTIFY_TRACK_TIME_MS:
+            return IPOD_PLAY_STATUS_NOTIFICATION_MASK_TRACK_TIME_OFFSET_MS;
+        case NOTIFY_TRACK_TIME_SEC:
+            return IPOD_PLAY_STATUS_NOTIFICATION_MASK_TRACK_TIME_OFFSET_SEC;
+        default:
+            return 0;
     }
+}
 
-    // notifications
-    if (_playStatusNotificationTimer < millis() && _playStatusNotifications)
+uint32_t iPod::notifyValue(NotifyEvent event, bt_app_clock_state_t state, uint32_t pos)
+{
+    switch (event)
     {
-        // postpone timer
-        _playStatusNotificationTimer = millis() + PLAY_STATUS_NOTIFICATION_INTERVAL;
-
-        sendTrackTimeOffsetMS(2500);
+        case NOTIFY_TRACK_INDEX:
+            // one track playlist, a new generation is a new track at index 0
+            return bt_app_meta_generation();
+        case NOTIFY_TRACK_TIME_MS:
+            return pos;
+        case NOTIFY_TRACK_TIME_SEC:
+            return pos / 1000;
+        default:
+            return state;
     }
 }
 
-void iPod::send(const uint8_t* data, uint32_t len)
+uint32_t iPod::notifyDue(NotifyEvent event, uint32_t value, bt_app_clock_state_t state, uint32_t pos, uint32_t now) const
 {
-    _ser.write(0xFF); // sync
-    _ser.write(0x55); // header
-    _ser.write(uint8_t(len));
-    _ser.write(data, len);
-    _ser.write(iPod::checksum(data, len));
+    const Notifier& n = _notify[event];
+    bool playing = state == BT_APP_CLOCK_PLAYING;
+    bool changed = value != n.value;
+    uint32_t due = UINT32_MAX;
+
+    if (event == NOTIFY_TRACK_TIME_MS && playing)
+    {
+        // a running offset is refreshed on the interval, between refreshes only a seek counts
+        uint32_t expected = n.value + (now - n.sentAt);
+        changed = uint32_t(abs(int32_t(value - expected))) > PLAY_STATUS_NOTIFICATION_JUMP_MS;
+        due = n.sentAt + PLAY_STATUS_NOTIFICATION_INTERVAL;
+    }
+    else if (event == NOTIFY_TRACK_TIME_SEC && playing)
+    {
+        // wake when the next whole second starts
+        due = now + 1000 - pos % 1000;
+    }
+
+    // rate limit, a change right after a send waits for the next slot
+    if (changed && n.sentAt + PLAY_STATUS_NOTIFICATION_MIN_GAP < due)
+        due = n.sentAt + PLAY_STATUS_NOTIFICATION_MIN_GAP;
+
+    return due;
 }
 
-void iPod::sendExtendedInterfaceACK(uint8_t error, uint8_t cmd)
+void iPod::sendNotification(NotifyEvent event, uint32_t value)
 {
-    const uint8_t resp[] = {
-        IPOD_LINGO_EXTENDED_INTERFACE,
-        0x00, IPOD_CMD_EXTENDED_INTERFACE_ACK,
-        error,
-        0x00, cmd
-    };
-
-    send(resp, sizeof(resp));
+    switch (event)
+    {
+        case NOTIFY_PLAY_STATE:
+            // the basic form only reports stopping
+            if (value != BT_APP_CLOCK_STOPPED)
+                return;
+            sendPlaybackStopped();
+            break;
+        case NOTIFY_PLAY_STATE_EXTENDED:
+            if (value == BT_APP_CLOCK_PLAYING)
+                sendPlayStatusExtended(IPOD_PLAY_STATUS_EXTENDED_PLAYING);
+            else if (value == BT_APP_CLOCK_PAUSED)
+                sendPlayStatusExtended(IPOD_PLAY_STATUS_EXTENDED_PAUSED);
+            else
+                sendPlayStatusExtended(IPOD_PLAY_STATUS_EXTENDED_STOPPED);
+            break;
+        case NOTIFY_TRACK_INDEX:
+            sendTrackIndex(0);
+            break;
+        case NOTIFY_TRACK_TIME_MS:
+            sendTrackTimeOffsetMS(value);
+            break;
+        case NOTIFY_TRACK_TIME_SEC:
+            sendTrackTimeOffsetSec(value);
+            break;
+        default:
+            return;
+    }
+
+    _notifySent++;
+}
+
+void iPod::runNotifications()
+{
+    if (_notifyMask == 0)
+        return;
+
+    uint32_t now = millis();
+    bt_app_clock_state_t state = bt_app_clock_state();
+    uint32_t pos = bt_app_clock_position_ms();
+
+    for (uint8_t e = 0; e < NOTIFY_EVENTS; ++e)
+    {
+        NotifyEvent event = NotifyEvent(e);
+        Notifier& n = _notify[e];
+
+        if (!(_notifyMask & notifyMaskBit(event)))
+            continue;
+
+        uint32_t value = notifyValue(event, state, pos);
+
+        if (notifyDue(event, value, state, pos, now) <= now)
+        {
+            sendNotification(event, value);
+            n.value = value;
+            n.sentAt = now;
+        }
+
+        n.due = notifyDue(event, value, state, pos, now);
+    }
+}
+
+uint8_t iPod::playerState()
+{
+    switch (bt_app_clock_state())
+    {
+        case BT_APP_CLOCK_PLAYING:
+            return IPOD_PLAYER_STATE_PLAYING;
+        case BT_APP_CLOCK_PAUSED:
+            return IPOD_PLAYER_STATE_PAUSED;
+        default:
+            return IPOD_PLAYER_STATE_STOPPED;
+    }
+}
+
+void iPod::begin(uint32_t baud)
+{
+    _baudIndex = loadBaud(baud);
+    baud = autobaudRates[_baudIndex];
+
+    uart_config_t config = {};
+    config.baud_rate = baud;
+    config.data_bits = UART_DATA_8_BITS;
+    config.parity = UART_PARITY_DISABLE;
+    config.stop_bits = UART_STOP_BITS_1;
+    config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+
+    ESP_ERROR_CHECK(uart_param_config(_port, &config));
+    ESP_ERROR_CHECK(uart_set_pin(_port, IPOD_UART_TX_PIN, IPOD_UART_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+    ESP_ERROR_CHECK(uart_driver_install(_port, IPOD_UART_RX_BUF_SIZE, IPOD_UART_TX_BUF_SIZE, IPOD_UART_EVENT_QUEUE_LEN, &_uartQueue, 0));
+    _baud = baud;
+
+    // The pattern detector only matches runs of one character, so it cannot see 0xFF 0x55.
+    // A short rx timeout delivers each request as soon as the head unit stops sending
+    uart_intr_config_t intr = {};
+    intr.intr_enable_mask = UART_RXFIFO_FULL_INT_ENA_M | UART_RXFIFO_TOUT_INT_ENA_M | UART_FRM_ERR_INT_ENA_M |
+                            UART_RXFIFO_OVF_INT_ENA_M | UART_BRK_DET_INT_ENA_M | UART_PARITY_ERR_INT_ENA_M;
+    intr.rx_timeout_thresh = IPOD_UART_RX_TIMEOUT;
+    intr.txfifo_empty_intr_thresh = 10;
+    intr.rxfifo_full_thresh = IPOD_UART_RXFIFO_FULL_THRESH;
+    ESP_ERROR_CHECK(uart_intr_config(_port, &intr));
+
+    ESP_LOGI(TAG, "UART%d at %u baud, rx timeout %d symbols", _port, baud, IPOD_UART_RX_TIMEOUT);
+
+    clockListener = this;
+    bt_app_clock_register_callback(&onClockChanged);
+}
+
+uint8_t iPod::loadBaud(uint32_t baud)
+{
+    nvs_handle handle;
+    uint32_t stored = 0;
+
+    if (nvs_open(IPOD_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+    {
+        nvs_get_u32(handle, IPOD_NVS_KEY_BAUD, &stored);
+        nvs_close(handle);
+    }
+
+    uint8_t index = 0;
+    for (uint8_t i = 0; i < AUTOBAUD_RATES; ++i)
+    {
+        if (autobaudRates[i] == stored)
+            return i;
+        if (autobaudRates[i] == baud)
+            index = i;
+    }
+
+    return index;
+}
+
+void iPod::storeBaud(uint32_t baud)
+{
+    nvs_handle handle;
+    uint32_t stored = 0;
+
+    esp_err_t err = nvs_open(IPOD_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "NVS open failed: %d", err);
+        return;
+    }
+
+    // spare the flash when the head unit is the same as last time
+    if (nvs_get_u32(handle, IPOD_NVS_KEY_BAUD, &stored) != ESP_OK || stored != baud)
+    {
+        err = nvs_set_u32(handle, IPOD_NVS_KEY_BAUD, baud);
+        if (err == ESP_OK)
+            err = nvs_commit(handle);
+        if (err != ESP_OK)
+            ESP_LOGE(TAG, "Storing baud rate failed: %d", err);
+    }
+
+    nvs_close(handle);
+}
+
+void iPod::setBaud(uint8_t index)
+{
+    _baudIndex = index;
+    _baud = autobaudRates[index];
+
+    ESP_ERROR_CHECK(uart_set_baudrate(_port, _baud));
+    // whatever is buffered or reported was sampled at the old rate
+    uart_flush_input(_port);
+    xQueueReset(_uartQueue);
+    resync();
+
+    _autobaudTimer = 0;
+    _baudSwitches++;
+
+    ESP_LOGD(TAG, "Autobaud: trying %u baud", _baud);
+}
+
+uint32_t iPod::rxErrors() const
+{
+    return _rxChecksumErrors + _rxResyncs + _rxLineErrors;
+}
+
+int64_t iPod::frameGapUs() const
+{
+    int64_t fills = 2LL * IPOD_UART_RXFIFO_FULL_THRESH * 10 * 1000000 / _baud;
+
+    return fills > IPOD_FRAME_GAP_MS * 1000LL ? fills : IPOD_FRAME_GAP_MS * 1000LL;
+}
+
+void iPod::autobaud()
+{
+    uint32_t frames = _rxFrames - _baudFramesSeen;
+    uint32_t errors = rxErrors() - _baudErrorsSeen;
+    uint32_t bytes = _rxBytes - _baudBytesSeen;
+
+    _baudFramesSeen = _rxFrames;
+    _baudErrorsSeen = rxErrors();
+    _baudBytesSeen = _rxBytes;
+
+    if (frames)
+    {
+        _baudBadRun = 0;
+        _autobaudTimer = 0;
+
+        if (!_baudLocked)
+        {
+            _baudLocked = true;
+            ESP_LOGI(TAG, "Autobaud: locked at %u baud after %u switches", _baud, _baudSwitches);
+            storeBaud(_baud);
+        }
+        return;
+    }
+
+    if (_baudLocked)
+    {
+        // the head unit restarted at another rate, or the line is bad
+        _baudBadRun += errors;
+        if (_baudBadRun < IPOD_AUTOBAUD_MAX_ERRORS)
+            return;
+
+        ESP_LOGW(TAG, "Autobaud: %u errors without a frame at %u baud, searching", _baudBadRun, _baud);
+        _baudLocked = false;
+        _baudBadRun = 0;
+    }
+    else if ((bytes || errors) && _autobaudTimer == 0)
+    {
+        // traffic, give a whole frame time to arrive. Garbage may be a single noise run, so any byte counts
+        _autobaudTimer = millis() + IPOD_AUTOBAUD_WINDOW_MS;
+        return;
+    }
+    else if (_autobaudTimer == 0 || _autobaudTimer >= millis())
+        return;
+
+    setBaud((_baudIndex + 1) % AUTOBAUD_RATES);
+    _baudErrorsSeen = rxErrors();
+}
+
+void iPod::wake()
+{
+    // an event type the driver never posts, update() then only runs the timers
+    uart_event_t event = {};
+    event.type = UART_EVENT_MAX;
+
+    xQueueSend(_uartQueue, &event, 0);
+}
+
+uint32_t iPod::msUntilTimer() const
+{
+    uint32_t now = millis();
+    uint32_t due = _responseStatsTimer < _commandStatsTimer ? _responseStatsTimer : _commandStatsTimer;
+
+    if (_notifyMask)
+    {
+        for (const auto& n : _notify)
+            if (n.due < due)
+                due = n.due;
+    }
+
+    if (!_baudLocked && _autobaudTimer && _autobaudTimer < due)
+        due = _autobaudTimer;
+
+    uint32_t ms = due > now ? due - now : 0;
+    uint32_t tx = txDrainMs();
+
+    return tx < ms ? tx : ms;
+}
+
+void iPod::update()
+{
+    uart_event_t event;
+
+    // round up, a wait shorter than a tick would spin until the timer is due
+    TickType_t ticks = (msUntilTimer() + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+    bool received = xQueueReceive(_uartQueue, &event, ticks) == pdTRUE;
+
+    int64_t now = esp_timer_get_time();
+    _wakes++;
+
+    if (received)
+    {
+        switch (event.type)
+        {
+            case UART_DATA:
+            {
+                uint8_t buf[UART_FIFO_LEN];
+                int n;
+
+                while ((n = uart_read_bytes(_port, buf, sizeof(buf), 0)) > 0)
+                    receive(buf, n, now);
+                break;
+            }
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+            {
+                ESP_LOGW(TAG, "UART rx overflow, dropping buffered input");
+                _rxOverflows++;
+                uart_flush_input(_port);
+                xQueueReset(_uartQueue);
+                break;
+            }
+            case UART_FRAME_ERR:
+            case UART_PARITY_ERR:
+                // a wrong baud rate shows up here first
+                _rxLineErrors++;
+                break;
+            case UART_EVENT_MAX:
+                // posted by wake()
+                break;
+            default:
+                ESP_LOGD(TAG, "UART event: %d", event.type);
+                break;
+        }
+    }
+
+    autobaud();
+    runNotifications();
+
+    pumpTx();
+
+    if (_responseStatsTimer < millis())
+    {
+        _responseStatsTimer = millis() + RESPONSE_STATS_INTERVAL;
+
+        ESP_LOGI(TAG, "Response cache: %u hits, %u misses, worst request to reply %u us", _cacheHits, _cacheMisses, _responseUsMax);
+        ESP_LOGI(TAG, "UART link: %u wakes, %u us awake in %u ms, %u rx overflows", _wakes, _busyUs, RESPONSE_STATS_INTERVAL, _rxOverflows);
+        ESP_LOGI(TAG, "Parser: %u frames, %u checksum errors, %u resyncs, %u image bytes dropped",
+            _rxFrames, _rxChecksumErrors, _rxResyncs, _imageSink.bytes());
+        ESP_LOGI(TAG, "RX: %u baud%s, %u frames/s, %u bytes/s, %u line errors, %u rate switches",
+            _baud, _baudLocked ? "" : " (searching)", (_rxFrames - _statsRxFrames) * 1000 / RESPONSE_STATS_INTERVAL,
+            (_rxBytes - _statsRxBytes) * 1000 / RESPONSE_STATS_INTERVAL, _rxLineErrors, _baudSwitches);
+
+        _txBytesPerSec = uint32_t(uint64_t(_txBytes) * 1000 / RESPONSE_STATS_INTERVAL);
+        ESP_LOGI(TAG, "TX: %u bytes/s, queued %u bytes (max %u), %u frames dropped", _txBytesPerSec, txQueueDepth(), _txDepthMax, _txDropped);
+
+        ESP_LOGI(TAG, "Notifications: mask 0x%08X, %u sent", _notifyMask, _notifySent);
+
+        _txBytes = 0;
+        _statsRxFrames = _rxFrames;
+        _statsRxBytes = _rxBytes;
+        _notifySent = 0;
+
+        _wakes = 0;
+        _busyUs = 0;
+    }
+
+    if (_commandStatsTimer < millis())
+    {
+        _commandStatsTimer = millis() + COMMAND_STATS_INTERVAL;
+
+        dumpCommandStats();
+    }
+
+    _busyUs += uint32_t(esp_timer_get_time() - now);
+}
+
+uint32_t iPod::headerSize(uint8_t lingo)
+{
+    // the extended interface lingo has 16 bit commands
+    return lingo == IPOD_LINGO_EXTENDED_INTERFACE ? 3 : 2;
+}
+
+bool iPod::setSink(uint8_t lingo, uint16_t cmd, iPodSink* sink)
+{
+    if (_sinkCount == MAX_SINKS)
+        return false;
+
+    _sinks[_sinkCount++] = { lingo, cmd, sink };
+    return true;
+}
+
+void iPod::resync()
+{
+    if (_rxSink)
+        _rxSink->end(false);
+
+    _rxSink = nullptr;
+    _rxState = RX_SYNC;
+    _rxResyncs++;
+}
+
+void iPod::startPayload()
+{
+    ESP_LOGD(TAG, "Begin receiving. Len: %u", _rxLen);
+
+    _recvItr = 0;
+    _rxDone = 0;
+    _rxState = RX_PAYLOAD;
+}
+
+void iPod::endFrame(uint8_t checksum)
+{
+    bool ok = uint8_t(_rxSum + checksum) == 0;
+
+    if (_rxSink)
+        _rxSink->end(ok);
+
+    if (!ok)
+    {
+        _rxChecksumErrors++;
+        ESP_LOGE(TAG, "Checksum failed. Len: %u, Remote: 0x%02X", _rxLen, checksum);
+    }
+    else if (!_rxSink && _rxLen > MAX_PACKET_SIZE)
+    {
+        _rxFrames++;
+        ESP_LOGW(TAG, "Dropped %u byte frame, lingo 0x%02X has no sink for it", _rxLen, _recv[0]);
+    }
+    else
+    {
+        _rxFrames++;
+
+        // a streamed command is handled with its header only, the sink has the rest
+        _requestPending = true;
+        handlePacket(_recv, _recvItr);
+        _requestPending = false;
+    }
+
+    _rxSink = nullptr;
+}
+
+void iPod::receive(const uint8_t* data, uint32_t len, int64_t rxUs)
+{
+    if (rxUs - _rxLastUs > frameGapUs())
+    {
+        // a frame is sent in one burst, a gap inside one means bytes were lost
+        if (_rxState != RX_SYNC)
+        {
+            ESP_LOGW(TAG, "Frame interrupted after %u of %u bytes", _rxDone, _rxLen);
+            resync();
+        }
+
+        // garbage after a pause is a new run, autobaud counts the runs
+        _rxNoise = false;
+    }
+    _rxLastUs = rxUs;
+    _rxBytes += len;
+
+    for (uint32_t i = 0; i < len; ++i)
+    {
+        uint8_t c = data[i];
+
+        switch (_rxState)
+        {
+            case RX_SYNC:
+            {
+                if (c == 0xFF)
+                    _rxState = RX_START;
+                else if (!_rxNoise)
+                {
+                    // count a run of garbage once
+                    _rxNoise = true;
+                    _rxResyncs++;
+                }
+                break;
+            }
+            case RX_START:
+            {
+                if (c == 0x55)
+                {
+                    _rxNoise = false;
+                    _rxState = RX_LENGTH;
+                    _requestUs = rxUs;
+                }
+                else if (c != 0xFF)
+                {
+                    _rxNoise = true;
+                    resync();
+                }
+                break;
+            }
+            case RX_LENGTH:
+            {
+                _rxSum = c;
+
+                if (c == 0x00)
+                    _rxState = RX_LENGTH_HI;
+                else
+                {
+                    _rxLen = c;
+                    startPayload();
+                }
+                break;
+            }
+            case RX_LENGTH_HI:
+            {
+                _rxSum += c;
+                _rxLen = uint32_t(c) << 8;
+                _rxState = RX_LENGTH_LO;
+                break;
+            }
+            case RX_LENGTH_LO:
+            {
+                _rxSum += c;
+                _rxLen |= c;
+
+                if (_rxLen == 0)
+                    resync();
+                else
+                    startPayload();
+                break;
+            }
+            case RX_PAYLOAD:
+            {
+                _recv[_recvItr++] = c;
+                _rxSum += c;
+                _rxDone++;
+
+                if (_rxDone == _rxLen)
+                {
+                    _rxState = RX_CHECKSUM;
+                    break;
+                }
+                if (_recvItr != headerSize(_recv[0]))
+                    break;
+
+                // the command is known, from here on the parameters may go to a sink
+                uint16_t cmd = _recv[0] == IPOD_LINGO_EXTENDED_INTERFACE ? (_recv[1] << 8) | _recv[2] : _recv[1];
+
+                for (uint8_t s = 0; s < _sinkCount; ++s)
+                {
+                    if (_sinks[s].lingo == _recv[0] && _sinks[s].cmd == cmd)
+                    {
+                        _rxSink = _sinks[s].sink;
+                        _rxSink->begin(_rxLen - _rxDone);
+                        _rxState = RX_STREAM;
+                        break;
+                    }
+                }
+
+                if (_rxState == RX_PAYLOAD && _rxLen > MAX_PACKET_SIZE)
+                    _rxState = RX_DISCARD;
+                break;
+            }
+            case RX_STREAM:
+            case RX_DISCARD:
+            {
+                // take as much of this chunk as belongs to the frame
+                uint32_t n = _rxLen - _rxDone;
+                if (n > len - i)
+                    n = len - i;
+
+                for (uint32_t k = 0; k < n; ++k)
+                    _rxSum += data[i+k];
+
+                if (_rxSink)
+                    _rxSink->data(data+i, n);
+
+                _rxDone += n;
+                i += n - 1;
+
+                if (_rxDone == _rxLen)
+                    _rxState = RX_CHECKSUM;
+                break;
+            }
+            case RX_CHECKSUM:
+            {
+                endFrame(c);
+                _rxState = RX_SYNC;
+                break;
+            }
+        }
+    }
+}
+
+uint32_t iPod::frame(const uint8_t* data, uint32_t len, uint8_t* out)
+{
+    uint8_t sum = uint8_t(len);
+
+    out[0] = 0xFF; // sync
+    out[1] = 0x55; // header
+    out[2] = uint8_t(len);
+
+    // checksum while copying
+    for (uint32_t i = 0; i < len; ++i)
+    {
+        out[3+i] = data[i];
+        sum += data[i];
+    }
+    out[3+len] = uint8_t(0x100 - sum);
+
+    return 3+len+1;
+}
+
+uint32_t iPod::txQueueDepth() const
+{
+    uint32_t depth = 0;
+
+    for (const auto& q : _tx)
+        depth += q.head - q.tail;
+
+    return depth;
+}
+
+bool iPod::txPush(TxPriority prio, const uint8_t* data, uint32_t len)
+{
+    TxQueue& q = _tx[prio];
+
+    if (IPOD_TX_QUEUE_SIZE - (q.head - q.tail) < len+2)
+        return false;
+
+    q.buf[q.head++ & (IPOD_TX_QUEUE_SIZE-1)] = uint8_t(len >> 8);
+    q.buf[q.head++ & (IPOD_TX_QUEUE_SIZE-1)] = uint8_t(len);
+    for (uint32_t i = 0; i < len; ++i)
+        q.buf[q.head++ & (IPOD_TX_QUEUE_SIZE-1)] = data[i];
+
+    uint32_t depth = txQueueDepth();
+    if (depth > _txDepthMax)
+        _txDepthMax = depth;
+
+    return true;
+}
+
+uint32_t iPod::txPeek(TxPriority prio) const
+{
+    const TxQueue& q = _tx[prio];
+
+    if (q.head == q.tail)
+        return 0;
+
+    return (q.buf[q.tail & (IPOD_TX_QUEUE_SIZE-1)] << 8) | q.buf[(q.tail+1) & (IPOD_TX_QUEUE_SIZE-1)];
+}
+
+void iPod::pumpTx()
+{
+    // account for what the UART shifted out since the last look, 10 bits per byte
+    int64_t now = esp_timer_get_time();
+    uint32_t sent = uint32_t((now - _txInflightUs) * (_baud / 10) / 1000000);
+
+    if (sent >= _txInflight)
+    {
+        _txInflight = 0;
+        _txInflightUs = now;
+    }
+    else
+    {
+        _txInflight -= sent;
+        _txInflightUs += int64_t(sent) * 1000000 / (_baud / 10);
+    }
+
+    for (uint8_t p = 0; p < TX_PRIORITIES; )
+    {
+        uint32_t len = txPeek(TxPriority(p));
+
+        if (len == 0)
+        {
+            p++;
+            continue;
+        }
+
+        // lower priorities wait too, a reply queued meanwhile must not end up behind them
+        if (_txInflight + len > IPOD_TX_WINDOW)
+            break;
+
+        TxQueue& q = _tx[p];
+        uint8_t buf[MAX_FRAME_SIZE];
+
+        if (p == TX_REPLY && _replyMarkHead != _replyMarkTail && _replyMarks[_replyMarkTail % IPOD_TX_REPLY_MARKS].pos == q.tail)
+        {
+            // the first reply byte goes out once everything already in the driver has
+            const ReplyMark& mark = _replyMarks[_replyMarkTail++ % IPOD_TX_REPLY_MARKS];
+            int64_t firstByteUs = now + int64_t(_txInflight) * 10 * 1000000 / _baud;
+            uint32_t us = uint32_t(firstByteUs - mark.requestUs);
+
+            if (us > _responseUsMax)
+                _responseUsMax = us;
+        }
+
+        q.tail += 2;
+        for (uint32_t i = 0; i < len; ++i)
+            buf[i] = q.buf[q.tail++ & (IPOD_TX_QUEUE_SIZE-1)];
+
+        // the window keeps the driver ring from filling, so this only copies
+        uart_write_bytes(_port, (const char*)buf, len);
+        _txInflight += len;
+        _txBytes += len;
+    }
+}
+
+uint32_t iPod::txDrainMs() const
+{
+    for (uint8_t p = 0; p < TX_PRIORITIES; ++p)
+    {
+        uint32_t len = txPeek(TxPriority(p));
+
+        if (len == 0)
+            continue;
+
+        if (_txInflight + len <= IPOD_TX_WINDOW)
+            return 0;
+
+        uint32_t excess = _txInflight + len - IPOD_TX_WINDOW;
+        return (excess * 10 * 1000 + _baud - 1) / _baud;
+    }
+
+    return UINT32_MAX;
+}
+
+void iPod::writeFrame(const uint8_t* data, uint32_t len, TxPriority prio)
+{
+    uint32_t pos = _tx[prio].head;
+
+    if (!txPush(prio, data, len))
+    {
+        _txDropped++;
+        ESP_LOGW(TAG, "TX queue full, dropped %u byte frame", len);
+    }
+    else if (_requestPending && prio == TX_REPLY)
+    {
+        // the first reply to a request is timed when pumpTx hands it to the driver. With all
+        // marks taken the request goes unmeasured, those ahead already saw the same backlog
+        if (uint8_t(_replyMarkHead - _replyMarkTail) < IPOD_TX_REPLY_MARKS)
+        {
+            ReplyMark& mark = _replyMarks[_replyMarkHead++ % IPOD_TX_REPLY_MARKS];
+            mark.pos = pos;
+            mark.requestUs = _requestUs;
+        }
+    }
+
+    if (prio == TX_REPLY)
+        _requestPending = false;
+
+    pumpTx();
+}
+
+void iPod::send(const uint8_t* data, uint32_t len, TxPriority prio)
+{
+    uint8_t buf[MAX_FRAME_SIZE];
+
+    writeFrame(buf, frame(data, len, buf), prio);
+}
+
+bool iPod::sendCached(CacheSlot slot, uint32_t key)
+{
+    const CachedResponse& entry = _cache[slot];
+
+    if (!entry.valid || entry.key != key)
+    {
+        _cacheMisses++;
+        return false;
+    }
+
+    _cacheHits++;
+    writeFrame(entry.frame, entry.len);
+    return true;
+}
+
+void iPod::sendAndCache(CacheSlot slot, uint32_t key, const uint8_t* frame, uint32_t len)
+{
+    CachedResponse& entry = _cache[slot];
+
+    memcpy(entry.frame, frame, len);
+    entry.len = len;
+    entry.key = key;
+    entry.valid = true;
+
+    writeFrame(entry.frame, entry.len);
+}
+
+void iPod::sendExtendedInterfaceACK(uint8_t error, uint8_t cmd)
+{
+    sendAck(IPOD_LINGO_EXTENDED_INTERFACE, error, cmd);
+}
+
+void iPod::sendAck(uint8_t lingo, uint8_t error, uint16_t cmd)
+{
+    if (error != IPOD_ERROR_OK)
+        _nackSent = true;
+
+    switch (lingo)
+    {
+        case IPOD_LINGO_GENERAL:
+        {
+            const AckFrame resp(IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_ACK, error, uint8_t(cmd));
+
+            writeFrame(resp.bytes, resp.len);
+            break;
+        }
+        case IPOD_LINGO_DISPLAY_REMOTE:
+        {
+            const AckFrame resp(IPOD_LINGO_DISPLAY_REMOTE, IPOD_CMD_DISPLAY_REMOTE_ACK, error, uint8_t(cmd));
+
+            writeFrame(resp.bytes, resp.len);
+            break;
+        }
+        case IPOD_LINGO_EXTENDED_INTERFACE:
+        {
+            const ExtendedInterfaceAckFrame resp(IPOD_LINGO_EXTENDED_INTERFACE,
+                0x00, IPOD_CMD_EXTENDED_INTERFACE_ACK,
+                error,
+                uint8_t(cmd >> 8), uint8_t(cmd));
+
+            writeFrame(resp.bytes, resp.len);
+            break;
+        }
+        default:
+            // no ACK command known for this lingo
+            break;
+    }
 }
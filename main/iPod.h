@@ -2,11 +2,76 @@
 #define _IPOD_H_
 
 #include "Arduino.h"
+#include "driver/uart.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "bt_app_clock.h"
 #include <string>
 
+// payloads up to this size are buffered whole, larger ones need a sink
 #define MAX_PACKET_SIZE 300
 
+// sinks that can be attached to commands
+#define MAX_SINKS 4
+
+// a pause this long inside a frame means bytes were lost. Never shorter than two fifo fills at the current rate
+#define IPOD_FRAME_GAP_MS 100
+
+// sync, header, length, up to 255 bytes of payload, checksum
+#define MAX_FRAME_SIZE (3 + 255 + 1)
+
+// play status notifications: time offset in ms at most this often while playing
 #define PLAY_STATUS_NOTIFICATION_INTERVAL 500
+// spacing of notifications of the same event, later changes wait for the next slot
+#define PLAY_STATUS_NOTIFICATION_MIN_GAP 100
+// a time offset further than this from the one the head unit extrapolates is sent at once
+#define PLAY_STATUS_NOTIFICATION_JUMP_MS 1000
+
+#define RESPONSE_STATS_INTERVAL 10000
+
+// per command statistics are logged this often
+#define COMMAND_STATS_INTERVAL 60000
+
+// handled commands, and unhandled or reply (lingo, command) pairs counted separately
+#define MAX_COMMANDS 40
+#define MAX_UNKNOWN_COMMANDS 16
+
+// command table entry without a handler
+#define NO_COMMAND 0xFF
+// command table entry for an ACK or response from the head unit, counted but never NACKed
+#define REPLY_COMMAND 0xFE
+
+// dock connector on UART2, same pins as the Arduino Serial2 defaults
+#define IPOD_UART_NUM UART_NUM_2
+#define IPOD_UART_TX_PIN 17
+#define IPOD_UART_RX_PIN 16
+// first rate tried when none is stored, autobaud moves on from here
+#define IPOD_UART_BAUD 57600
+#define IPOD_UART_RX_BUF_SIZE 1024
+#define IPOD_UART_EVENT_QUEUE_LEN 16
+
+// symbol times of line idle before the driver hands over a partly filled fifo
+#define IPOD_UART_RX_TIMEOUT 2
+// bytes in the rx fifo before the driver hands them over. At 9600 baud filling it takes 125 ms
+#define IPOD_UART_RXFIFO_FULL_THRESH 120
+
+// driver TX ring. At most IPOD_TX_WINDOW bytes are handed to it, so the priority queues decide the order
+#define IPOD_UART_TX_BUF_SIZE 1024
+#define IPOD_TX_WINDOW 512
+
+// frames waiting per priority, each with a 2 byte length. Must be a power of two
+#define IPOD_TX_QUEUE_SIZE 2048
+// replies queued at once whose request to first reply byte time is still being measured
+#define IPOD_TX_REPLY_MARKS 4
+
+// autobaud: a rate that sees traffic but no valid frame for this long is left for the next one
+#define IPOD_AUTOBAUD_WINDOW_MS 250
+// a locked rate is given up after this many parser or line errors without a valid frame
+#define IPOD_AUTOBAUD_MAX_ERRORS 4
+
+// the locked rate is kept across restarts
+#define IPOD_NVS_NAMESPACE "ipod"
+#define IPOD_NVS_KEY_BAUD "baud"
 
 enum IPOD_LINGO : uint8_t
 {
@@ -27,19 +92,25 @@ enum IPOD_LINGO : uint8_t
 
 enum IPOD_CMD_GENERAL : uint8_t
 {
-    IPOD_CMD_GENERAL_ACK                        = 0x02,
-    IPOD_CMD_GENERAL_ENTER_REMOTE_UI_MODE       = 0x05,
-    IPOD_CMD_GENERAL_REQUEST_IPOD_MODEL_NUM     = 0x0D,
-    IPOD_CMD_GENERAL_RETURN_IPOD_MODEL_NUM      = 0x0E,
-    IPOD_CMD_GENERAL_IDENTIFY_DEVICE_LINGOES    = 0x13,
-    IPOD_CMD_GENERAL_GET_ACCESSORY_INFO         = 0x27,
-    IPOD_CMD_GENERAL_RET_ACCESSORY_INFO         = 0x28
+    IPOD_CMD_GENERAL_ACK                              = 0x02,
+    IPOD_CMD_GENERAL_ENTER_REMOTE_UI_MODE             = 0x05,
+    IPOD_CMD_GENERAL_REQUEST_IPOD_MODEL_NUM           = 0x0D,
+    IPOD_CMD_GENERAL_RETURN_IPOD_MODEL_NUM            = 0x0E,
+    IPOD_CMD_GENERAL_IDENTIFY_DEVICE_LINGOES          = 0x13,
+    IPOD_CMD_GENERAL_RET_DEV_AUTHENTICATION_INFO      = 0x15,
+    IPOD_CMD_GENERAL_RET_DEV_AUTHENTICATION_SIGNATURE = 0x18,
+    IPOD_CMD_GENERAL_GET_ACCESSORY_INFO               = 0x27,
+    IPOD_CMD_GENERAL_RET_ACCESSORY_INFO               = 0x28
 };
 
 enum IPOD_CMD_DISPLAY_REMOTE : uint8_t
 {
     IPOD_CMD_DISPLAY_REMOTE_ACK                             = 0x00,
+    IPOD_CMD_DISPLAY_REMOTE_GET_CURRENT_EQ_PROFILE_INDEX    = 0x01,
+    IPOD_CMD_DISPLAY_REMOTE_RET_CURRENT_EQ_PROFILE_INDEX    = 0x02,
     IPOD_CMD_DISPLAY_REMOTE_SET_CURRENT_EQ_PROFILE_INDEX    = 0x03,
+    IPOD_CMD_DISPLAY_REMOTE_GET_NUM_EQ_PROFILES             = 0x04,
+    IPOD_CMD_DISPLAY_REMOTE_RET_NUM_EQ_PROFILES             = 0x05,
 };
 
 enum IPOD_CMD_EXTENDED_INTERFACE : uint8_t
@@ -111,6 +182,36 @@ enum IPOD_PLAY_STATUS_NOTIFICATION : uint8_t
     IPOD_PLAY_STATUS_NOTIFICATION_TRACK_LYRICS_READY                = 0x0C,
 };
 
+// 4 byte form of SetPlayStatusChangeNotification
+enum IPOD_PLAY_STATUS_NOTIFICATION_MASK : uint32_t
+{
+    IPOD_PLAY_STATUS_NOTIFICATION_MASK_BASIC_PLAY_STATE             = 1 << 0,
+    IPOD_PLAY_STATUS_NOTIFICATION_MASK_EXTENDED_PLAY_STATE          = 1 << 1,
+    IPOD_PLAY_STATUS_NOTIFICATION_MASK_TRACK_INDEX                  = 1 << 2,
+    IPOD_PLAY_STATUS_NOTIFICATION_MASK_TRACK_TIME_OFFSET_MS         = 1 << 3,
+    IPOD_PLAY_STATUS_NOTIFICATION_MASK_TRACK_TIME_OFFSET_SEC        = 1 << 4,
+    IPOD_PLAY_STATUS_NOTIFICATION_MASK_CHAPTER_INDEX                = 1 << 5,
+    IPOD_PLAY_STATUS_NOTIFICATION_MASK_CHAPTER_TIME_OFFSET_MS       = 1 << 6,
+    IPOD_PLAY_STATUS_NOTIFICATION_MASK_CHAPTER_TIME_OFFSET_SEC      = 1 << 7,
+    IPOD_PLAY_STATUS_NOTIFICATION_MASK_TRACK_UID                    = 1 << 8,
+    IPOD_PLAY_STATUS_NOTIFICATION_MASK_TRACK_MEDIA_TYPE             = 1 << 9,
+    IPOD_PLAY_STATUS_NOTIFICATION_MASK_TRACK_LYRICS_READY           = 1 << 10,
+
+    // what the 1 byte form enables
+    IPOD_PLAY_STATUS_NOTIFICATION_MASK_LEGACY                       = (1 << 0) | (1 << 2) | (1 << 3) | (1 << 5),
+};
+
+// data byte of IPOD_PLAY_STATUS_NOTIFICATION_PLAYBACK_STATUS_EXTENDED
+enum IPOD_PLAY_STATUS_EXTENDED : uint8_t
+{
+    IPOD_PLAY_STATUS_EXTENDED_STOPPED               = 0x02,
+    IPOD_PLAY_STATUS_EXTENDED_FF_SEEK_STARTED       = 0x05,
+    IPOD_PLAY_STATUS_EXTENDED_REW_SEEK_STARTED      = 0x06,
+    IPOD_PLAY_STATUS_EXTENDED_FF_REW_SEEK_STOPPED   = 0x07,
+    IPOD_PLAY_STATUS_EXTENDED_PLAYING               = 0x0A,
+    IPOD_PLAY_STATUS_EXTENDED_PAUSED                = 0x0B,
+};
+
 enum IPOD_PLAY_CONTROL : uint8_t
 {
     IPOD_PLAY_CONTROL_RESERVED                  = 0x00,
@@ -127,7 +228,7 @@ enum IPOD_PLAY_CONTROL : uint8_t
     IPOD_PLAY_CONTROL_PAUSE                     = 0x0B,
     IPOD_PLAY_CONTROL_NEXT_CHAPTER              = 0x0C,
     IPOD_PLAY_CONTROL_PREVIOUS_CHAPTER          = 0x0D
-}
+};
 
 enum IPOD_ERROR : uint8_t
 {
@@ -141,43 +242,356 @@ enum IPOD_ERROR : uint8_t
     // more errors exist
 };
 
+// Takes the parameters of one command as they arrive instead of having them buffered
+class iPodSink
+{
+public:
+    virtual ~iPodSink() {}
+
+    // len is the number of bytes after the command
+    virtual void begin(uint32_t len) = 0;
+    virtual void data(const uint8_t* data, uint32_t len) = 0;
+    // ok is false if the checksum failed, everything passed to data() must be dropped
+    virtual void end(bool ok) = 0;
+};
+
+// Checks and drops a payload without holding it in RAM, used for images since there is no display
+class iPodDiscardSink : public iPodSink
+{
+public:
+    iPodDiscardSink(): _bytes(0), _pending(0) {}
+
+    void begin(uint32_t len) override { _pending = 0; }
+    void data(const uint8_t* data, uint32_t len) override { _pending += len; }
+    void end(bool ok) override { if (ok) _bytes += _pending; }
+
+    uint32_t bytes() const { return _bytes; }
+
+private:
+    uint32_t _bytes;
+    uint32_t _pending;
+};
+
 class iPod
 {
 public:
-    iPod(HardwareSerial& ser);
+    // Replies are sent before anything the link sends on its own
+    enum TxPriority : uint8_t
+    {
+        TX_REPLY,
+        TX_NOTIFY,
+        TX_PRIORITIES
+    };
+
+    iPod(uart_port_t port);
+
+    // Installs the UART driver with an event queue. Starts at the rate stored in NVS, else at baud
+    void begin(uint32_t baud);
 
     // Calculates checksum. Length is not included in data
     static uint8_t checksum(const uint8_t* data, uint32_t len);
 
+    // Looks the command up in the dispatch table. Unknown or short commands are NACKed,
+    // ACKs and responses from the head unit are only counted
     void handlePacket(const uint8_t* data, uint32_t len);
-    void handleLingoGeneral(const uint8_t* data, uint32_t len);
-    void handleLingoDisplayRemote(const uint8_t* data, uint32_t len);
-    void handleLingoExtendedInterface(const uint8_t* data, uint32_t len);
+
+    // Logs calls, NACKs and handler time of every command seen so far
+    void dumpCommandStats() const;
 
     // events
     void sendTrackIndex(uint32_t index);
     void sendTrackTimeOffsetMS(uint32_t offset);
+    void sendTrackTimeOffsetSec(uint32_t offset);
+    void sendPlaybackStopped();
+    void sendPlayStatusExtended(uint8_t status);
+
+    // Wakes update() from another task, e.g. when the playback clock changed state
+    void wake();
 
+    // Maps the playback clock state to IPOD_PLAYER_STATE
+    static uint8_t playerState();
+
+    // Sleeps until the UART has data or a timer is due, then handles both
     void update();
 
-    void send(const uint8_t* data, uint32_t len);
+    // Feeds received bytes to the frame parser. rxUs is when they were picked up
+    void receive(const uint8_t* data, uint32_t len, int64_t rxUs);
+
+    // Streams the parameters of a command to sink. cmd is 16 bit on the extended interface lingo
+    bool setSink(uint8_t lingo, uint16_t cmd, iPodSink* sink);
+
+    // parser counters
+    uint32_t framesReceived() const { return _rxFrames; }
+    uint32_t checksumErrors() const { return _rxChecksumErrors; }
+    uint32_t resyncs() const { return _rxResyncs; }
+
+    // TX counters
+    uint32_t txQueueDepth() const;
+    uint32_t txBytesPerSecond() const { return _txBytesPerSec; }
+    uint32_t txDropped() const { return _txDropped; }
+
+    // Queues a frame, never blocks. A frame that does not fit is dropped
+    void send(const uint8_t* data, uint32_t len, TxPriority prio = TX_REPLY);
     void sendExtendedInterfaceACK(uint8_t error, uint8_t cmd);
+    // ACK in the format of the lingo. An error other than IPOD_ERROR_OK counts as a NACK
+    void sendAck(uint8_t lingo, uint8_t error, uint16_t cmd);
+
+    // Wraps a payload in sync, header, length and checksum. Returns the frame length
+    static uint32_t frame(const uint8_t* data, uint32_t len, uint8_t* out);
+
+    // response cache
+    uint32_t cacheHits() const { return _cacheHits; }
+    uint32_t cacheMisses() const { return _cacheMisses; }
+    uint32_t responseUsMax() const { return _responseUsMax; }
 
 private:
-    HardwareSerial& _ser;
+    friend struct iPodDispatch;
+
+    typedef void (iPod::*Handler)(const uint8_t* data, uint32_t len);
+
+    struct Command
+    {
+        uint8_t lingo;
+        uint8_t cmd;
+        uint8_t minLen;
+        Handler handler;
+        const char* name;
+    };
+
+    struct CommandStats
+    {
+        uint32_t calls;
+        uint32_t nacks;
+        uint32_t usMax;
+        uint64_t usTotal;
+    };
+
+    struct UnknownCommand
+    {
+        uint8_t lingo;
+        uint16_t cmd;
+        bool reply;
+        uint32_t calls;
+    };
+
+    void countUnknown(uint8_t lingo, uint16_t cmd, bool reply);
+
+    // general lingo
+    void handleEnterRemoteUIMode(const uint8_t* data, uint32_t len);
+    void handleRequestiPodModelNum(const uint8_t* data, uint32_t len);
+    void handleIdentifyDeviceLingoes(const uint8_t* data, uint32_t len);
+
+    // display remote lingo
+    void handleGetCurrentEQProfileIndex(const uint8_t* data, uint32_t len);
+    void handleSetCurrentEQProfileIndex(const uint8_t* data, uint32_t len);
+    void handleGetNumEQProfiles(const uint8_t* data, uint32_t len);
+
+    // extended interface lingo
+    void handleAckOnly(const uint8_t* data, uint32_t len);
+    void handleRequestProtocolVersion(const uint8_t* data, uint32_t len);
+    void handleRequestiPodName(const uint8_t* data, uint32_t len);
+    void handleGetNumberCategorizedDBRecords(const uint8_t* data, uint32_t len);
+    void handleRetrieveCategorizedDBRecords(const uint8_t* data, uint32_t len);
+    void handleGetPlayStatus(const uint8_t* data, uint32_t len);
+    void handleGetCurrentPlayingTrackIndex(const uint8_t* data, uint32_t len);
+    void handleGetIndexedPlayingTrackString(const uint8_t* data, uint32_t len);
+    void handleSetPlayStatusChangeNotification(const uint8_t* data, uint32_t len);
+    void handlePlayControl(const uint8_t* data, uint32_t len);
+    void handleSetShuffle(const uint8_t* data, uint32_t len);
+    void handleSetRepeat(const uint8_t* data, uint32_t len);
+    void handleGetMonoDisplayImageLimits(const uint8_t* data, uint32_t len);
+    void handleGetNumPlayingTracks(const uint8_t* data, uint32_t len);
+    void handleSetCurrentPlayingTrack(const uint8_t* data, uint32_t len);
+    void handleGetColorDisplayImageLimits(const uint8_t* data, uint32_t len);
+
+    enum CacheSlot : uint8_t
+    {
+        CACHE_IPOD_NAME,
+        CACHE_TRACK_TITLE,
+        CACHE_TRACK_ARTIST,
+        CACHE_TRACK_ALBUM,
+        CACHE_SLOTS
+    };
+
+    // Fully framed reply to one query, valid while the key it was built for is current
+    struct CachedResponse
+    {
+        bool valid;
+        uint32_t key;
+        uint16_t len;
+        uint8_t frame[MAX_FRAME_SIZE];
+    };
+
+    // Sends the cached reply if it was built for key, otherwise counts a miss
+    bool sendCached(CacheSlot slot, uint32_t key);
+    void sendAndCache(CacheSlot slot, uint32_t key, const uint8_t* frame, uint32_t len);
+    void writeFrame(const uint8_t* data, uint32_t len, TxPriority prio = TX_REPLY);
+
+    // Time until the next notification or stats timer fires, or the TX window has room
+    uint32_t msUntilTimer() const;
+
+    // play status notifications the head unit can enable, one deadline each
+    enum NotifyEvent : uint8_t
+    {
+        NOTIFY_PLAY_STATE,
+        NOTIFY_PLAY_STATE_EXTENDED,
+        NOTIFY_TRACK_INDEX,
+        NOTIFY_TRACK_TIME_MS,
+        NOTIFY_TRACK_TIME_SEC,
+        NOTIFY_EVENTS
+    };
+
+    struct Notifier
+    {
+        uint32_t value;     // last value sent
+        uint32_t sentAt;    // millis() when it was sent
+        uint32_t due;       // millis() of the next send, UINT32_MAX while nothing is pending
+    };
+
+    static uint32_t notifyMaskBit(NotifyEvent event);
+    // Current value of an event, compared with what the head unit was last told
+    static uint32_t notifyValue(NotifyEvent event, bt_app_clock_state_t state, uint32_t pos);
+    // When the event has to be sent next, given its current value
+    uint32_t notifyDue(NotifyEvent event, uint32_t value, bt_app_clock_state_t state, uint32_t pos, uint32_t now) const;
+    void sendNotification(NotifyEvent event, uint32_t value);
+    // Sends the events that changed or are due and schedules the next ones
+    void runNotifications();
+
+    uint32_t rxErrors() const;
+    // IPOD_FRAME_GAP_MS, or longer at low rates where the driver hands over bytes less often
+    int64_t frameGapUs() const;
+    // Locks onto the rate once a valid frame arrived, tries the next one while only garbage does
+    void autobaud();
+    void setBaud(uint8_t index);
+    // Rate index stored in NVS, or the index of baud
+    static uint8_t loadBaud(uint32_t baud);
+    static void storeBaud(uint32_t baud);
+
+    struct TxQueue
+    {
+        uint8_t buf[IPOD_TX_QUEUE_SIZE];
+        uint32_t head;
+        uint32_t tail;
+    };
+
+    bool txPush(TxPriority prio, const uint8_t* data, uint32_t len);
+    // Length of the next frame of a queue, 0 if it is empty
+    uint32_t txPeek(TxPriority prio) const;
+    // Moves queued frames to the driver while the window has room. A timed reply is stamped
+    // when it gets there, plus the time the bytes already in the driver take to go out
+    void pumpTx();
+    uint32_t txDrainMs() const;
+
+    enum RxState : uint8_t
+    {
+        RX_SYNC,        // waiting for 0xFF
+        RX_START,       // waiting for 0x55
+        RX_LENGTH,      // 1 byte length, or 0x00 for the 3 byte form
+        RX_LENGTH_HI,
+        RX_LENGTH_LO,
+        RX_PAYLOAD,     // buffered in _recv
+        RX_STREAM,      // past the command, handed to _rxSink
+        RX_DISCARD,     // too large and no sink, only the checksum is checked
+        RX_CHECKSUM
+    };
+
+    struct SinkEntry
+    {
+        uint8_t lingo;
+        uint16_t cmd;
+        iPodSink* sink;
+    };
+
+    // Lingo and command bytes at the start of a payload
+    static uint32_t headerSize(uint8_t lingo);
+
+    void startPayload();
+    void endFrame(uint8_t checksum);
+    // Drops a partial frame and waits for the next sync
+    void resync();
+
+    uart_port_t _port;
+    QueueHandle_t _uartQueue;
 
     // iPod constants
     std::string _name;
 
     // state
-    bool _playStatusNotifications;
-    uint32_t _playStatusNotificationTimer;
+    uint32_t _notifyMask;
+    Notifier _notify[NOTIFY_EVENTS];
+    uint32_t _notifySent;
 
     // Handle serial recv
     uint8_t _recv[MAX_PACKET_SIZE];
-    uint8_t _lastChar;
     uint32_t _recvItr;
-    uint32_t _recvSize;
+    RxState _rxState;
+    bool _rxNoise;
+    uint8_t _rxSum;
+    uint32_t _rxLen;
+    uint32_t _rxDone;
+    int64_t _rxLastUs;
+    iPodSink* _rxSink;
+
+    SinkEntry _sinks[MAX_SINKS];
+    uint8_t _sinkCount;
+    iPodDiscardSink _imageSink;
+
+    uint32_t _rxFrames;
+    uint32_t _rxChecksumErrors;
+    uint32_t _rxResyncs;
+
+    // response cache and request to reply latency
+    CachedResponse _cache[CACHE_SLOTS];
+    uint32_t _cacheHits;
+    uint32_t _cacheMisses;
+    int64_t _requestUs;
+    bool _requestPending;
+    uint32_t _responseUsMax;
+    // replies in TX_REPLY waiting for the driver: their position in the queue and request time
+    struct ReplyMark
+    {
+        uint32_t pos;
+        int64_t requestUs;
+    };
+    ReplyMark _replyMarks[IPOD_TX_REPLY_MARKS];
+    uint8_t _replyMarkHead;
+    uint8_t _replyMarkTail;
+    uint32_t _responseStatsTimer;
+
+    // task wakeups and time spent awake per stats interval
+    uint32_t _wakes;
+    uint32_t _busyUs;
+    uint32_t _rxOverflows;
+    uint32_t _rxLineErrors;
+    uint32_t _rxBytes;
+    uint32_t _statsRxFrames;
+    uint32_t _statsRxBytes;
+
+    // autobaud
+    uint8_t _baudIndex;
+    bool _baudLocked;
+    uint32_t _autobaudTimer;
+    uint32_t _baudFramesSeen;
+    uint32_t _baudErrorsSeen;
+    uint32_t _baudBytesSeen;
+    uint32_t _baudBadRun;
+    uint32_t _baudSwitches;
+
+    // TX queues, and the bytes estimated to be still in the driver
+    TxQueue _tx[TX_PRIORITIES];
+    uint32_t _baud;
+    uint32_t _txInflight;
+    int64_t _txInflightUs;
+    uint32_t _txBytes;
+    uint32_t _txBytesPerSec;
+    uint32_t _txDepthMax;
+    uint32_t _txDropped;
+
+    // per command statistics, in command table order
+    CommandStats _commandStats[MAX_COMMANDS];
+    UnknownCommand _unknown[MAX_UNKNOWN_COMMANDS];
+    bool _nackSent;
+    uint32_t _commandStatsTimer;
 };
 
 #endif
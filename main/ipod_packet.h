@@ -0,0 +1,172 @@
+#ifndef _IPOD_PACKET_H_
+#define _IPOD_PACKET_H_
+
+#include <stdint.h>
+
+// Typed iPod frame layouts. Sizes are known at compile time, multi-byte fields are
+// written big endian byte by byte and the checksum is summed while encoding
+namespace pkt
+{
+
+// one byte field
+struct U8
+{
+    static constexpr uint32_t maxSize = 1;
+    uint8_t v;
+    U8(uint8_t v): v(v) {}
+};
+
+// big endian uint16_t field
+struct Be16
+{
+    static constexpr uint32_t maxSize = 2;
+    uint16_t v;
+    Be16(uint16_t v): v(v) {}
+};
+
+// big endian uint32_t field
+struct Be32
+{
+    static constexpr uint32_t maxSize = 4;
+    uint32_t v;
+    Be32(uint32_t v): v(v) {}
+};
+
+// NUL terminated string, cut to N bytes including the NUL
+template <uint32_t N>
+struct Str
+{
+    static_assert(N > 0, "no room for the NUL");
+    static constexpr uint32_t maxSize = N;
+    const char* s;
+    Str(const char* s): s(s) {}
+};
+
+// Reads a big endian uint32_t from a payload without an unaligned load
+inline uint32_t getBe32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+inline uint16_t getBe16(const uint8_t* p)
+{
+    return uint16_t((p[0] << 8) | p[1]);
+}
+
+constexpr uint32_t sizeSum()
+{
+    return 0;
+}
+
+template <typename... T>
+constexpr uint32_t sizeSum(uint32_t size, T... rest)
+{
+    return size + sizeSum(rest...);
+}
+
+constexpr uint8_t byteSum()
+{
+    return 0;
+}
+
+template <typename... T>
+constexpr uint8_t byteSum(uint8_t b, T... rest)
+{
+    return uint8_t(b + byteSum(rest...));
+}
+
+// A reply that never changes. The whole frame, checksum included, is a constant in flash
+template <uint8_t... B>
+struct ConstFrame
+{
+    static_assert(sizeof...(B) > 0 && sizeof...(B) <= 255, "payload needs the 1 byte length form");
+
+    static constexpr uint32_t size = 3 + sizeof...(B) + 1;
+    static constexpr uint8_t bytes[size] = {
+        0xFF, 0x55, uint8_t(sizeof...(B)), B..., uint8_t(0x100 - byteSum(uint8_t(sizeof...(B)), B...))
+    };
+};
+
+template <uint8_t... B>
+constexpr uint8_t ConstFrame<B...>::bytes[];
+
+// Encodes fields and keeps the running checksum
+struct Writer
+{
+    uint8_t* p;
+    uint8_t sum;
+
+    void put(uint8_t b)
+    {
+        *p++ = b;
+        sum += b;
+    }
+
+    void field(U8 f)
+    {
+        put(f.v);
+    }
+
+    void field(Be16 f)
+    {
+        put(uint8_t(f.v >> 8));
+        put(uint8_t(f.v));
+    }
+
+    void field(Be32 f)
+    {
+        put(uint8_t(f.v >> 24));
+        put(uint8_t(f.v >> 16));
+        put(uint8_t(f.v >> 8));
+        put(uint8_t(f.v));
+    }
+
+    template <uint32_t N>
+    void field(Str<N> f)
+    {
+        const char* s = f.s;
+        for (uint32_t i = 0; i < N-1 && *s; ++i)
+            put(uint8_t(*s++));
+        put(0x00);
+    }
+
+    void fields() {}
+
+    template <typename F, typename... R>
+    void fields(F f, R... rest)
+    {
+        field(f);
+        fields(rest...);
+    }
+};
+
+// A reply built at run time into an exactly sized buffer, framed as it is encoded
+template <typename... F>
+struct Frame
+{
+    static constexpr uint32_t maxPayload = sizeSum(F::maxSize...);
+    static_assert(maxPayload <= 255, "payload needs the 3 byte length form");
+
+    static constexpr uint32_t maxSize = 3 + maxPayload + 1;
+
+    uint8_t bytes[maxSize];
+    uint32_t len;
+
+    Frame(F... fields)
+    {
+        Writer w = { bytes + 3, 0 };
+        w.fields(fields...);
+
+        uint8_t payload = uint8_t(w.p - (bytes + 3));
+        bytes[0] = 0xFF; // sync
+        bytes[1] = 0x55; // header
+        bytes[2] = payload;
+        *w.p = uint8_t(0x100 - uint8_t(w.sum + payload));
+
+        len = 3 + payload + 1;
+    }
+};
+
+}
+
+#endif
@@ -2,20 +2,17 @@
 #include "iPod.h"
 #include <thread>
 
-HardwareSerial ipod_ser(2);
-iPod ipod(ipod_ser);
+iPod ipod(IPOD_UART_NUM);
 std::thread ipod_thread;
 
 void ipod_thread_func()
 {
-    ipod_ser.begin(57600);
+    ipod.begin(IPOD_UART_BAUD);
 
     while(1)
     {
+        // blocks on the UART event queue, no polling
         ipod.update();
-
-        // yield
-        delay(1);
     }
 }
 
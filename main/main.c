@@ -26,6 +26,7 @@
 #include "esp_bt.h"
 #include "bt_app_core.h"
 #include "bt_app_av.h"
+#include "bt_app_i2s.h"
 #include "esp_bt_main.h"
 #include "esp_bt_device.h"
 #include "esp_gap_bt_api.h"
@@ -59,12 +60,12 @@ void app_main()
 #else
         .mode = I2S_MODE_MASTER | I2S_MODE_TX,                                  // Only TX
 #endif
-        .sample_rate = 44100,
-        .bits_per_sample = 16,                                              
+        .sample_rate = BT_I2S_DEFAULT_SAMPLE_RATE,
+        .bits_per_sample = BT_I2S_BITS_PER_SAMPLE,
         .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,                           //2-channels
         .communication_format = I2S_COMM_FORMAT_I2S | I2S_COMM_FORMAT_I2S_MSB,
-        .dma_buf_count = 6,
-        .dma_buf_len = 60,                                                      //
+        .dma_buf_count = BT_I2S_DMA_BUF_COUNT,
+        .dma_buf_len = BT_I2S_DMA_BUF_LEN,                                      //frames per buffer
         .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1                                //Interrupt level 1
     };
 
@@ -83,6 +84,9 @@ void app_main()
     i2s_set_pin(0, &pin_config);
 #endif
 
+    /* PCM ring buffer and I2S writer task, fed by the A2DP data callback */
+    bt_app_i2s_task_start_up();
+
 
     ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_BLE));
 
@@ -111,6 +115,9 @@ void app_main()
     /* create application task */
     bt_app_task_start_up();
 
+    /* stats summary, kept out of the A2DP data callback */
+    bt_app_av_stats_start_up();
+
     /* Bluetooth device name, connection mode and profile set up */
     bt_app_work_dispatch(bt_av_hdl_stack_evt, BT_APP_EVT_STACK_UP, NULL, 0, NULL);
 
@@ -136,6 +143,14 @@ static void bt_av_hdl_stack_evt(uint16_t event, void *p_param)
         esp_avrc_ct_init();
         esp_avrc_ct_register_callback(bt_app_rc_ct_cb);
 
+        /* initialize AVRCP target, the phone sets our volume instead of scaling its PCM */
+        esp_avrc_tg_init();
+        esp_avrc_tg_register_callback(bt_app_rc_tg_cb);
+
+        esp_avrc_rn_evt_cap_mask_t evt_set = {0};
+        esp_avrc_rn_evt_bit_mask_operation(ESP_AVRC_BIT_MASK_OP_SET, &evt_set, ESP_AVRC_RN_VOLUME_CHANGE);
+        esp_avrc_tg_set_rn_evt_cap(&evt_set);
+
         /* set discoverable and connectable mode, wait to be connected */
         esp_bt_gap_set_scan_mode(ESP_BT_SCAN_MODE_CONNECTABLE_DISCOVERABLE);
         break;
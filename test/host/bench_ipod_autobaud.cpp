@@ -0,0 +1,377 @@
+/*
+   Host benchmark: autobaud lock time and receive rate at each accessory rate.
+
+   A head unit and the iPod link are wired back to back on simulated time. What the
+   head unit sends is turned into a line level bit stream at its rate and sampled again
+   by a UART at the rate autobaud has set, start bit, 8 data bits and stop bit, so a
+   wrong rate yields the garbage bytes and framing errors the real driver reports. The
+   driver side is faked here: its event queue hands out UART_DATA after the rx timeout
+   and UART_FRAME_ERR per bad stop bit, and time only moves while iPod::update() waits.
+
+   The head unit repeats RequestiPodModelNum every 500 ms until it gets an answer. It
+   walks through the rates, going back to an earlier one at the end, and is restarted
+   with the locked rate in NVS. Each lock time, counted from its first request, is
+   reported. Then every rate gets one second of back to back 255 byte frames, and
+   frames/s and bytes/s parsed are reported against what the line carried, along with
+   the host CPU spent in update() per second of line time.
+
+   Fails if a rate does not lock within 10 s or is not the one stored in NVS, if a
+   restart with a stored rate needs more than one request, or if any streamed frame is
+   lost.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include "iPod.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "nvs.h"
+
+#define REQUEST_INTERVAL_MS (500)
+#define LOCK_TIMEOUT_MS     (10000)
+// idle line after each burst, so the last byte is not cut by the next one
+#define IDLE_BITS           (20)
+// update() spinning with nothing to wait for still takes time on the target
+#define SPIN_US             (100)
+
+// one sampled character, or a framing error, at the time the stop bit ends
+struct LineItem
+{
+    int64_t us;
+    uint8_t c;
+    bool frameError;
+};
+
+static int64_t now = 0;
+static uint32_t rxBaud = IPOD_UART_BAUD;
+static uint32_t rateSwitches = 0;
+static std::deque<LineItem> line;
+static std::deque<uint8_t> rxRing;
+static uint32_t txBytes = 0;
+static bool wakePending = false;
+// the head unit's next move, a wait in the iPod task never runs past it
+static int64_t horizon = 0;
+static int fakeQueue;
+
+extern "C"
+{
+
+int64_t esp_timer_get_time(void)
+{
+    return now;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    now += int64_t(ticks) * portTICK_PERIOD_MS * 1000;
+}
+
+esp_err_t uart_param_config(uart_port_t, const uart_config_t* config)
+{
+    rxBaud = config->baud_rate;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t, int, int, int, int)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t, int, int, int, QueueHandle_t* queue, int)
+{
+    *queue = reinterpret_cast<QueueHandle_t>(&fakeQueue);
+    return ESP_OK;
+}
+
+esp_err_t uart_intr_config(uart_port_t, const uart_intr_config_t*)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t, uint32_t baud)
+{
+    rxBaud = baud;
+    rateSwitches++;
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t)
+{
+    rxRing.clear();
+    // what already went through the old rate is gone with the ring
+    while (!line.empty() && line.front().us <= now)
+        line.pop_front();
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t, uint8_t* buf, uint32_t length, TickType_t)
+{
+    uint32_t n = 0;
+
+    while (n < length && !rxRing.empty())
+    {
+        buf[n++] = rxRing.front();
+        rxRing.pop_front();
+    }
+    return n;
+}
+
+int uart_write_bytes(uart_port_t, const char*, size_t size)
+{
+    txBytes += size;
+    return size;
+}
+
+BaseType_t xQueueSend(QueueHandle_t, const void*, TickType_t)
+{
+    wakePending = true;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t)
+{
+    wakePending = false;
+    return pdTRUE;
+}
+
+// the driver's event queue, fed from the line as the interrupts would
+BaseType_t xQueueReceive(QueueHandle_t, void* item, TickType_t ticks)
+{
+    uart_event_t* event = static_cast<uart_event_t*>(item);
+    int64_t deadline = ticks == portMAX_DELAY ? INT64_MAX : now + int64_t(ticks) * portTICK_PERIOD_MS * 1000;
+    if (deadline > horizon)
+        deadline = horizon;
+    // the rx timeout fires this long after the last character
+    int64_t timeoutUs = int64_t(IPOD_UART_RX_TIMEOUT) * 10 * 1000000 / rxBaud;
+
+    if (wakePending)
+    {
+        wakePending = false;
+        event->type = UART_EVENT_MAX;
+        return pdTRUE;
+    }
+
+    if (line.empty() || line.front().us + timeoutUs > deadline)
+    {
+        now = ticks && deadline > now ? deadline : now + SPIN_US;
+        return pdFALSE;
+    }
+
+    if (line.front().us > now)
+        now = line.front().us;
+
+    if (line.front().frameError)
+    {
+        line.pop_front();
+        event->type = UART_FRAME_ERR;
+        return pdTRUE;
+    }
+
+    // a full fifo or an idle line hands over what arrived
+    size_t n = 0;
+    while (n < UART_FIFO_LEN - 8 && !line.empty() && !line.front().frameError &&
+        line.front().us <= now + (n ? timeoutUs : 0))
+    {
+        now = line.front().us;
+        rxRing.push_back(line.front().c);
+        line.pop_front();
+        n++;
+    }
+    if (line.empty() || line.front().frameError || n < UART_FIFO_LEN - 8)
+        now += timeoutUs;
+
+    event->type = UART_DATA;
+    event->size = n;
+    return pdTRUE;
+}
+
+}
+
+// bytes sent at txBaud from the current time on, sampled by a UART at rxBaud
+static int64_t send(const std::vector<uint8_t>& bytes, uint32_t txBaud)
+{
+    std::vector<uint8_t> bits;
+
+    for (uint8_t b : bytes)
+    {
+        bits.push_back(0);
+        for (int i = 0; i < 8; ++i)
+            bits.push_back((b >> i) & 1);
+        bits.push_back(1);
+    }
+    bits.insert(bits.end(), IDLE_BITS, 1);
+
+    const double txBit = 1e6 / txBaud;
+    const double rxBit = 1e6 / rxBaud;
+    const double end = bits.size() * txBit;
+    auto level = [&](double t) -> uint8_t
+    {
+        size_t i = size_t(t / txBit);
+        return i < bits.size() ? bits[i] : 1;
+    };
+
+    // the receiver looks for a falling edge at 16 times its rate, then samples mid bit
+    double t = 0;
+    while (t < end)
+    {
+        if (level(t))
+        {
+            t += rxBit / 16;
+            continue;
+        }
+
+        uint8_t c = 0;
+        for (int i = 0; i < 8; ++i)
+            c |= level(t + rxBit * (1.5 + i)) << i;
+
+        LineItem item = { now + int64_t(t + rxBit * 10), c, level(t + rxBit * 9.5) == 0 };
+        line.push_back(item);
+        t += rxBit * 10;
+    }
+
+    return now + int64_t(end);
+}
+
+static std::vector<uint8_t> frame(const std::vector<uint8_t>& payload)
+{
+    std::vector<uint8_t> out(MAX_FRAME_SIZE);
+
+    out.resize(iPod::frame(payload.data(), payload.size(), out.data()));
+    return out;
+}
+
+static double hostUs = 0;
+
+static void runUntil(iPod& ipod, int64_t until)
+{
+    horizon = until;
+    while (now < until)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        ipod.update();
+        hostUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    }
+}
+
+static uint32_t storedBaud()
+{
+    nvs_handle handle;
+    uint32_t baud = 0;
+
+    nvs_open(IPOD_NVS_NAMESPACE, NVS_READONLY, &handle);
+    nvs_get_u32(handle, IPOD_NVS_KEY_BAUD, &baud);
+    nvs_close(handle);
+    return baud;
+}
+
+// the head unit polls at its rate until the iPod answers, returns the requests it took or 0
+static uint32_t connect(iPod& ipod, uint32_t headUnitBaud, int64_t* lockUs)
+{
+    const std::vector<uint8_t> request = frame({ IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_REQUEST_IPOD_MODEL_NUM });
+    const int64_t start = now;
+
+    for (uint32_t requests = 1; now - start < int64_t(LOCK_TIMEOUT_MS) * 1000; ++requests)
+    {
+        uint32_t tx = txBytes;
+        int64_t sent = now;
+
+        send(request, headUnitBaud);
+        while (now - sent < int64_t(REQUEST_INTERVAL_MS) * 1000 && txBytes == tx)
+        {
+            horizon = sent + int64_t(REQUEST_INTERVAL_MS) * 1000;
+            ipod.update();
+        }
+
+        if (txBytes != tx)
+        {
+            *lockUs = now - start;
+            // let the reply and anything queued behind it go out
+            runUntil(ipod, sent + int64_t(REQUEST_INTERVAL_MS) * 1000);
+            return requests;
+        }
+    }
+
+    return 0;
+}
+
+int main()
+{
+    static const uint32_t headUnits[] = { 19200, 38400, 57600, 115200, 9600, 57600 };
+    static const uint32_t rates[] = { 9600, 19200, 38400, 57600, 115200 };
+    bool ok = true;
+
+    nvs_host_erase();
+
+    iPod ipod(IPOD_UART_NUM);
+    ipod.begin(IPOD_UART_BAUD);
+
+    printf("%-12s %10s %10s %10s %10s\n", "head unit", "lock ms", "requests", "switches", "stored");
+    for (uint32_t baud : headUnits)
+    {
+        int64_t lockUs = 0;
+        uint32_t switches = rateSwitches;
+        uint32_t requests = connect(ipod, baud, &lockUs);
+
+        printf("%-12u %10.1f %10u %10u %10u\n", baud, lockUs / 1000.0, requests, rateSwitches - switches, storedBaud());
+        if (!requests || rxBaud != baud || storedBaud() != baud)
+            ok = false;
+    }
+
+    // power cycle: the stored rate is tried first
+    {
+        iPod restarted(IPOD_UART_NUM);
+        int64_t lockUs = 0;
+
+        restarted.begin(IPOD_UART_BAUD);
+        uint32_t switches = rateSwitches;
+        uint32_t requests = connect(restarted, 57600, &lockUs);
+
+        printf("%-12s %10.1f %10u %10u %10u\n", "restart", lockUs / 1000.0, requests, rateSwitches - switches, storedBaud());
+        if (requests != 1 || rateSwitches != switches)
+            ok = false;
+    }
+
+    // one second of SetDisplayImage frames back to back at each rate, no reply expected
+    std::vector<uint8_t> payload(255, 0x11);
+    payload[0] = IPOD_LINGO_EXTENDED_INTERFACE;
+    payload[1] = 0x00;
+    payload[2] = IPOD_CMD_EXTENDED_INTERFACE_SET_DISPLAY_IMAGE;
+    const std::vector<uint8_t> image = frame(payload);
+
+    printf("\n%-8s %10s %12s %12s %10s %10s\n", "baud", "frames/s", "bytes/s", "line bytes/s", "lost", "host CPU");
+    for (uint32_t baud : rates)
+    {
+        int64_t lockUs;
+
+        if (!connect(ipod, baud, &lockUs))
+        {
+            printf("%-8u no lock\n", baud);
+            ok = false;
+            continue;
+        }
+
+        uint32_t frames = baud / 10 / image.size();
+        std::vector<uint8_t> burst;
+        for (uint32_t i = 0; i < frames; ++i)
+            burst.insert(burst.end(), image.begin(), image.end());
+
+        uint32_t rx0 = ipod.framesReceived();
+        int64_t t0 = now;
+        hostUs = 0;
+        int64_t end = send(burst, baud);
+        runUntil(ipod, end + 20000);
+
+        double s = (end - t0) / 1e6;
+        uint32_t parsed = ipod.framesReceived() - rx0;
+        printf("%-8u %10.1f %12.0f %12u %10u %9.3f%%\n", baud, parsed / s, parsed * image.size() / s, baud / 10,
+            frames - parsed, 100.0 * hostUs / (s * 1e6));
+        if (parsed != frames)
+            ok = false;
+    }
+
+    printf("%s\n", ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+/*
+   Host benchmark: the event driven iPod loop against the polling loop it replaced.
+
+   The polling loop is the old ipod_thread_func: read whatever the UART holds one byte
+   at a time, then delay(1). With CONFIG_FREERTOS_HZ=100 that delay is vTaskDelay(0),
+   a bare yield, so it is measured as it shipped and with a real one tick sleep. The
+   event loop is iPod::update() blocking on the driver's event queue.
+
+   All threads share one CPU like the tasks on one ESP32 core. Per loop it reports the
+   CPU time the loop thread used while the head unit was silent, its wakeups, and the
+   time from the last request byte reaching the RX ring to the first reply byte handed
+   to the driver. The UART rx timeout, 2 symbol times before either loop can see the
+   bytes, is the same for both and not included. Fails if the event loop burns more
+   than 1% of the CPU at idle or a request goes unanswered.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "iPod.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "uart_host.h"
+
+#define IDLE_MS             (2000)
+#define REQUESTS            (200)
+// head unit pause after a reply is fully on the wire, plus up to a tick of jitter so
+// requests do not line up with the poll loop's sleeps
+#define REQUEST_GAP_US      (2000)
+#define REQUEST_JITTER_US   (10000)
+#define REPLY_TIMEOUT_MS    (200)
+
+enum LoopKind
+{
+    LOOP_POLL_YIELD,    // delay(1) at 100 Hz, as shipped
+    LOOP_POLL_TICK,     // one tick sleep, what delay(1) was meant to be
+    LOOP_EVENT,
+    LOOP_KINDS
+};
+
+static const char* const loopNames[LOOP_KINDS] = { "poll, delay(1)", "poll, 1 tick sleep", "event queue" };
+
+struct LoopResult
+{
+    double idleCpuPct;
+    double idleWakesPerSec;
+    uint32_t answered;
+    uint32_t p50Us;
+    uint32_t p99Us;
+    uint32_t maxUs;
+};
+
+static iPod ipod(IPOD_UART_NUM);
+
+static std::atomic<bool> running;
+static std::atomic<uint32_t> wakes;
+static int64_t loopCpuUs;
+
+static std::mutex replyLock;
+static std::condition_variable replyCond;
+static bool replied;
+static int64_t replyUs;
+static size_t replyBytes;
+
+static int64_t threadCpuUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void onTx(const uint8_t* data, size_t len)
+{
+    std::lock_guard<std::mutex> lock(replyLock);
+
+    if (!replied)
+    {
+        replyUs = esp_timer_get_time();
+        replyBytes = len;
+        replied = true;
+        replyCond.notify_one();
+    }
+}
+
+static void pollLoop(TickType_t ticks)
+{
+    while (running)
+    {
+        size_t n = 0;
+
+        uart_get_buffered_data_len(IPOD_UART_NUM, &n);
+        while (n--)
+        {
+            uint8_t c;
+
+            uart_read_bytes(IPOD_UART_NUM, &c, 1, 0);
+            ipod.receive(&c, 1, esp_timer_get_time());
+        }
+
+        wakes++;
+        vTaskDelay(ticks);
+    }
+}
+
+static void loopThread(LoopKind kind)
+{
+    int64_t start = threadCpuUs();
+
+    switch (kind)
+    {
+        case LOOP_POLL_YIELD:
+            // what Arduino's delay(1) does with a 10 ms tick
+            pollLoop(1 / portTICK_PERIOD_MS);
+            break;
+        case LOOP_POLL_TICK:
+            pollLoop(1);
+            break;
+        default:
+            while (running)
+            {
+                ipod.update();
+                wakes++;
+            }
+            break;
+    }
+
+    loopCpuUs = threadCpuUs() - start;
+}
+
+static std::vector<uint8_t> frame(std::initializer_list<uint8_t> payload)
+{
+    std::vector<uint8_t> out(MAX_FRAME_SIZE);
+    std::vector<uint8_t> in(payload);
+
+    out.resize(iPod::frame(in.data(), in.size(), out.data()));
+    return out;
+}
+
+static LoopResult measure(LoopKind kind)
+{
+    LoopResult r = {};
+    std::vector<uint32_t> lat;
+    // RequestiPodModelNum, answered straight from the handler
+    const std::vector<uint8_t> request = frame({ IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_REQUEST_IPOD_MODEL_NUM });
+
+    running = true;
+    wakes = 0;
+    std::thread loop(loopThread, kind);
+
+    for (uint32_t i = 0; i < REQUESTS; ++i)
+    {
+        std::unique_lock<std::mutex> lock(replyLock);
+
+        replied = false;
+        lock.unlock();
+
+        int64_t sent = esp_timer_get_time();
+        uart_host_receive(IPOD_UART_NUM, request.data(), request.size(), kind == LOOP_EVENT);
+
+        lock.lock();
+        size_t wire = request.size();
+        if (replyCond.wait_for(lock, std::chrono::milliseconds(REPLY_TIMEOUT_MS), [] { return replied; }))
+        {
+            lat.push_back(uint32_t(replyUs - sent));
+            r.answered++;
+            wire += replyBytes;
+        }
+        lock.unlock();
+
+        // a real head unit cannot send faster than the wire, 10 bits per byte
+        std::this_thread::sleep_for(std::chrono::microseconds(REQUEST_GAP_US + rand() % REQUEST_JITTER_US +
+            wire * 10 * 1000000 / IPOD_UART_BAUD));
+    }
+
+    running = false;
+    ipod.wake();
+    loop.join();
+
+    // the head unit goes quiet, a fresh loop thread only has its own wakeups to account for
+    running = true;
+    wakes = 0;
+    std::thread idle(loopThread, kind);
+    std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_MS));
+    running = false;
+    ipod.wake();
+    idle.join();
+
+    // the wake() that stops the event loop is not idle traffic
+    uint32_t idleWakes = wakes;
+    if (kind == LOOP_EVENT && idleWakes > 0)
+        idleWakes--;
+
+    r.idleCpuPct = 100.0 * loopCpuUs / (IDLE_MS * 1000.0);
+    r.idleWakesPerSec = idleWakes * 1000.0 / IDLE_MS;
+
+    std::sort(lat.begin(), lat.end());
+    if (!lat.empty())
+    {
+        r.p50Us = lat[lat.size() / 2];
+        r.p99Us = lat[lat.size() * 99 / 100];
+        r.maxUs = lat.back();
+    }
+    return r;
+}
+
+int main()
+{
+    // one core for the loop and the head unit, as on the ESP32
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(0, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+    uart_host_set_tx_callback(onTx);
+    ipod.begin(IPOD_UART_BAUD);
+
+    bool ok = true;
+
+    printf("%-20s %10s %12s %10s %10s %10s %10s\n", "loop", "idle CPU", "idle wakes/s", "answered", "p50 us", "p99 us", "max us");
+    for (int k = 0; k < LOOP_KINDS; ++k)
+    {
+        LoopResult r = measure(LoopKind(k));
+
+        printf("%-20s %9.2f%% %12.0f %6u/%-3u %10u %10u %10u\n", loopNames[k], r.idleCpuPct, r.idleWakesPerSec,
+            r.answered, REQUESTS, r.p50Us, r.p99Us, r.maxUs);
+
+        if (r.answered != REQUESTS)
+            ok = false;
+        if (k == LOOP_EVENT && r.idleCpuPct > 1.0)
+            ok = false;
+    }
+
+    printf("%s\n", ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+/*
+   Host benchmark: iPod::receive() throughput on a noisy capture.
+
+   The capture is what a head unit uploading cover art sends while it polls the play
+   status: SetDisplayImage in the 3 byte length form, streamed to the image sink, mixed
+   with short GetPlayStatus and RequestiPodModelNum frames. Every 50th frame has a bit
+   flipped, every 100th is cut short as by a dropout, and bursts of line noise sit
+   between frames. It is fed in FIFO sized chunks stamped at 57600 baud wire time.
+
+   Reports parser throughput and the frame, checksum error and resync counters. Fails
+   if fewer than 90% of the intact frames come out, or if the parser is not at least
+   100 times faster than the fastest accessory rate.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include "iPod.h"
+
+#define CAPTURE_FRAMES      (20000)
+#define CHUNK               (UART_FIFO_LEN)
+#define WIRE_BAUD           (57600)
+#define PASSES              (5)
+
+// image data per SetDisplayImage frame
+#define IMAGE_MIN           (256)
+#define IMAGE_MAX           (4096)
+
+struct Capture
+{
+    std::vector<uint8_t> bytes;
+    uint32_t frames;    // frames sent
+    uint32_t intact;    // frames neither corrupted nor cut short
+};
+
+static uint32_t rng = 0x12345678;
+
+static uint32_t rngNext()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// 1 byte length form up to 255, 3 byte form above
+static void appendFrame(std::vector<uint8_t>& out, const std::vector<uint8_t>& payload)
+{
+    uint32_t len = payload.size();
+    uint8_t sum;
+
+    out.push_back(0xFF);
+    out.push_back(0x55);
+    if (len > 255)
+    {
+        out.push_back(0x00);
+        out.push_back(uint8_t(len >> 8));
+        out.push_back(uint8_t(len));
+        sum = uint8_t(len >> 8) + uint8_t(len);
+    }
+    else
+    {
+        out.push_back(uint8_t(len));
+        sum = uint8_t(len);
+    }
+
+    for (uint8_t c : payload)
+    {
+        out.push_back(c);
+        sum += c;
+    }
+    out.push_back(uint8_t(-sum));
+}
+
+static Capture makeCapture()
+{
+    Capture cap = {};
+
+    for (uint32_t f = 0; f < CAPTURE_FRAMES; ++f)
+    {
+        std::vector<uint8_t> payload;
+        uint32_t kind = rngNext() % 10;
+
+        if (kind < 3)
+        {
+            // SetDisplayImage: descriptor, then pixel data
+            payload = { IPOD_LINGO_EXTENDED_INTERFACE, 0x00, IPOD_CMD_EXTENDED_INTERFACE_SET_DISPLAY_IMAGE };
+            uint32_t n = IMAGE_MIN + rngNext() % (IMAGE_MAX - IMAGE_MIN);
+            for (uint32_t i = 0; i < n; ++i)
+                payload.push_back(uint8_t(rngNext()));
+        }
+        else if (kind < 8)
+            payload = { IPOD_LINGO_EXTENDED_INTERFACE, 0x00, IPOD_CMD_EXTENDED_INTERFACE_GET_PLAY_STATUS };
+        else
+            payload = { IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_REQUEST_IPOD_MODEL_NUM };
+
+        size_t start = cap.bytes.size();
+        appendFrame(cap.bytes, payload);
+        cap.frames++;
+
+        if (f % 50 == 49)
+        {
+            // one flipped bit anywhere in the frame, sync and length included
+            size_t at = start + rngNext() % (cap.bytes.size() - start);
+            cap.bytes[at] ^= uint8_t(1 << (rngNext() % 8));
+        }
+        else if (f % 100 == 99)
+            cap.bytes.resize(start + 1 + rngNext() % (cap.bytes.size() - start - 1));
+        else
+            cap.intact++;
+
+        if (rngNext() % 100 == 0)
+        {
+            uint32_t n = 1 + rngNext() % 8;
+            for (uint32_t i = 0; i < n; ++i)
+                cap.bytes.push_back(uint8_t(rngNext()));
+        }
+    }
+
+    return cap;
+}
+
+int main()
+{
+    const Capture cap = makeCapture();
+    bool ok = true;
+    double best = 0;
+    double bestFrames = 0;
+
+    for (int pass = 0; pass < PASSES; ++pass)
+    {
+        iPod ipod(IPOD_UART_NUM);
+        auto t0 = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < cap.bytes.size(); i += CHUNK)
+        {
+            uint32_t n = cap.bytes.size() - i < CHUNK ? cap.bytes.size() - i : CHUNK;
+            int64_t wireUs = int64_t(i) * 10 * 1000000 / WIRE_BAUD;
+
+            ipod.receive(cap.bytes.data() + i, n, wireUs);
+        }
+
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        double rate = cap.bytes.size() / s;
+        if (rate > best)
+        {
+            best = rate;
+            bestFrames = ipod.framesReceived() / s;
+        }
+
+        if (pass == 0)
+        {
+            printf("capture: %zu bytes, %u frames, %u intact\n", cap.bytes.size(), cap.frames, cap.intact);
+            printf("parser: %u frames, %u checksum errors, %u resyncs\n",
+                ipod.framesReceived(), ipod.checksumErrors(), ipod.resyncs());
+
+            if (ipod.framesReceived() < cap.intact * 9 / 10 || ipod.framesReceived() > cap.frames)
+                ok = false;
+            if (ipod.checksumErrors() == 0 || ipod.resyncs() == 0)
+                ok = false;
+        }
+    }
+
+    // the fastest rate autobaud tries, 10 bits per byte on the wire
+    double line = 115200 / 10.0;
+    printf("throughput: %.1f MB/s, %.1f ns/byte, %.0f frames/s, %.0fx a 115200 baud line\n",
+        best / 1e6, 1e9 / best, bestFrames, best / line);
+    if (best < 100 * line)
+        ok = false;
+
+    printf("%s\n", ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Builds and runs the host tests. These only need gcc and g++; the firmware itself
+# still builds with the ESP-IDF make system.
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+MAIN="$HERE/../../main"
+OUT="${OUT:-$HERE/build}"
+CFLAGS="-O2 -std=gnu99 -Wall -I$HERE/stubs -I$MAIN"
+CXXFLAGS="-O2 -std=gnu++11 -fno-rtti -fno-exceptions -Wall -I$HERE/stubs -I$MAIN"
+
+mkdir -p "$OUT"
+
+gcc $CFLAGS "$HERE/test_asrc_jbuf.c" "$MAIN/bt_app_ringbuf.c" "$MAIN/bt_app_asrc.c" "$MAIN/bt_app_jbuf.c" -lm -o "$OUT/test_asrc_jbuf"
+"$OUT/test_asrc_jbuf"
+
+gcc $CFLAGS "$HERE/test_dispatch_alloc.c" "$MAIN/bt_app_core.c" "$HERE/stubs/freertos_host.c" -lpthread -o "$OUT/test_dispatch_alloc"
+"$OUT/test_dispatch_alloc"
+
+# the iPod link on a stand-in UART driver, with the real metadata store and playback clock
+for src in "$HERE/stubs/ipod_host.c" "$HERE/stubs/uart_host.c" "$HERE/stubs/freertos_host.c" "$MAIN/bt_app_meta.c" "$MAIN/bt_app_clock.c"; do
+    gcc $CFLAGS -c "$src" -o "$OUT/$(basename "$src" .c).o"
+done
+IPOD_HOST="$OUT/ipod_host.o $OUT/uart_host.o $OUT/freertos_host.o $OUT/bt_app_meta.o $OUT/bt_app_clock.o"
+
+g++ $CXXFLAGS "$HERE/bench_ipod_loop.cpp" "$MAIN/iPod.cpp" $IPOD_HOST -lpthread -o "$OUT/bench_ipod_loop"
+"$OUT/bench_ipod_loop"
+
+g++ $CXXFLAGS "$HERE/bench_ipod_parser.cpp" "$MAIN/iPod.cpp" $IPOD_HOST -lpthread -o "$OUT/bench_ipod_parser"
+
+g++ $CXXFLAGS "$HERE/test_ipod_dispatch.cpp" "$MAIN/iPod.cpp" $IPOD_HOST -lpthread -o "$OUT/test_ipod_dispatch"
+
+# simulated time and its own UART driver, so only the NVS and EQ stand-ins and the real metadata and clock
+g++ $CXXFLAGS "$HERE/bench_ipod_autobaud.cpp" "$MAIN/iPod.cpp" "$OUT/ipod_host.o" "$OUT/bt_app_meta.o" "$OUT/bt_app_clock.o" \
+    -o "$OUT/bench_ipod_autobaud"
+"$OUT/bench_ipod_autobaud"
+"$OUT/test_ipod_dispatch"
+"$OUT/bench_ipod_parser"
+
+# the packet layer is header only and plain C++11
+g++ -O2 -std=c++11 -Wall -Wextra -pedantic -I"$MAIN" "$HERE/test_ipod_packet.cpp" -o "$OUT/test_ipod_packet"
+"$OUT/test_ipod_packet"
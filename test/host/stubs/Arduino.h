@@ -0,0 +1,24 @@
+/* host build stand-in for the few Arduino core calls the iPod link uses */
+
+#ifndef __ARDUINO_HOST_H__
+#define __ARDUINO_HOST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* milliseconds from esp_timer_get_time, so a test that provides its own clock moves both */
+unsigned long millis(void);
+
+/* like the Arduino core, vTaskDelay(ms / portTICK_PERIOD_MS) */
+void delay(uint32_t ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ARDUINO_HOST_H__ */
@@ -0,0 +1,106 @@
+/* host build stand-in for the ESP-IDF v3.2 UART driver, only what the iPod link uses */
+
+#ifndef __UART_HOST_H__
+#define __UART_HOST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    UART_NUM_0 = 0,
+    UART_NUM_1,
+    UART_NUM_2,
+    UART_NUM_MAX,
+} uart_port_t;
+
+typedef enum {
+    UART_DATA_5_BITS = 0,
+    UART_DATA_6_BITS,
+    UART_DATA_7_BITS,
+    UART_DATA_8_BITS,
+} uart_word_length_t;
+
+typedef enum {
+    UART_PARITY_DISABLE = 0,
+    UART_PARITY_EVEN = 2,
+    UART_PARITY_ODD = 3,
+} uart_parity_t;
+
+typedef enum {
+    UART_STOP_BITS_1 = 1,
+    UART_STOP_BITS_1_5,
+    UART_STOP_BITS_2,
+} uart_stop_bits_t;
+
+typedef enum {
+    UART_HW_FLOWCTRL_DISABLE = 0,
+} uart_hw_flowcontrol_t;
+
+typedef struct {
+    int                   baud_rate;
+    uart_word_length_t    data_bits;
+    uart_parity_t         parity;
+    uart_stop_bits_t      stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t               rx_flow_ctrl_thresh;
+    bool                  use_ref_tick;
+} uart_config_t;
+
+typedef struct {
+    uint32_t             intr_enable_mask;
+    uint8_t              rx_timeout_thresh;
+    uint8_t              txfifo_empty_intr_thresh;
+    uint8_t              rxfifo_full_thresh;
+} uart_intr_config_t;
+
+typedef enum {
+    UART_DATA,
+    UART_BREAK,
+    UART_BUFFER_FULL,
+    UART_FIFO_OVF,
+    UART_FRAME_ERR,
+    UART_PARITY_ERR,
+    UART_DATA_BREAK,
+    UART_PATTERN_DET,
+    UART_EVENT_MAX,
+} uart_event_type_t;
+
+typedef struct {
+    uart_event_type_t    type;
+    size_t               size;
+} uart_event_t;
+
+#define UART_PIN_NO_CHANGE           (-1)
+#define UART_FIFO_LEN                (128)
+
+#define UART_RXFIFO_FULL_INT_ENA_M   (1 << 0)
+#define UART_PARITY_ERR_INT_ENA_M    (1 << 2)
+#define UART_FRM_ERR_INT_ENA_M       (1 << 3)
+#define UART_RXFIFO_OVF_INT_ENA_M    (1 << 4)
+#define UART_BRK_DET_INT_ENA_M       (1 << 7)
+#define UART_RXFIFO_TOUT_INT_ENA_M   (1 << 8)
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *uart_config);
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num);
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t *uart_queue, int intr_alloc_flags);
+esp_err_t uart_intr_config(uart_port_t uart_num, const uart_intr_config_t *intr_conf);
+esp_err_t uart_set_baudrate(uart_port_t uart_num, uint32_t baudrate);
+esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t *size);
+esp_err_t uart_flush_input(uart_port_t uart_num);
+int uart_read_bytes(uart_port_t uart_num, uint8_t *buf, uint32_t length, TickType_t ticks_to_wait);
+int uart_write_bytes(uart_port_t uart_num, const char *src, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UART_HOST_H__ */
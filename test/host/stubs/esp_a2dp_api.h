@@ -0,0 +1,20 @@
+/* host build stand-in, only the callback parameter type sized like the real one */
+
+#ifndef __ESP_A2DP_API_HOST_H__
+#define __ESP_A2DP_API_HOST_H__
+
+#include <stdint.h>
+
+typedef union {
+    struct {
+        int              state;
+        uint8_t          remote_bda[6];
+        int              disc_rsn;
+    } conn_stat;
+    struct {
+        uint8_t          remote_bda[6];
+        uint8_t          mcc[16];
+    } audio_cfg;
+} esp_a2d_cb_param_t;
+
+#endif /* __ESP_A2DP_API_HOST_H__ */
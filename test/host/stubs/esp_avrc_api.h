@@ -0,0 +1,35 @@
+/* host build stand-in, the callback parameter types sized like the real ones and the metadata ids */
+
+#ifndef __ESP_AVRC_API_HOST_H__
+#define __ESP_AVRC_API_HOST_H__
+
+#include <stdint.h>
+
+/* metadata attribute mask bits */
+#define ESP_AVRC_MD_ATTR_TITLE                 0x1
+#define ESP_AVRC_MD_ATTR_ARTIST                0x2
+#define ESP_AVRC_MD_ATTR_ALBUM                 0x4
+#define ESP_AVRC_MD_ATTR_TRACK_NUM             0x8
+#define ESP_AVRC_MD_ATTR_NUM_TRACKS            0x10
+#define ESP_AVRC_MD_ATTR_GENRE                 0x20
+#define ESP_AVRC_MD_ATTR_PLAYING_TIME          0x40
+
+typedef union {
+    struct {
+        uint8_t          attr_id;
+        uint8_t          *attr_text;
+        int              attr_length;
+    } meta_rsp;
+    struct {
+        uint8_t          event_id;
+        uint32_t         event_parameter;
+    } change_ntf;
+} esp_avrc_ct_cb_param_t;
+
+typedef union {
+    struct {
+        uint8_t          volume;
+    } set_abs_vol;
+} esp_avrc_tg_cb_param_t;
+
+#endif /* __ESP_AVRC_API_HOST_H__ */
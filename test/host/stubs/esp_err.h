@@ -0,0 +1,27 @@
+/* host build stand-in for the ESP-IDF error codes */
+
+#ifndef __ESP_ERR_HOST_H__
+#define __ESP_ERR_HOST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                       (0)
+#define ESP_FAIL                     (-1)
+#define ESP_ERR_NO_MEM               (0x101)
+#define ESP_ERR_INVALID_ARG          (0x102)
+#define ESP_ERR_INVALID_STATE        (0x103)
+#define ESP_ERR_TIMEOUT              (0x107)
+#define ESP_ERR_NVS_NOT_FOUND        (0x1102)
+
+#define ESP_ERROR_CHECK(x) do {                                             \
+        esp_err_t __err = (x);                                              \
+        if (__err != ESP_OK) {                                              \
+            fprintf(stderr, "%s:%d %s failed: %d\n", __FILE__, __LINE__, #x, __err); \
+            abort();                                                        \
+        }                                                                   \
+    } while (0)
+
+#endif /* __ESP_ERR_HOST_H__ */
@@ -0,0 +1,22 @@
+/* host build stand-in for the ESP-IDF heap, capabilities are ignored */
+
+#ifndef __ESP_HEAP_CAPS_H__
+#define __ESP_HEAP_CAPS_H__
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT              (1 << 2)
+#define MALLOC_CAP_SPIRAM            (1 << 10)
+
+static inline void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    return malloc(size);
+}
+
+static inline void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+#endif /* __ESP_HEAP_CAPS_H__ */
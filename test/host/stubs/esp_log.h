@@ -0,0 +1,17 @@
+/* host build stand-in, logging is compiled out so it cannot allocate or slow a test down;
+   the arguments are still type checked against the format */
+
+#ifndef __ESP_LOG_HOST_H__
+#define __ESP_LOG_HOST_H__
+
+#include <stdio.h>
+
+#define ESP_LOG_HOST(tag, fmt, ...)  do { if (0) printf("%s " fmt, tag, ##__VA_ARGS__); } while (0)
+
+#define ESP_LOGE(tag, fmt, ...)      ESP_LOG_HOST(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)      ESP_LOG_HOST(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)      ESP_LOG_HOST(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...)      ESP_LOG_HOST(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...)      ESP_LOG_HOST(tag, fmt, ##__VA_ARGS__)
+
+#endif /* __ESP_LOG_HOST_H__ */
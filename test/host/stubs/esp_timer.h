@@ -0,0 +1,17 @@
+#ifndef __ESP_TIMER_HOST_H__
+#define __ESP_TIMER_HOST_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* monotonic microseconds, from CLOCK_MONOTONIC unless a test provides its own */
+int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESP_TIMER_HOST_H__ */
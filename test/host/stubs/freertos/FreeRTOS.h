@@ -0,0 +1,43 @@
+/* host build stand-in for FreeRTOS on top of pthreads, enough for the bt_app_* modules */
+
+#ifndef __FREERTOS_HOST_H__
+#define __FREERTOS_HOST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOSConfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+typedef TickType_t portTickType;
+
+#define pdTRUE                       (1)
+#define pdFALSE                      (0)
+#define pdPASS                       pdTRUE
+#define portMAX_DELAY                ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS           (1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS             portTICK_PERIOD_MS
+
+/* critical sections share one host mutex, the lock argument is only there for the API */
+typedef struct {
+    int                  unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+
+void host_enter_critical(void);
+void host_exit_critical(void);
+
+#define portENTER_CRITICAL(mux)      ((void)(mux), host_enter_critical())
+#define portEXIT_CRITICAL(mux)       ((void)(mux), host_exit_critical())
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FREERTOS_HOST_H__ */
@@ -0,0 +1,7 @@
+#ifndef __FREERTOS_CONFIG_HOST_H__
+#define __FREERTOS_CONFIG_HOST_H__
+
+#define configTICK_RATE_HZ           (100)
+#define configMAX_PRIORITIES         (25)
+
+#endif /* __FREERTOS_CONFIG_HOST_H__ */
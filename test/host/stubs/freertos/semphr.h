@@ -0,0 +1,22 @@
+#ifndef __FREERTOS_SEMPHR_HOST_H__
+#define __FREERTOS_SEMPHR_HOST_H__
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct host_sem *SemaphoreHandle_t;
+typedef SemaphoreHandle_t xSemaphoreHandle;
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FREERTOS_SEMPHR_HOST_H__ */
@@ -0,0 +1,27 @@
+#ifndef __FREERTOS_TASK_HOST_H__
+#define __FREERTOS_TASK_HOST_H__
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct host_task *TaskHandle_t;
+typedef TaskHandle_t xTaskHandle;
+typedef void (*TaskFunction_t)(void *arg);
+
+/* tasks are detached threads, priorities and cores are ignored */
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                                   TaskHandle_t *handle, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+void taskYIELD(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FREERTOS_TASK_HOST_H__ */
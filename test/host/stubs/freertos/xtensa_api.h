@@ -0,0 +1 @@
+/* nothing from the Xtensa port is needed on the host */
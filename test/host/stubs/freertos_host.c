@@ -0,0 +1,272 @@
+/*
+   pthread implementation of the FreeRTOS calls the bt_app_* modules use, for host tests.
+   Queues and semaphores are created up front, so sending and receiving never allocate.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+struct host_queue {
+    pthread_mutex_t      lock;
+    pthread_cond_t       cond;
+    uint32_t             len;
+    uint32_t             item_size;
+    uint32_t             head;
+    uint32_t             count;
+    uint8_t              *items;
+};
+
+struct host_sem {
+    pthread_mutex_t      lock;
+    pthread_cond_t       cond;
+    uint32_t             max;
+    uint32_t             count;
+};
+
+struct host_task {
+    pthread_t            thread;
+    TaskFunction_t       fn;
+    void                 *arg;
+};
+
+static pthread_mutex_t m_critical = PTHREAD_MUTEX_INITIALIZER;
+
+void host_enter_critical(void)
+{
+    pthread_mutex_lock(&m_critical);
+}
+
+void host_exit_critical(void)
+{
+    pthread_mutex_unlock(&m_critical);
+}
+
+__attribute__((weak)) int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* wait deadline for a FreeRTOS tick count, NULL for portMAX_DELAY */
+static const struct timespec *host_deadline(TickType_t wait, struct timespec *ts)
+{
+    if (wait == portMAX_DELAY) {
+        return NULL;
+    }
+    clock_gettime(CLOCK_REALTIME, ts);
+    uint64_t ns = (uint64_t)ts->tv_nsec + (uint64_t)wait * portTICK_PERIOD_MS * 1000000;
+    ts->tv_sec += ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+    return ts;
+}
+
+static int host_wait(pthread_cond_t *cond, pthread_mutex_t *lock, const struct timespec *deadline)
+{
+    if (deadline == NULL) {
+        return pthread_cond_wait(cond, lock);
+    }
+    return pthread_cond_timedwait(cond, lock, deadline);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size)
+{
+    QueueHandle_t q = calloc(1, sizeof(struct host_queue));
+
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    q->len = len;
+    q->item_size = item_size;
+    q->items = malloc(len * item_size);
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t q)
+{
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->cond);
+    free(q->items);
+    free(q);
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait)
+{
+    struct timespec ts;
+    const struct timespec *deadline = host_deadline(wait, &ts);
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->len && wait != 0) {
+        if (host_wait(&q->cond, &q->lock, deadline) != 0) {
+            break;
+        }
+    }
+    if (q->count < q->len) {
+        memcpy(q->items + ((q->head + q->count) % q->len) * q->item_size, item, q->item_size);
+        q->count++;
+        pthread_cond_broadcast(&q->cond);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait)
+{
+    struct timespec ts;
+    const struct timespec *deadline = host_deadline(wait, &ts);
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && wait != 0) {
+        if (host_wait(&q->cond, &q->lock, deadline) != 0) {
+            break;
+        }
+    }
+    if (q->count > 0) {
+        memcpy(item, q->items + q->head * q->item_size, q->item_size);
+        q->head = (q->head + 1) % q->len;
+        q->count--;
+        pthread_cond_broadcast(&q->cond);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
+
+BaseType_t xQueueReset(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->head = 0;
+    q->count = 0;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t n = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    SemaphoreHandle_t sem = calloc(1, sizeof(struct host_sem));
+
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    sem->max = max;
+    sem->count = initial;
+    return sem;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->cond);
+    free(sem);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&sem->lock);
+    if (sem->count < sem->max) {
+        sem->count++;
+        pthread_cond_signal(&sem->cond);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return ret;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    struct timespec ts;
+    const struct timespec *deadline = host_deadline(wait, &ts);
+    BaseType_t ret = pdFALSE;
+
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0 && wait != 0) {
+        if (host_wait(&sem->cond, &sem->lock, deadline) != 0) {
+            break;
+        }
+    }
+    if (sem->count > 0) {
+        sem->count--;
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return ret;
+}
+
+static void *host_task_main(void *arg)
+{
+    struct host_task *task = arg;
+
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                                   TaskHandle_t *handle, BaseType_t core)
+{
+    struct host_task *task = calloc(1, sizeof(struct host_task));
+
+    (void)name;
+    (void)stack;
+    (void)prio;
+    (void)core;
+    task->fn = fn;
+    task->arg = arg;
+    if (pthread_create(&task->thread, NULL, host_task_main, task) != 0) {
+        free(task);
+        return pdFALSE;
+    }
+    pthread_detach(task->thread);
+    if (handle) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, handle, 0);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    /* the test process exits right after, a detached thread left blocked is fine */
+    (void)task;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = { 0, (long)ticks * portTICK_PERIOD_MS * 1000000 };
+
+    if (ticks == 0) {
+        sched_yield();
+    } else {
+        nanosleep(&ts, NULL);
+    }
+}
+
+void taskYIELD(void)
+{
+    sched_yield();
+}
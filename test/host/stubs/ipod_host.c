@@ -0,0 +1,120 @@
+/* host build stand-ins for what the iPod link calls outside bt_app_meta and bt_app_clock:
+   the Arduino clock, EQ presets, AVRCP pass-through and NVS */
+
+#include <string.h>
+#include "Arduino.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "bt_app_eq.h"
+#include "bt_app_pt.h"
+
+#define NVS_HOST_KEYS                (8)
+#define NVS_HOST_KEY_LEN             (16)
+
+typedef struct {
+    char                 key[NVS_HOST_KEY_LEN];
+    uint32_t             value;
+} nvs_host_entry_t;
+
+static nvs_host_entry_t m_nvs[NVS_HOST_KEYS];
+static uint32_t m_nvs_cnt = 0;
+
+static const char *const m_eq_names[] = { "Flat", "Bass", "Voice" };
+static uint32_t m_eq_selected = 0;
+
+unsigned long millis(void)
+{
+    return (unsigned long)(esp_timer_get_time() / 1000);
+}
+
+void delay(uint32_t ms)
+{
+    vTaskDelay(ms / portTICK_PERIOD_MS);
+}
+
+uint32_t bt_app_eq_count(void)
+{
+    return sizeof(m_eq_names) / sizeof(m_eq_names[0]);
+}
+
+const char *bt_app_eq_name(uint32_t index)
+{
+    return index < bt_app_eq_count() ? m_eq_names[index] : NULL;
+}
+
+bool bt_app_eq_select(uint32_t index)
+{
+    if (index >= bt_app_eq_count()) {
+        return false;
+    }
+    m_eq_selected = index;
+    return true;
+}
+
+uint32_t bt_app_eq_selected(void)
+{
+    return m_eq_selected;
+}
+
+bool bt_app_pt_play_control(uint8_t code)
+{
+    return true;
+}
+
+void nvs_host_erase(void)
+{
+    m_nvs_cnt = 0;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode, nvs_handle *out_handle)
+{
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+static nvs_host_entry_t *nvs_host_find(const char *key)
+{
+    for (uint32_t i = 0; i < m_nvs_cnt; i++) {
+        if (strncmp(m_nvs[i].key, key, NVS_HOST_KEY_LEN) == 0) {
+            return &m_nvs[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_get_u32(nvs_handle handle, const char *key, uint32_t *out_value)
+{
+    nvs_host_entry_t *e = nvs_host_find(key);
+
+    if (e == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *out_value = e->value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u32(nvs_handle handle, const char *key, uint32_t value)
+{
+    nvs_host_entry_t *e = nvs_host_find(key);
+
+    if (e == NULL) {
+        if (m_nvs_cnt == NVS_HOST_KEYS) {
+            return ESP_ERR_NO_MEM;
+        }
+        e = &m_nvs[m_nvs_cnt++];
+        strncpy(e->key, key, NVS_HOST_KEY_LEN - 1);
+    }
+    e->value = value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle handle)
+{
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle handle)
+{
+}
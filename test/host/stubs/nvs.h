@@ -0,0 +1,33 @@
+/* host build stand-in for NVS, one in-memory namespace of u32 values shared by all handles */
+
+#ifndef __NVS_HOST_H__
+#define __NVS_HOST_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t nvs_handle;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode;
+
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode, nvs_handle *out_handle);
+esp_err_t nvs_get_u32(nvs_handle handle, const char *key, uint32_t *out_value);
+esp_err_t nvs_set_u32(nvs_handle handle, const char *key, uint32_t value);
+esp_err_t nvs_commit(nvs_handle handle);
+void nvs_close(nvs_handle handle);
+
+/* forgets every stored value, as after an erase of the partition */
+void nvs_host_erase(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __NVS_HOST_H__ */
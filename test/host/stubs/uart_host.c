@@ -0,0 +1,138 @@
+/* host build stand-in for the UART driver: an rx ring and an event queue, tx goes to a callback */
+
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "driver/uart.h"
+#include "uart_host.h"
+
+typedef struct {
+    bool                 installed;
+    uint32_t             baud;
+    QueueHandle_t        queue;
+    uint8_t              *ring;
+    size_t               size;
+    size_t               head;            /*!< bytes written by the line */
+    size_t               tail;            /*!< bytes read by the firmware */
+} uart_host_port_t;
+
+static uart_host_port_t m_port[UART_NUM_MAX];
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static uart_host_tx_cb_t m_tx_cb = NULL;
+
+void uart_host_set_tx_callback(uart_host_tx_cb_t cb)
+{
+    m_tx_cb = cb;
+}
+
+uint32_t uart_host_baudrate(uart_port_t uart_num)
+{
+    return m_port[uart_num].baud;
+}
+
+bool uart_host_receive(uart_port_t uart_num, const uint8_t *data, size_t len, bool post_event)
+{
+    uart_host_port_t *p = &m_port[uart_num];
+    uart_event_t event = { UART_DATA, len };
+    bool ok = true;
+
+    pthread_mutex_lock(&m_lock);
+    for (size_t i = 0; i < len; i++) {
+        if (p->head - p->tail == p->size) {
+            ok = false;
+            break;
+        }
+        p->ring[p->head++ % p->size] = data[i];
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    if (!ok) {
+        event.type = UART_BUFFER_FULL;
+    }
+    if ((post_event || !ok) && p->queue) {
+        xQueueSend(p->queue, &event, 0);
+    }
+    return ok;
+}
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *uart_config)
+{
+    m_port[uart_num].baud = uart_config->baud_rate;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t *uart_queue, int intr_alloc_flags)
+{
+    uart_host_port_t *p = &m_port[uart_num];
+
+    if (p->installed) {
+        return ESP_FAIL;
+    }
+    p->ring = malloc(rx_buffer_size);
+    p->size = rx_buffer_size;
+    p->head = p->tail = 0;
+    p->queue = NULL;
+    if (uart_queue) {
+        p->queue = xQueueCreate(queue_size, sizeof(uart_event_t));
+        *uart_queue = p->queue;
+    }
+    p->installed = true;
+    return ESP_OK;
+}
+
+esp_err_t uart_intr_config(uart_port_t uart_num, const uart_intr_config_t *intr_conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t uart_num, uint32_t baudrate)
+{
+    m_port[uart_num].baud = baudrate;
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t *size)
+{
+    pthread_mutex_lock(&m_lock);
+    *size = m_port[uart_num].head - m_port[uart_num].tail;
+    pthread_mutex_unlock(&m_lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t uart_num)
+{
+    pthread_mutex_lock(&m_lock);
+    m_port[uart_num].tail = m_port[uart_num].head;
+    pthread_mutex_unlock(&m_lock);
+    return ESP_OK;
+}
+
+/* never waits, the firmware only reads what an event announced */
+int uart_read_bytes(uart_port_t uart_num, uint8_t *buf, uint32_t length, TickType_t ticks_to_wait)
+{
+    uart_host_port_t *p = &m_port[uart_num];
+    uint32_t n = 0;
+
+    pthread_mutex_lock(&m_lock);
+    while (n < length && p->tail != p->head) {
+        buf[n++] = p->ring[p->tail++ % p->size];
+    }
+    pthread_mutex_unlock(&m_lock);
+    return n;
+}
+
+int uart_write_bytes(uart_port_t uart_num, const char *src, size_t size)
+{
+    uart_host_tx_cb_t cb = m_tx_cb;
+
+    if (cb) {
+        cb((const uint8_t *)src, size);
+    }
+    return size;
+}
@@ -0,0 +1,34 @@
+/* line side of the host UART stand-in: what a head unit on the other end of the wire does */
+
+#ifndef __UART_HOST_LINE_H__
+#define __UART_HOST_LINE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "driver/uart.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* called from uart_write_bytes with what the firmware sends */
+typedef void (*uart_host_tx_cb_t)(const uint8_t *data, size_t len);
+
+void uart_host_set_tx_callback(uart_host_tx_cb_t cb);
+
+/**
+ * Bytes arriving on RX. With post_event the driver's UART_DATA event is queued as the rx
+ * timeout interrupt would after the last byte; without it the bytes only sit in the ring
+ * for a reader that polls uart_get_buffered_data_len. Returns false if the ring overflowed.
+ */
+bool uart_host_receive(uart_port_t uart_num, const uint8_t *data, size_t len, bool post_event);
+
+/* rate last set through uart_param_config or uart_set_baudrate */
+uint32_t uart_host_baudrate(uart_port_t uart_num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UART_HOST_LINE_H__ */
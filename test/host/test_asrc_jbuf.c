@@ -0,0 +1,151 @@
+/*
+   Host test: one simulated hour of A2DP playback through the PCM ring, the jitter
+   buffer controller and the drift resampler, with the source clock off by +-200 ppm.
+
+   Mirrors the BT_APP_ASRC path of bt_app_i2s.c: the source writes jittered packets
+   into the ring, the writer reads 256-frame blocks whenever the DMA has room, feeds
+   the fill level to bt_app_jbuf_update() and resamples with the correction. Fails
+   on any underrun or overflow after the prefill.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "bt_app_ringbuf.h"
+#include "bt_app_asrc.h"
+#include "bt_app_jbuf.h"
+
+#define RATE                (44100)
+#define SIM_SECONDS         (3600)
+#define STEP_US             (500)
+
+/* sdkconfig defaults: 16 KiB ring, 40 ms jitter target */
+#define RING_BYTES          (16384)
+#define TARGET_FRAMES       (40 * RATE / 1000)
+
+/* SBC packets of 512 frames, each delivered up to 15 ms late */
+#define PKT_FRAMES          (512)
+#define PKT_JITTER_US       (15000)
+
+/* writer block and DMA depth as in bt_app_i2s.c */
+#define BLOCK_FRAMES        (256)
+#define DMA_FRAMES          (4 * BLOCK_FRAMES)
+
+typedef struct {
+    uint32_t underruns;
+    uint32_t overflows;
+    uint32_t fill_min;
+    uint32_t fill_max;
+    int32_t  ppb;
+} sim_result_t;
+
+static uint32_t m_rng = 0x12345678;
+
+static uint32_t rng_next(void)
+{
+    m_rng ^= m_rng << 13;
+    m_rng ^= m_rng >> 17;
+    m_rng ^= m_rng << 5;
+    return m_rng;
+}
+
+static sim_result_t simulate(double drift_ppm)
+{
+    static int16_t pkt[PKT_FRAMES * 2];
+    static int16_t in[BLOCK_FRAMES * 2];
+    static int16_t out[BLOCK_FRAMES * 3 + 4][2];
+
+    bt_app_ringbuf_t rb;
+    bt_app_asrc_t asrc;
+    bt_app_jbuf_t jb;
+    sim_result_t res = { 0, 0, UINT32_MAX, 0, 0 };
+
+    bt_app_ringbuf_init(&rb, RING_BYTES, 0);
+    bt_app_asrc_init(&asrc, RATE, RATE);
+
+    double src_rate = RATE * (1.0 + drift_ppm * 1e-6);
+    double phase = 0.0;
+    uint64_t pkt_no = 0;
+    uint64_t pkt_due_us = 0;
+    double dma_frames = 0.0;
+    int playing = 0;
+
+    for (uint64_t now = 0; now < (uint64_t)SIM_SECONDS * 1000000; now += STEP_US) {
+        /* source side, in order; a late packet also holds back the ones behind it */
+        while (pkt_due_us <= now) {
+            for (uint32_t i = 0; i < PKT_FRAMES; i++) {
+                int16_t v = (int16_t)(12000 * sin(phase));
+                phase += 2 * M_PI * 1000.0 / src_rate;
+                pkt[2 * i] = v;
+                pkt[2 * i + 1] = v;
+            }
+            if (bt_app_ringbuf_write(&rb, (const uint8_t *)pkt, sizeof(pkt)) != sizeof(pkt)) {
+                res.overflows++;
+            }
+            pkt_no++;
+            uint64_t ideal = (uint64_t)(pkt_no * PKT_FRAMES * 1e6 / src_rate);
+            uint64_t due = ideal + rng_next() % PKT_JITTER_US;
+            pkt_due_us = due > pkt_due_us ? due : pkt_due_us;
+        }
+
+        uint32_t fill = bt_app_ringbuf_fill(&rb) / 4;
+        if (!playing) {
+            if (fill < TARGET_FRAMES) {
+                continue;
+            }
+            bt_app_jbuf_init(&jb, TARGET_FRAMES, fill);
+            playing = 1;
+        }
+
+        /* sink side, the DMA drains at the local rate */
+        dma_frames -= RATE * STEP_US / 1e6;
+        if (dma_frames < 0) {
+            dma_frames = 0;
+        }
+        while (dma_frames < DMA_FRAMES - BLOCK_FRAMES) {
+            fill = bt_app_ringbuf_fill(&rb) / 4;
+            uint32_t frames = bt_app_ringbuf_read(&rb, (uint8_t *)in, sizeof(in)) / 4;
+            if (frames == 0) {
+                res.underruns++;
+                break;
+            }
+            bt_app_asrc_set_drift(&asrc, bt_app_jbuf_update(&jb, fill));
+            dma_frames += bt_app_asrc_process(&asrc, in, frames, &out[0][0]);
+
+            /* skip the first minute while the controller learns the drift */
+            if (now > 60 * 1000000ULL) {
+                if (fill < res.fill_min) {
+                    res.fill_min = fill;
+                }
+                if (fill > res.fill_max) {
+                    res.fill_max = fill;
+                }
+            }
+        }
+    }
+
+    res.ppb = asrc.ppb;
+    bt_app_ringbuf_deinit(&rb);
+    return res;
+}
+
+int main(void)
+{
+    static const double drifts[] = { 200.0, -200.0, 0.0 };
+    int fails = 0;
+
+    for (uint32_t i = 0; i < sizeof(drifts) / sizeof(drifts[0]); i++) {
+        sim_result_t r = simulate(drifts[i]);
+        int32_t expect = (int32_t)(drifts[i] * 1000);
+        int ok = r.underruns == 0 && r.overflows == 0 && abs(r.ppb - expect) <= 20000;
+
+        printf("%+6.1f ppm: %u underruns, %u overflows, fill %u..%u frames (target %u), correction %d ppb  %s\n",
+               drifts[i], r.underruns, r.overflows, r.fill_min, r.fill_max, TARGET_FRAMES, r.ppb,
+               ok ? "ok" : "FAIL");
+        if (!ok) {
+            fails++;
+        }
+    }
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+/*
+   Host test: the work dispatcher must not touch the heap per event.
+
+   malloc, calloc, realloc and free are interposed and counted while a burst of
+   events goes through bt_app_core: plain high lane posts, posts with a copy
+   callback that deep-copies text into the arena, and coalesced low lane posts.
+   Fails if anything was allocated between the first post and the last dispatch.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "bt_app_core.h"
+
+#define BURST_EVENTS        (20000)
+/* posts between waits for the task, well under the shorter lane */
+#define BATCH               (8)
+
+#define EVT_PLAIN           (1)
+#define EVT_TEXT            (2)
+#define EVT_COALESCED       (3)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static volatile bool m_counting = false;
+static volatile uint32_t m_allocs = 0;
+static volatile uint32_t m_frees = 0;
+
+void *malloc(size_t size)
+{
+    if (m_counting) {
+        __atomic_fetch_add(&m_allocs, 1, __ATOMIC_RELAXED);
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    if (m_counting) {
+        __atomic_fetch_add(&m_allocs, 1, __ATOMIC_RELAXED);
+    }
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (m_counting) {
+        __atomic_fetch_add(&m_allocs, 1, __ATOMIC_RELAXED);
+    }
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    if (m_counting && ptr) {
+        __atomic_fetch_add(&m_frees, 1, __ATOMIC_RELAXED);
+    }
+    __libc_free(ptr);
+}
+
+static volatile uint32_t m_handled = 0;
+static volatile uint32_t m_text_bad = 0;
+
+static void handler(uint16_t event, void *param)
+{
+    if (event == EVT_TEXT) {
+        esp_avrc_ct_cb_param_t *rc = param;
+        if (rc == NULL || rc->meta_rsp.attr_length != 11 || memcmp(rc->meta_rsp.attr_text, "Hello world", 12) != 0) {
+            m_text_bad++;
+        }
+    }
+    __atomic_fetch_add(&m_handled, 1, __ATOMIC_RELEASE);
+}
+
+static void copy_text(bt_app_msg_t *msg, void *p_dest, void *p_src)
+{
+    esp_avrc_ct_cb_param_t *dst = p_dest;
+    esp_avrc_ct_cb_param_t *src = p_src;
+
+    dst->meta_rsp.attr_text = (uint8_t *)bt_app_msg_text_dup(msg, src->meta_rsp.attr_text, src->meta_rsp.attr_length,
+                                                             &dst->meta_rsp.attr_length);
+}
+
+/* wait until the task drained everything posted so far */
+static void drain(uint32_t posted)
+{
+    bt_app_lane_stats_t hi, lo;
+
+    for (int spins = 0; spins < 100000; spins++) {
+        bt_app_get_lane_stats(BT_APP_LANE_HIGH, &hi);
+        bt_app_get_lane_stats(BT_APP_LANE_LOW, &lo);
+        if (__atomic_load_n(&m_handled, __ATOMIC_ACQUIRE) + hi.coalesced + lo.coalesced + hi.dropped + lo.dropped >= posted) {
+            return;
+        }
+        usleep(10);
+    }
+}
+
+int main(void)
+{
+    static uint8_t text[] = "Hello world";
+    bt_app_lane_stats_t hi, lo;
+    uint32_t posted = 0;
+
+    bt_app_task_start_up();
+    /* let the task reach its first wait, its thread stack is not a per-event cost */
+    usleep(10000);
+
+    m_counting = true;
+    for (uint32_t i = 0; i < BURST_EVENTS; i++) {
+        esp_a2d_cb_param_t a2d;
+        esp_avrc_ct_cb_param_t rc;
+
+        switch (i % 3) {
+        case 0:
+            memset(&a2d, 0, sizeof(a2d));
+            a2d.conn_stat.state = i;
+            bt_app_work_dispatch(handler, EVT_PLAIN, &a2d, sizeof(a2d), NULL);
+            break;
+        case 1:
+            rc.meta_rsp.attr_id = 1;
+            rc.meta_rsp.attr_text = text;
+            rc.meta_rsp.attr_length = 11;
+            bt_app_work_post(handler, EVT_TEXT, &rc, sizeof(rc), copy_text, BT_APP_LANE_LOW, BT_APP_COALESCE_NONE);
+            break;
+        default:
+            rc.change_ntf.event_id = 5;
+            rc.change_ntf.event_parameter = i;
+            bt_app_work_post(handler, EVT_COALESCED, &rc, sizeof(rc), NULL, BT_APP_LANE_LOW, 0x0105);
+            break;
+        }
+        posted++;
+
+        if (posted % BATCH == 0) {
+            drain(posted);
+        }
+    }
+    drain(posted);
+    m_counting = false;
+
+    bt_app_get_lane_stats(BT_APP_LANE_HIGH, &hi);
+    bt_app_get_lane_stats(BT_APP_LANE_LOW, &lo);
+    printf("%u events posted, %u handled, %u coalesced, %u dropped, %u bad text copies\n",
+           posted, m_handled, hi.coalesced + lo.coalesced, hi.dropped + lo.dropped, m_text_bad);
+    printf("heap: %u allocations, %u frees during the burst\n", m_allocs, m_frees);
+
+    bool ok = m_allocs == 0 && m_frees == 0 && m_text_bad == 0 && m_handled > 0 &&
+              m_handled + hi.coalesced + lo.coalesced + hi.dropped + lo.dropped == posted;
+    printf("%s\n", ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+/*
+   Host test: what the iPod link sends back for each kind of incoming command.
+
+   Frames go through iPod::receive() and whatever reaches the UART driver is captured.
+   ACKs and responses from the head unit must get nothing back; answering them would
+   start an ACK loop with head units that ACK everything. Unknown commands get an
+   IPOD_ERROR_UNKNOWN_ID ACK and short ones IPOD_ERROR_BAD_PARAMETER, each in the
+   ACK format of its lingo. Expected replies are written out byte for byte. A reply
+   queued behind another one must be timed to its first byte on the wire, not to the
+   moment it was queued.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <initializer_list>
+#include <vector>
+#include "iPod.h"
+#include "esp_timer.h"
+#include "uart_host.h"
+
+static std::vector<uint8_t> sent;
+static int failures = 0;
+
+static void onTx(const uint8_t* data, size_t len)
+{
+    sent.insert(sent.end(), data, data + len);
+}
+
+// feeds one framed command and returns what the link wrote back
+static std::vector<uint8_t> exchange(iPod& ipod, std::initializer_list<uint8_t> payload)
+{
+    std::vector<uint8_t> in(payload);
+    uint8_t frame[MAX_FRAME_SIZE];
+    uint32_t len = iPod::frame(in.data(), in.size(), frame);
+
+    sent.clear();
+    ipod.receive(frame, len, esp_timer_get_time());
+    return sent;
+}
+
+static void expectReply(const char* name, const std::vector<uint8_t>& got, std::initializer_list<uint8_t> want)
+{
+    if (got.size() == want.size() && std::equal(got.begin(), got.end(), want.begin()))
+        return;
+
+    failures++;
+    printf("FAIL %s\n  got ", name);
+    for (uint8_t c : got)
+        printf(" %02X", c);
+    printf("\n  want");
+    for (uint8_t c : want)
+        printf(" %02X", c);
+    printf("\n");
+}
+
+int main()
+{
+    iPod ipod(IPOD_UART_NUM);
+
+    uart_host_set_tx_callback(onTx);
+
+    // replies from the head unit are only counted
+    expectReply("general ACK", exchange(ipod, { IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_ACK, IPOD_ERROR_OK, 0x0E }), {});
+    expectReply("general ACK with an error",
+        exchange(ipod, { IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_ACK, IPOD_ERROR_BAD_PARAMETER, 0x0E }), {});
+    expectReply("RetAccessoryInfo", exchange(ipod, { IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_RET_ACCESSORY_INFO, 0x00, 0x01 }), {});
+    expectReply("display remote ACK",
+        exchange(ipod, { IPOD_LINGO_DISPLAY_REMOTE, IPOD_CMD_DISPLAY_REMOTE_ACK, IPOD_ERROR_OK, 0x03 }), {});
+    expectReply("extended interface ACK",
+        exchange(ipod, { IPOD_LINGO_EXTENDED_INTERFACE, 0x00, IPOD_CMD_EXTENDED_INTERFACE_ACK, IPOD_ERROR_OK, 0x00, 0x29 }), {});
+    expectReply("ReturnPlayStatus", exchange(ipod, { IPOD_LINGO_EXTENDED_INTERFACE, 0x00,
+        IPOD_CMD_EXTENDED_INTERFACE_RETURN_PLAY_STATUS, 0, 0, 0, 0, 0, 0, 0, 0, 0 }), {});
+
+    // unknown commands are NACKed in the ACK format of their lingo
+    expectReply("unknown general command", exchange(ipod, { IPOD_LINGO_GENERAL, 0x50 }),
+        { 0xFF, 0x55, 0x04, 0x00, 0x02, 0x05, 0x50, 0xA5 });
+    expectReply("unknown extended interface command", exchange(ipod, { IPOD_LINGO_EXTENDED_INTERFACE, 0x00, 0x50 }),
+        { 0xFF, 0x55, 0x06, 0x04, 0x00, 0x01, 0x05, 0x00, 0x50, 0xA0 });
+
+    // a handled command with a short payload
+    expectReply("short SetCurrentEQProfileIndex",
+        exchange(ipod, { IPOD_LINGO_DISPLAY_REMOTE, IPOD_CMD_DISPLAY_REMOTE_SET_CURRENT_EQ_PROFILE_INDEX }),
+        { 0xFF, 0x55, 0x04, 0x03, 0x00, 0x04, 0x03, 0xF2 });
+
+    // and a handled one still answers
+    expectReply("PlayControl", exchange(ipod, { IPOD_LINGO_EXTENDED_INTERFACE, 0x00,
+        IPOD_CMD_EXTENDED_INTERFACE_PLAY_CONTROL, IPOD_PLAY_CONTROL_PLAY }),
+        { 0xFF, 0x55, 0x06, 0x04, 0x00, 0x01, 0x00, 0x00, 0x29, 0xCC });
+
+    if (ipod.framesReceived() != 10)
+    {
+        failures++;
+        printf("FAIL %u frames parsed, 10 sent\n", ipod.framesReceived());
+    }
+
+    // two requests back to back, the second reply waits for the first to go out
+    {
+        iPod fresh(IPOD_UART_NUM);
+        std::vector<uint8_t> first = exchange(fresh, { IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_REQUEST_IPOD_MODEL_NUM });
+        exchange(fresh, { IPOD_LINGO_GENERAL, IPOD_CMD_GENERAL_REQUEST_IPOD_MODEL_NUM });
+
+        uint32_t behind = first.size() * 10 * 1000000 / IPOD_UART_BAUD;
+        if (fresh.responseUsMax() < behind * 9 / 10 || fresh.responseUsMax() > behind + 2000)
+        {
+            failures++;
+            printf("FAIL second reply timed at %u us, %u us of reply ahead of it\n", fresh.responseUsMax(), behind);
+        }
+    }
+
+    printf("%s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,178 @@
+/*
+   Host test: ipod_packet.h against known-good frames, byte for byte.
+
+   Every expected frame below is written out by hand, sync, length and checksum
+   included, so a layout or checksum mistake in the builder cannot also hide in the
+   expectation. Covers the run-time pkt::Frame with U8, Be16, Be32 and Str<N>
+   fields, Str<N> truncation at N - 1 characters, compile-time ConstFrame, the
+   exact maxSize of each layout and the unaligned big endian readers.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "ipod_packet.h"
+
+using pkt::U8;
+using pkt::Be16;
+using pkt::Be32;
+using pkt::Str;
+
+static int failures = 0;
+
+static void expectBytes(const char* name, const uint8_t* got, uint32_t gotLen, const uint8_t* want, uint32_t wantLen)
+{
+    if (gotLen == wantLen && memcmp(got, want, wantLen) == 0)
+        return;
+
+    failures++;
+    printf("FAIL %s\n  got ", name);
+    for (uint32_t i = 0; i < gotLen; ++i)
+        printf(" %02X", got[i]);
+    printf("\n  want");
+    for (uint32_t i = 0; i < wantLen; ++i)
+        printf(" %02X", want[i]);
+    printf("\n");
+}
+
+template <uint32_t N>
+static void expectFrame(const char* name, const uint8_t* got, uint32_t gotLen, const uint8_t (&want)[N])
+{
+    expectBytes(name, got, gotLen, want, N);
+}
+
+static void expect(const char* name, bool ok)
+{
+    if (!ok)
+    {
+        failures++;
+        printf("FAIL %s\n", name);
+    }
+}
+
+// the same rule the head unit applies: length, payload and checksum sum to zero
+static bool checksumOk(const uint8_t* frame, uint32_t len)
+{
+    uint8_t sum = 0;
+
+    for (uint32_t i = 2; i < len; ++i)
+        sum += frame[i];
+    return sum == 0;
+}
+
+static void testFrames()
+{
+    // extended interface ACK of PlayControl, success
+    {
+        const pkt::Frame<U8, U8, U8, U8, U8, U8> f(0x04, 0x00, 0x01, 0x00, 0x00, 0x29);
+        const uint8_t want[] = { 0xFF, 0x55, 0x06, 0x04, 0x00, 0x01, 0x00, 0x00, 0x29, 0xCC };
+        expectFrame("extended interface ACK", f.bytes, f.len, want);
+    }
+
+    // ReturnPlayStatus: 240000 ms long, 74565 ms in, playing
+    {
+        const pkt::Frame<U8, U8, U8, Be32, Be32, U8> f(0x04, 0x00, 0x1D, 240000, 0x00012345, 0x01);
+        const uint8_t want[] = {
+            0xFF, 0x55, 0x0C, 0x04, 0x00, 0x1D, 0x00, 0x03, 0xA9, 0x80, 0x00, 0x01, 0x23, 0x45, 0x01, 0x3D
+        };
+        expectFrame("play status", f.bytes, f.len, want);
+    }
+
+    // PlayStatusChangeNotification, track time offset in ms
+    {
+        const pkt::Frame<U8, U8, U8, U8, Be32> f(0x04, 0x00, 0x27, 0x04, 0x12345678);
+        const uint8_t want[] = { 0xFF, 0x55, 0x08, 0x04, 0x00, 0x27, 0x04, 0x12, 0x34, 0x56, 0x78, 0xB5 };
+        expectFrame("time offset notification", f.bytes, f.len, want);
+    }
+
+    // Be16 keeps the high byte first
+    {
+        const pkt::Frame<U8, U8, Be16> f(0x03, 0x02, 0xABCD);
+        const uint8_t want[] = { 0xFF, 0x55, 0x04, 0x03, 0x02, 0xAB, 0xCD, 0x7F };
+        expectFrame("be16", f.bytes, f.len, want);
+    }
+}
+
+static void testStrings()
+{
+    typedef pkt::Frame<U8, U8, U8, Str<8>> TitleFrame;
+
+    // cut to 7 characters and the NUL
+    {
+        const TitleFrame f(0x04, 0x00, 0x21, "Hello, world");
+        const uint8_t want[] = {
+            0xFF, 0x55, 0x0B, 0x04, 0x00, 0x21, 'H', 'e', 'l', 'l', 'o', ',', ' ', 0x00, 0x90
+        };
+        expectFrame("string cut to N - 1", f.bytes, f.len, want);
+        expect("string cut fills maxSize", f.len == TitleFrame::maxSize);
+    }
+
+    // exactly N - 1 characters is not cut
+    {
+        const TitleFrame f(0x04, 0x00, 0x21, "Hello, ");
+        const uint8_t want[] = {
+            0xFF, 0x55, 0x0B, 0x04, 0x00, 0x21, 'H', 'e', 'l', 'l', 'o', ',', ' ', 0x00, 0x90
+        };
+        expectFrame("string of N - 1", f.bytes, f.len, want);
+    }
+
+    // shorter strings make a shorter frame, the checksum follows the NUL
+    {
+        const TitleFrame f(0x04, 0x00, 0x21, "Hi");
+        const uint8_t want[] = { 0xFF, 0x55, 0x06, 0x04, 0x00, 0x21, 'H', 'i', 0x00, 0x24 };
+        expectFrame("short string", f.bytes, f.len, want);
+    }
+
+    {
+        const TitleFrame f(0x04, 0x00, 0x21, "");
+        const uint8_t want[] = { 0xFF, 0x55, 0x04, 0x04, 0x00, 0x21, 0x00, 0xD7 };
+        expectFrame("empty string", f.bytes, f.len, want);
+    }
+}
+
+// ReturnProtocolVersion 1.28, folded at compile time
+typedef pkt::ConstFrame<0x04, 0x00, 0x13, 0x01, 0x1C> ProtocolVersionFrame;
+
+static_assert(ProtocolVersionFrame::size == 9, "const frame size");
+static_assert(ProtocolVersionFrame::bytes[8] == 0xC7, "const frame checksum at compile time");
+static_assert(pkt::Frame<U8, U8, U8, Be32, Be32, U8>::maxSize == 3 + 12 + 1, "exact frame size");
+static_assert(pkt::Frame<U8, U8, U8, Str<128>>::maxSize == 3 + 3 + 128 + 1, "string frame size");
+static_assert(pkt::Frame<U8, U8, Be16>::maxPayload == 4, "be16 payload size");
+
+static void testConstFrames()
+{
+    const uint8_t want[] = { 0xFF, 0x55, 0x05, 0x04, 0x00, 0x13, 0x01, 0x1C, 0xC7 };
+    expectFrame("const protocol version", ProtocolVersionFrame::bytes, ProtocolVersionFrame::size, want);
+}
+
+static void testReaders()
+{
+    // odd offsets, as the fields sit in a received payload
+    const uint8_t buf[] = { 0x00, 0x12, 0x34, 0x56, 0x78, 0x9A };
+
+    expect("getBe32 unaligned", pkt::getBe32(buf + 1) == 0x12345678);
+    expect("getBe16 unaligned", pkt::getBe16(buf + 3) == 0x5678);
+    expect("getBe16 high bit", pkt::getBe16(buf + 4) == 0x789A);
+}
+
+static void testChecksums()
+{
+    // a sweep of field values, each frame still sums to zero
+    for (uint32_t v = 0; v < 0x10000; v += 0x0101)
+    {
+        const pkt::Frame<U8, Be16, Be32> f(static_cast<uint8_t>(v), static_cast<uint16_t>(v), v * 0x01010101u);
+        expect("checksum sums to zero", checksumOk(f.bytes, f.len));
+    }
+}
+
+int main()
+{
+    testFrames();
+    testStrings();
+    testConstFrames();
+    testReaders();
+    testChecksums();
+
+    printf("%s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}